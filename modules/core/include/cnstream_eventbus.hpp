@@ -121,6 +121,14 @@ class EventBus {
    * @note Block until get a event or bus stopped.
    ************************************************************************/
   Event PollEvent();
+  /************************************************************************
+   * Start the bus, events can be posted and polled.
+   ************************************************************************/
+  void Start();
+  /************************************************************************
+   * Stop the bus, wakes up the threads blocked in PollEvent.
+   ************************************************************************/
+  void Stop();
   const std::list<std::pair<BusWatcher, Module *>> &GetBusWatchers() const;
   /************************************************************************
    * Remove all bus watchers.
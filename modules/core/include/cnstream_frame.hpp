@@ -27,6 +27,9 @@
  *  This file contains a declaration of struct CNFrameInfo and its subtructure.
  */
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -74,7 +77,9 @@ typedef struct {
  * The mask of CNDataFrame
  */
 enum CNFrameFlag {
-  CN_FRAME_FLAG_EOS = 1 << 0  ///> Identifies the end of data stream.
+  CN_FRAME_FLAG_EOS = 1 << 0,     ///> Identifies the end of data stream.
+  CN_FRAME_FLAG_PARTIAL = 1 << 1  ///> Processed by a module with several input links before all of them had
+                                  ///> it, see Pipeline::SetModuleJoinTimeout.
 };
 
 /**
@@ -110,6 +115,7 @@ class IDataDeallocator {
 };
 
 class Module;
+struct FrameMemoryAccount;
 /**
  * The structure contains a frame of data and describes infomation
  * about this frame.
@@ -163,16 +169,115 @@ struct CNDataFrame {
    */
   void CopyToSyncMem();
 
+  /**
+   * The data queues spilling to disk (QUEUE_IMPL_SPILL) info.
+   * Do not call it.
+   *
+   * @return Return true if the planes may be moved out of memory by SpillPlanes and ReleasePlanes: host data
+   *   copied by CopyToSyncMem, shared with no other frame, and no image derived from it. Whether the frame
+   *   itself is held by anybody else is up to the caller.
+   */
+  bool IsSpillable() const;
+  /**
+   * The data queues spilling to disk (QUEUE_IMPL_SPILL) info.
+   * Do not call it.
+   *
+   * Copy the planes to dst, GetBytes() bytes. They stay in memory until ReleasePlanes.
+   */
+  void SpillPlanes(void* dst);
+  /**
+   * The data queues spilling to disk (QUEUE_IMPL_SPILL) info.
+   * Do not call it.
+   *
+   * Free the planes and give their memory charges back. Nobody else may hold the frame.
+   */
+  void ReleasePlanes();
+  /**
+   * The data queues spilling to disk (QUEUE_IMPL_SPILL) info.
+   * Do not call it.
+   *
+   * Copy the planes back from src as written by SpillPlanes.
+   */
+  void RestorePlanes(const void* src);
+
   /**
    * The pipeline stages (modules) info.
    * Do not call it.
+   *
+   * Allocate the module masks for a pipeline with module_num modules. Does nothing if
+   * they have been allocated. Called before the frame is shared between threads.
    */
-  void SetModuleMask(Module* module, Module* current);
+  void InitModuleMask(size_t module_num);
   /**
    * The pipeline stages (modules) info.
    * Do not call it.
+   *
+   * Mark the frame has been got by module from its input_idx-th input link. threadsafe function.
+   *
+   * @return
+   *   Return mask of the input links the frame has been got from, after add mask. 0 if the frame has not been
+   *   provided to a pipeline with module, see InitModuleMask.
    */
-  unsigned long GetModulesMask(Module* module);
+  uint64_t SetModuleMask(Module* module, size_t input_idx);
+  /**
+   * The pipeline stages (modules) info.
+   *
+   * @return
+   *   Return mask of the input links of module the frame has been got from, one bit for each. The frame may
+   *   have gone on before it was got from all of them, see IsModuleMaskJoined and CN_FRAME_FLAG_PARTIAL.
+   */
+  uint64_t GetModulesMask(Module* module);
+  /**
+   * The pipeline stages (modules) info.
+   * Do not call it.
+   *
+   * Count an input link of module the frame is sent on only to be passed on, see RoutePredicate. threadsafe
+   * function.
+   */
+  void AddRoutedMask(Module* module);
+  /**
+   * The pipeline stages (modules) info.
+   *
+   * @return
+   *   Return true if the frame is to be processed by module once got from the input links in mask, false if
+   *   it is only passed on (it has been sent on all of them only to be passed on).
+   */
+  bool ModuleMaskGot(Module* module, uint64_t mask);
+  /**
+   * The pipeline stages (modules) info.
+   *
+   * @return
+   *   Return true if the frame has been sent to module only to be passed on, and did not go on without some
+   *   input links, see RoutePredicate.
+   */
+  bool IsModuleMaskPassedOn(Module* module);
+  /**
+   * The pipeline stages (modules) info.
+   * Do not call it.
+   *
+   * Mark the frame got by module from all its input links. threadsafe function.
+   *
+   * @return
+   *   Return false if the frame has been joined before, see CloseModuleMask.
+   */
+  bool CompleteModuleMask(Module* module);
+  /**
+   * The pipeline stages (modules) info.
+   * Do not call it.
+   *
+   * Mark the frame joined by module before it has been got from all input links in join_mask. threadsafe function.
+   *
+   * @return
+   *   Return false if it has been got from all of them already, or from none.
+   */
+  bool CloseModuleMask(Module* module, uint64_t join_mask);
+  /**
+   * The pipeline stages (modules) info.
+   *
+   * @return
+   *   Return true if the frame went on from module before it was got from all input links, see CloseModuleMask.
+   */
+  bool IsModuleMaskJoined(Module* module);
   /**
    * The pipeline stages (modules) info.
    * Do not call it.
@@ -189,9 +294,9 @@ struct CNDataFrame {
    *   module[in]: The mask is from this module.
    *
    * @return
-   *   Return mask after add mask.
+   *   Return the number of modules which have added EOS mask, including this one.
    */
-  unsigned long AddEOSMask(Module* module);
+  size_t AddEOSMask(Module* module);
 
  public:
   void* cpu_data = nullptr;  ///> CPU data pointer. Should be allocated by CNStreamMallocHost().
@@ -206,12 +311,45 @@ struct CNDataFrame {
   cv::Mat* bgr_mat = nullptr;
 #endif
  private:
-  std::mutex modules_mutex;
-  /*Module mask map, identify which modules the data can already be processed by.*/
-  std::map<unsigned int, unsigned long> module_mask_map_;
+  /*
+    The state of the join of the frame at a module. links identify which input links of the module the
+    frame has already been got from.
+   */
+  struct ModuleMaskState {
+    std::atomic<uint64_t> links{0};
+    std::atomic<uint32_t> routed{0};  ///< input links sent on only to be passed on, see AddRoutedMask
+    std::atomic<int> join{0};         ///< kJoinOpen, kJoinComplete or kJoinClosed
+  };
+  static constexpr int kJoinOpen = 0;
+  static constexpr int kJoinComplete = 1;  ///< got from all input links, see CompleteModuleMask
+  static constexpr int kJoinClosed = 2;    ///< went on without some, see CloseModuleMask
+  /* nullptr if the frame has no mask for module, see InitModuleMask */
+  ModuleMaskState* ModuleMask(Module* module);
+
+  /*
+    Module masks indexed by Module::GetId(). Small pipelines use the inline ones.
+   */
+  static constexpr size_t kInlineModuleMaskNum = 16;
+  ModuleMaskState inline_module_masks_[kInlineModuleMaskNum];
+  std::unique_ptr<ModuleMaskState[]> module_masks_;
+  size_t module_num_ = 0;
+
+  std::atomic<size_t> eos_cnt_{0};
 
-  std::mutex eos_mutex;
-  unsigned long eos_mask = 0;
+  /*
+    Charge memory held by the frame to its stream and to the module owning the calling thread, see
+    FrameMemoryOwner. Released on destruction. planes is true for the frame data, the size sources
+    expect the next frame of the stream to hold, see SetFrameMemoryBudget.
+   */
+  void ChargeMemory(uint64_t host_bytes, uint64_t device_bytes, bool planes);
+  void ReleaseMemory();
+  struct MemoryCharge {
+    FrameMemoryAccount* module;  ///< nullptr if no module owned the calling thread
+    uint64_t host_bytes;
+    uint64_t device_bytes;
+  };
+  std::vector<MemoryCharge> memory_charges_;
+  FrameMemoryAccount* memory_account_ = nullptr;  ///< of stream_id, set by the first charge
 };  // struct CNDataFrame
 
 /**
@@ -370,6 +508,16 @@ struct CNFrameInfo {
   uint32_t channel_idx;                              ///> Channel index.
   CNDataFrame frame;                                 ///> Frame data.
   std::vector<std::shared_ptr<CNInferObject>> objs;  ///> Structured informations of objects for this frame.
+  int priority = 0;     ///> Priority class of the stream, higher ones are served first by QUEUE_IMPL_FAIR queues.
+  uint32_t weight = 1;  ///> Share of the stream within its priority class in QUEUE_IMPL_FAIR queues.
+  int64_t create_time_us = 0;      ///> Steady clock time of Create, in microseconds.
+  uint32_t latency_budget_ms = 0;  ///> How long after Create the frame is worth processing, 0 for no limit.
+  /**
+   * @return Return true if the frame is out of its latency budget. EOS frames never are.
+   *
+   * @see Module::SetStaleFrameSkippable
+   */
+  bool IsStale() const;
   ~CNFrameInfo();
 
  private:
@@ -377,6 +525,11 @@ struct CNFrameInfo {
   DISABLE_COPY_AND_ASSIGN(CNFrameInfo);
   static std::mutex mutex_;
   static std::map<std::string, int> stream_count_map_;
+  static std::condition_variable credit_cond_;
+  static std::atomic<int> credit_waiters_;  ///< threads in WaitForFrameCredit, credit_cond_ is notified if any
+  friend bool HasFrameCredit(const std::string& stream_id);
+  friend bool WaitForFrameCredit(const std::string& stream_id, const std::function<bool()>& stop);
+  friend void WakeupFrameCreditWaiters();
 
  public:
   static int parallelism_;
@@ -389,6 +542,82 @@ struct CNFrameInfo {
  */
 void SetParallelism(int parallelism);
 
+/**
+ * Whether the stream may create one more frame before the limit set by SetParallelism, and within its memory
+ * budget set by SetFrameMemoryBudget and SetStreamFrameMemoryBudget.
+ * Sources check it before decoding, so that no frame is decoded only to be dropped by CNFrameInfo::Create.
+ *
+ * @return Return true if CNFrameInfo::Create will not fail for the stream and one more frame fits in the memory
+ *         budgets. Always true when the limits are disabled.
+ */
+bool HasFrameCredit(const std::string& stream_id);
+
+/**
+ * Block until the stream may create one more frame, or until stop returns true. stop is checked again each
+ * time a frame is released, and on WakeupFrameCreditWaiters.
+ *
+ * @return Return true if the stream may create one more frame, false if stopped.
+ */
+bool WaitForFrameCredit(const std::string& stream_id, const std::function<bool()>& stop);
+
+/**
+ * Wake up the threads blocked in WaitForFrameCredit to check their stop condition.
+ */
+void WakeupFrameCreditWaiters();
+
+/**
+ * Host and MLU memory held by frames, in bytes. Counts the frame data copied by CNDataFrame::CopyToSyncMem,
+ * or the decoder buffers it holds, and the images derived by CNDataFrame::ImageBGR.
+ */
+struct CNFrameMemoryUsage {
+  uint64_t host_bytes = 0;    ///> Bytes of host memory.
+  uint64_t device_bytes = 0;  ///> Bytes of MLU memory.
+};
+
+/**
+ * Limit the memory held by the frames of all streams together, 0 for no limit. Disabled as default.
+ *
+ * Sources hold a stream back, see HasFrameCredit, while one more frame as large as its last one would
+ * exceed the budget. A stream holding no memory is never held back, so that every stream goes on.
+ */
+void SetFrameMemoryBudget(uint64_t host_bytes, uint64_t device_bytes);
+
+/**
+ * Limit the memory held by the frames of one stream, 0 for no limit, in addition to SetFrameMemoryBudget.
+ * A 4K stream may be given a larger budget than a CIF one.
+ */
+void SetStreamFrameMemoryBudget(const std::string& stream_id, uint64_t host_bytes, uint64_t device_bytes);
+
+/**
+ * @return Return the memory held by the frames of all streams.
+ */
+CNFrameMemoryUsage GetFrameMemoryUsage();
+
+/**
+ * @return Return the memory held by the frames of the stream.
+ */
+CNFrameMemoryUsage GetStreamFrameMemoryUsage(const std::string& stream_id);
+
+/**
+ * @return Return the memory held by frames which has been allocated by the module, see FrameMemoryOwner.
+ */
+CNFrameMemoryUsage GetModuleFrameMemoryUsage(const std::string& module_name);
+
+/**
+ * Frame memory allocated by the calling thread is charged to module while the object lives, see
+ * GetModuleFrameMemoryUsage. The pipeline owns the threads calling Module::Process for the module,
+ * sources own their decoding threads. Nested owners restore the outer one.
+ */
+class FrameMemoryOwner {
+ public:
+  explicit FrameMemoryOwner(Module* module);
+  ~FrameMemoryOwner();
+
+ private:
+  FrameMemoryAccount* prev_owner_;
+  DISABLE_COPY_AND_ASSIGN(FrameMemoryOwner);
+};
+
 }  // namespace cnstream
 
 #endif  // CNSTREAM_FRAME_HPP_
@@ -28,9 +28,11 @@
  */
 
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "cnstream_eventbus.hpp"
 #include "cnstream_frame.hpp"
@@ -55,8 +57,8 @@ class Module {
    *
    * @param name Module name. Modules in pipeline should have different name.
    */
-  explicit Module(const std::string &name) : name_(name) { this->GetId(); }
-  virtual ~Module() { this->ReturnId(); }
+  explicit Module(const std::string &name) : name_(name) {}
+  virtual ~Module() {}
 
   /**
    * @deprecated
@@ -79,6 +81,9 @@ class Module {
    * @note Do not call this function by yourself. This function will be called
    *       by pipeline when pipeline starts. Pipeline guarantees that the Process function
    *       of this module will be called after the Open function.
+   * @note With PipelineConfig::openThreadNum other than 1, the Open of several modules run at the same time
+   *       on different threads. Their Open must be thread-safe then, e.g. against device binding, model loading
+   *       and static data shared with other modules.
    */
   virtual bool Open(ModuleParamSet param_set) = 0;
 
@@ -107,6 +112,117 @@ class Module {
    */
   virtual int Process(std::shared_ptr<CNFrameInfo> data) = 0;
 
+  /**
+   * Processing a batch of data. Called instead of Process for modules which set a batch size larger than 1,
+   * see SetBatchSize.
+   *
+   * @param data The data to be processed by this module, frames of the same stream are in order.
+   *             EOS frames are not handed over.
+   *
+   * @return
+   * @retval 0: OK, pipeline will transmit all the data to next modules.
+   * @retval <0: Failed. data should be resized to the frames processed before the failed one, pipeline
+   *             transmits them and then posts an event with type is EVENT_ERROR with return number.
+   *
+   * @note The default implementation calls Process for each frame.
+   */
+  virtual int ProcessBatch(std::vector<std::shared_ptr<CNFrameInfo>> &data);
+
+  /**
+   * Callback of ProcessAsync.
+   *
+   * @param ret 0 for success, <0 for failure, the same as the return number of Process.
+   */
+  using ProcessDone = std::function<void(int ret)>;
+
+  /**
+   * Processing data asynchronously. Called instead of Process for modules which set an async depth,
+   * see SetAsyncDepth.
+   *
+   * @param data The data to be processed by this module. EOS frames are not handed over.
+   * @param done Call it once, from any thread, when data has been processed. Pipeline then transmits the
+   *             frames of each stream (and its EOS) to next modules in the order they were handed over.
+   *             When done is called with ret < 0, pipeline posts an event with type is EVENT_ERROR.
+   *
+   * @note The default implementation calls done with the return number of Process.
+   * @note Frames still in flight have to be finished (done called) or dropped in Close.
+   */
+  virtual void ProcessAsync(std::shared_ptr<CNFrameInfo> data, ProcessDone done);
+
+  /**
+   * Warm up the calling thread. Called on each thread pipeline processes data of this module on, after Open and
+   * before the first data. Create the state of the thread here, e.g. thread_local contexts, or run synthetic data
+   * through the module, so that the first frames do not stall on it.
+   *
+   * @note Pipeline::Start returns once WarmUp returned on all the threads. With SCHEDULER_WORKER_POOL it is
+   *       called on every worker. It is not called for modules without input links.
+   * @note The default implementation does nothing.
+   */
+  virtual void WarmUp() {}
+
+  /**
+   * @return Return the max number of frames in flight in ProcessAsync for each thread of this module,
+   *         0 if the module does not process data asynchronously.
+   *
+   * @see SetAsyncDepth
+   */
+  uint32_t GetAsyncDepth() const { return async_depth_; }
+
+  /**
+   * @return Return the max number of frames handed to ProcessBatch at once.
+   *
+   * @see SetBatchSize
+   */
+  uint32_t GetBatchSize() const { return batch_size_; }
+
+  /**
+   * @return Return how long pipeline waits for more frames for a batch, in microseconds.
+   *
+   * @see SetBatchSize
+   */
+  uint32_t GetBatchTimeout() const { return batch_timeout_us_; }
+
+  /**
+   * @return Return whether this module has to get the frames of each stream in order.
+   *
+   * @see SetFrameOrderRequired
+   */
+  bool IsFrameOrderRequired() const { return frame_order_required_; }
+
+  /**
+   * @return Return whether frames out of their latency budget may go past this module unprocessed.
+   *
+   * @see SetStaleFrameSkippable
+   */
+  bool IsStaleFrameSkippable() const { return stale_frame_skippable_; }
+
+  /**
+   * @return Return the number of stale frames which went past this module unprocessed.
+   */
+  uint64_t GetSkippedFrameNum() const { return skipped_frames_.load(); }
+
+  /* useless for users, counts a stale frame which went past this module */
+  void AddSkippedFrame() { skipped_frames_.fetch_add(1, std::memory_order_relaxed); }
+
+  /**
+   * @return Return the number of frames processed before all input links had them.
+   *
+   * @see Pipeline::SetModuleJoinTimeout
+   */
+  uint64_t GetPartialFrameNum() const { return partial_frames_.load(); }
+
+  /**
+   * @return Return the number of frames got from an input link after they had been processed without it.
+   *
+   * @see Pipeline::SetModuleJoinTimeout
+   */
+  uint64_t GetLateFrameNum() const { return late_frames_.load(); }
+
+  /* useless for users, called by pipeline */
+  void AddPartialFrame() { partial_frames_.fetch_add(1, std::memory_order_relaxed); }
+  /* useless for users, called by pipeline */
+  void AddLateFrame() { late_frames_.fetch_add(1, std::memory_order_relaxed); }
+
   /**
    * Get name of this module.
    *
@@ -132,18 +248,27 @@ class Module {
    */
   bool PostEvent(EventType type, const std::string &msg) const;
 
-  /* useless for users */
-  size_t GetId();
+  /**
+   * Pin the calling thread like the threads pipeline runs this module on. Call it on the threads this module
+   * creates by itself, e.g. one for each stream.
+   *
+   * @see Pipeline::SetModulePlacement
+   */
+  void ApplyPlacement() const;
+
+  /* useless for users, index of this module in its pipeline, INVALID_MODULE_ID before added to one */
+  size_t GetId() const { return id_; }
+  /* useless for users, set by pipeline */
+  void SetId(size_t id) { id_ = id; }
   /* useless for users */
   std::vector<size_t> GetParentIds() const { return parent_ids_; }
-  /* useless for users, set upstream node id to this module */
+  /* useless for users, set upstream node id to this module, one for each input link */
   void SetParentId(size_t id) {
     parent_ids_.push_back(id);
-    mask_ = 0;
-    for (auto &v : parent_ids_) mask_ |= (uint64_t)1 << v;
+    mask_ = parent_ids_.size() >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << parent_ids_.size()) - 1;
   }
 
-  /* useless for users */
+  /* useless for users, one bit for each input link */
   uint64_t GetModulesMask() const { return mask_; }
 
   /**
@@ -154,20 +279,73 @@ class Module {
   bool hasTranmit() const { return hasTransmit_.load(); }
 
  protected:
+  /**
+   * Declare this module processes data in batches, call it in constructor or Open.
+   *
+   * @param batch_size Max number of frames handed to ProcessBatch at once. 1 (default) means Process is called for
+   *                   each frame.
+   * @param timeout_us How long pipeline waits for more frames after the first one of a batch. 0 takes the frames
+   *                   already queued only, so no latency is added.
+   *
+   * @note Batches are only used for modules with one input link which do not transmit data by themselves.
+   */
+  void SetBatchSize(uint32_t batch_size, uint32_t timeout_us = 0) {
+    batch_size_ = batch_size > 0 ? batch_size : 1;
+    batch_timeout_us_ = timeout_us;
+  }
+
+  /**
+   * Declare this module processes data asynchronously, call it in constructor or Open.
+   *
+   * @param depth Max number of frames in flight in ProcessAsync for each thread (data queue) of this module.
+   *              The thread waits for a done callback before it hands over more. 0 (default) means Process
+   *              is called for each frame.
+   *
+   * @note Only used for modules which do not transmit data by themselves. It takes precedence over
+   *       SetBatchSize.
+   */
+  void SetAsyncDepth(uint32_t depth) { async_depth_ = depth; }
+
+  /**
+   * Declare this module keeps state across the frames of a stream, e.g. a tracker or an encoder. Call it in
+   * constructor.
+   *
+   * Frames which went through a link with DISPATCH_SPREAD are put back in order of CNDataFrame::frame_id before
+   * they get to such a module, and its own input links never spread frames, see DispatchPolicy.
+   */
+  void SetFrameOrderRequired(bool required) { frame_order_required_ = required; }
+
+  /**
+   * Declare a frame out of its latency budget (see CNFrameInfo::IsStale) may go past this module unprocessed,
+   * e.g. an inference or an OSD whose result is worthless once late. Call it in constructor.
+   *
+   * Pipeline skips such frames for modules which do not transmit data by themselves. A module with several
+   * input links skips a frame once it got it from all of them, like it processes one. A module which transmits
+   * data by itself checks CNFrameInfo::IsStale in Process, transmits stale frames after the ones it holds and
+   * calls AddSkippedFrame.
+   */
+  void SetStaleFrameSkippable(bool skippable) { stale_frame_skippable_ = skippable; }
+
   const size_t INVALID_MODULE_ID = -1;
   Pipeline *container_ = nullptr;    ///> Container.
   std::string name_;                 ///> Module name.
   std::atomic<int> hasTransmit_{0};  ///> Has permission to transmit data.
 
  private:
-  void ReturnId();
   size_t id_ = -1;
-  /*support no more than 64 modules*/
-  static std::mutex module_id_mutex_;
-  static uint64_t module_id_mask_;
+  uint32_t batch_size_ = 1;
+  uint32_t batch_timeout_us_ = 0;
+  uint32_t async_depth_ = 0;
+  bool frame_order_required_ = false;
+  bool stale_frame_skippable_ = false;
+  std::atomic<uint64_t> skipped_frames_{0};
+  std::atomic<uint64_t> partial_frames_{0};
+  std::atomic<uint64_t> late_frames_{0};
 
   std::vector<size_t> parent_ids_;
   uint64_t mask_ = 0;
+  std::atomic<FrameMemoryAccount*> memory_account_{nullptr};  ///< looked up by name once, see FrameMemoryOwner
+  friend class FrameMemoryOwner;
 };
 
 class ModuleEx : public Module {
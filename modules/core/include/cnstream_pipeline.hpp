@@ -27,9 +27,12 @@
  * This file contains a declaration of class Pipeline.
  */
 
+#include <functional>
 #include <future>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <unordered_map>
 #include <vector>
@@ -97,6 +100,157 @@ class PipelinePrivate;
 struct LinkStatus {
   bool stopped;                      ///> Whether data transmission between modules stops.
   std::vector<uint32_t> cache_size;  ///> Number of data cache data in each data transmission queue between modules.
+  std::vector<uint64_t> dispatched;  ///> Number of data dispatched to each data transmission queue.
+  std::vector<double> busy_ms;       ///> Time spent by the downstream module on the data of each queue, in ms.
+  std::vector<uint32_t> stream_cnt;  ///> Number of streams pinned to each queue, see DispatchPolicy.
+  uint32_t active_cnt;               ///> Number of queues dispatched to, see Pipeline::SetModuleParallelismRange.
+  std::map<uint32_t, uint64_t> dropped;  ///> Number of data dropped on the link by the drop policy, by channel_idx.
+  uint64_t routed_past;  ///> Number of data which did not pass the route of the link, see LinkConfig::route.
+  std::vector<uint32_t> spilled;  ///> Number of data in each queue whose planes are spilled, see QUEUE_IMPL_SPILL.
+};
+
+/**
+ * Implementation of the data queues between two modules.
+ */
+enum QueueImpl {
+  QUEUE_IMPL_MUTEX = 0,  ///> Queue guarded by a mutex. The default one.
+  QUEUE_IMPL_RING,       ///> Preallocated lock-free ring buffer, no lock handoff when neither full nor empty.
+  QUEUE_IMPL_FAIR,       ///> Guarded by a mutex, one sub-queue for each stream. Served by strict priority between
+                         ///> CNFrameInfo::priority classes, then by deficit round robin on CNFrameInfo::weight.
+  QUEUE_IMPL_SPILL       ///> Guarded by a mutex. Beyond the queue capacity, the planes of pushed host frames are
+                         ///> spilled to a memory-mapped scratch file instead of blocking the pushing side, and
+                         ///> read back when popped. They leave memory once no other module holds the frame
+                         ///> (e.g. another branch). MLU data and EOS are not spilled, the pushing side blocks on
+                         ///> them as with QUEUE_IMPL_MUTEX. Not with drop policies. See LinkConfig::spill_dir.
+};
+
+/**
+ * How a link spreads streams over the data queues (and threads) of the downstream module.
+ *
+ * DISPATCH_LEAST_LOADED and DISPATCH_CONSISTENT_HASH pin a stream to a queue when it is first seen, and only
+ * move it while none of its frames is queued or processed on the link, e.g. after its EOS.
+ *
+ * DISPATCH_SPREAD sends each frame to the queue with the fewest frames in flight, so one stream can use all
+ * the threads of the downstream module, but its frames leave that module out of order. Pipeline puts them
+ * back in order of CNDataFrame::frame_id before any later module which requires it, see
+ * Module::IsFrameOrderRequired. Use it for stateless modules only.
+ *
+ * Modules with more than one input link always use DISPATCH_MODULO.
+ */
+enum DispatchPolicy {
+  DISPATCH_MODULO = 0,       ///> Queue channel_idx % queue number. The default one.
+  DISPATCH_LEAST_LOADED,     ///> Least loaded queue, by recent processing time of its streams.
+  DISPATCH_CONSISTENT_HASH,  ///> Consistent hashing of channel_idx, with a bounded number of streams per queue.
+  DISPATCH_SPREAD            ///> Each frame to the queue with the fewest frames in flight, frames are reordered.
+};
+
+/**
+ * What a full data queue does with a new data, see LinkConfig::drop_policy.
+ *
+ * A dropping queue never blocks the upstream module. EOS data are never dropped. Frames dropped before a
+ * DISPATCH_SPREAD reorder point are skipped there, so the frames after them are not held back.
+ *
+ * With LinkConfig::drop_low_watermark above 0, a queue which got full keeps dropping until it is down to the
+ * watermark, instead of dropping one data for each one pushed while it stays at capacity.
+ */
+enum DropPolicy {
+  DROP_NONE = 0,       ///> The upstream module waits for space. The default one.
+  DROP_OLDEST,         ///> Drops the data queued first, the freshest data get through.
+  DROP_NEWEST,         ///> Drops the data being pushed, the queued ones are kept.
+  DROP_LARGEST_STREAM  ///> Drops the data queued first of the stream with the most data queued.
+};
+
+/**
+ * Where the threads of a module run.
+ *
+ * @see Pipeline::SetModulePlacement.
+ */
+struct ModulePlacement {
+  std::vector<int> cpus;  ///> CPUs the threads of the module may run on, empty for any.
+  int numa_node = -1;     ///> NUMA node the threads run on, -1 for any. Frames for the module are allocated there.
+};
+
+/**
+ * Which data a link passes to its downstream module.
+ *
+ * A frame passes if it meets all the conditions set, and EOS always passes. The downstream module, and the
+ * modules after it, do not process the frames which do not pass. Where the branch joins others again, the
+ * frames are passed on to the join module in order without being processed, so that it does not wait for
+ * them. Branches which join no other one never get them.
+ *
+ * @see LinkConfig::route.
+ */
+struct RoutePredicate {
+  std::vector<std::string> labels;   ///> Frames with an object of any of these labels (CNInferObject::id).
+  uint32_t every_n = 1;              ///> Frames with frame_id a multiple of every_n, 0 or 1 for every frame.
+  std::vector<std::string> streams;  ///> Frames of any of these streams (CNFrameInfo::stream_id).
+  std::function<bool(const CNFrameInfo&)> filter;  ///> Frames it returns true for.
+
+  /**
+   * @return Return true if no condition is set.
+   */
+  bool PassAll() const;
+  /**
+   * @return Return true if data passes.
+   */
+  bool Pass(const CNFrameInfo& data) const;
+};
+
+/**
+ * Link config between two modules.
+ *
+ * @see Pipeline::LinkModules.
+ */
+struct LinkConfig {
+  size_t queue_capacity = 20;                        ///> The max buffer number of each data queue.
+  QueueImpl queue_impl = QUEUE_IMPL_MUTEX;           ///> Data queue implementation.
+  DispatchPolicy dispatch_policy = DISPATCH_MODULO;  ///> How streams are spread over the data queues.
+  DropPolicy drop_policy = DROP_NONE;                ///> What a full data queue does, see DropPolicy.
+  size_t drop_low_watermark = 0;  ///> Queue size dropping stops at once started, 0 for queue_capacity - 1.
+  RoutePredicate route;           ///> Data passed to the downstream module, all data by default.
+  std::string spill_dir;          ///> Directory of the QUEUE_IMPL_SPILL scratch files, empty for $TMPDIR or /tmp.
+};
+
+/**
+ * How module tasks are run.
+ */
+enum SchedulerMode {
+  SCHEDULER_THREAD = 0,  ///> One thread for each module and each of its data queues. The default one.
+  SCHEDULER_WORKER_POOL  ///> Module tasks run on a fixed pool of work-stealing worker threads.
+};
+
+/**
+ * @brief Pipeline config parameters.
+ *
+ * Pipeline config can be written in the JSON file of Pipeline::BuildPipelineByJSONFile, under the reserved
+ * key "pipeline_config".
+ * eg.
+ * @code
+ * "pipeline_config": {
+ *   "scheduler(PipelineConfig::scheduler)": "thread" or "worker_pool",
+ *   "worker_num(PipelineConfig::workerNum)": 8,
+ *   "open_thread_num(PipelineConfig::openThreadNum)": 4
+ * }
+ * @endcode
+ *
+ * @see Pipeline::SetPipelineConfig.
+ */
+struct PipelineConfig {
+  SchedulerMode scheduler = SCHEDULER_THREAD;  ///> How module tasks are run.
+  uint32_t workerNum = 0;  ///> Worker number with SCHEDULER_WORKER_POOL, 0 for one worker per core.
+  /**
+   * Most modules opened at once by Pipeline::Start, 0 for one thread per core. 1 (the default) opens the modules
+   * one after another on the thread calling Pipeline::Start. Set more only when the Open of all the modules may
+   * run concurrently, see Module::Open.
+   */
+  uint32_t openThreadNum = 1;
+
+  /**
+   * Parse members from json string.
+   *
+   * @note If parse json string failed, std::string will be thrown.
+   */
+  void ParseByJSONStr(const std::string& jstr) noexcept(false);
 };
 
 /**
@@ -114,6 +268,22 @@ struct LinkStatus {
  *   }
  *  "parallelism(CNModuleConfig::parallelism)": 3,
  *  "max_input_queue_size(CNModuleConfig::maxInputQueueSize)": 20,
+ *  "queue_impl(CNModuleConfig::queueImpl)": "mutex", "ring", "fair" or "spill",
+ *  "spill_dir(CNModuleConfig::spillDir)": "/data/scratch",
+ *  "dispatch(CNModuleConfig::dispatchPolicy)": "modulo", "least_loaded", "consistent_hash" or "spread",
+ *  "disable_fusion(CNModuleConfig::disableFusion)": false,
+ *  "min_parallelism(CNModuleConfig::minParallelism)": 1,
+ *  "max_parallelism(CNModuleConfig::maxParallelism)": 8,
+ *  "cpu_affinity(CNModuleConfig::placement.cpus)": "0-3,8",
+ *  "numa_node(CNModuleConfig::placement.numa_node)": 0,
+ *  "drop_policy(CNModuleConfig::dropPolicy)": "none", "oldest", "newest" or "largest_stream",
+ *  "drop_low_watermark(CNModuleConfig::dropLowWatermark)": 10,
+ *  "join_timeout_ms(CNModuleConfig::joinTimeoutMs)": 40,
+ *  "route(CNModuleConfig::route)": {
+ *    "labels": ["0", "2"],
+ *    "every_n": 2,
+ *    "streams": ["stream0", "stream1"]
+ *  },
  *  "class_name(CNModuleConfig::className)": "Inferencer",
  *  "next_modules": ["module0(CNModuleConfig::name)", "module1(CNModuleConfig::name)", ...],
  * }
@@ -128,6 +298,17 @@ struct CNModuleConfig {
   int maxInputQueueSize;          ///> The max queue size for input data queues.
   std::string className;          ///> Module classs name.
   std::vector<std::string> next;  ///> Downstream modules(module name).
+  QueueImpl queueImpl;            ///> The implementation of input data queues, QUEUE_IMPL_MUTEX by default.
+  DispatchPolicy dispatchPolicy;  ///> How input links spread streams over the data queues, DISPATCH_MODULO by default.
+  bool disableFusion;             ///> Never run this module on the thread of a neighbour, false by default.
+  int minParallelism;  ///> Fewest threads an elastic module scales down to, see Pipeline::SetModuleParallelismRange.
+  int maxParallelism;  ///> Most threads an elastic module scales up to, 0 (the default) for a fixed parallelism.
+  ModulePlacement placement;  ///> CPUs and NUMA node of the module threads, not pinned by default.
+  DropPolicy dropPolicy;      ///> What the full input data queues do, DROP_NONE by default.
+  int dropLowWatermark;       ///> See LinkConfig::drop_low_watermark, 0 by default.
+  int joinTimeoutMs;          ///> See Pipeline::SetModuleJoinTimeout, 0 (wait for all input links) by default.
+  RoutePredicate route;       ///> Data the input links pass to this module, all data by default.
+  std::string spillDir;       ///> See LinkConfig::spill_dir, empty by default.
 
   /**
    * Parse members from json srting, except CNModuleConfig::name.
@@ -196,7 +377,8 @@ class Pipeline : public Module {
   /**
    * Start pipeline.
    * Start data transmission in pipeline.
-   * Call all module's Open, see Module::Open.
+   * Call all module's Open, see Module::Open. Up to PipelineConfig::openThreadNum modules are opened at once,
+   * the modules opened are closed again when one of them fails.
    * Link modules.
    *
    * @return Return true for success. Return false when one of the module's Open return false.
@@ -209,6 +391,36 @@ class Pipeline : public Module {
    * @return Return true for success. Otherwise, false will be returned.
    */
   bool Stop();
+  /**
+   * Pause pipeline.
+   * The module threads (or worker pool tasks) finish the data they are processing and wait, the modules are not
+   * closed. Join timeouts do not run out while paused. A thread blocked on a full data queue of the next module is
+   * not waited for, it waits after the push.
+   *
+   * Only the popping of data queues stops, frames still move on to the data queues of the next modules from
+   * threads the pipeline does not own:
+   *   - ProvideData, called for the source modules or by modules which transmit data by themselves, pushes on.
+   *     It blocks once a data queue is full (or drops, see DropPolicy).
+   *   - Frames in flight in Module::ProcessAsync are not waited for. When their done callbacks are called, they are
+   *     forwarded to the next modules as usual, and an EOS reaching the last module is reported to the
+   *     StreamMsgObserver.
+   * The modules fused after a paused module are paused with it, see DisableModuleFusion.
+   *
+   * @return Return true for success. Return false if the pipeline is not running or already paused.
+   */
+  bool Pause();
+  /**
+   * Resume pipeline paused by Pause. The data queued meanwhile is processed, none is dropped or processed twice.
+   *
+   * @return Return true for success. Return false if the pipeline is not paused.
+   */
+  bool Resume();
+  /**
+   * @return Return true if the pipeline is paused.
+   *
+   * @see Pause
+   */
+  bool IsPaused() const;
   /**
    * Return running status for pipeline.
    *
@@ -248,15 +460,34 @@ class Pipeline : public Module {
    *                   "device_id" : 0
    *                 }
    *              },
-   *    "detector" : {...}
+   *    "detector" : {...},
+   *    "pipeline_config" : {...}
    * }
    * @endcode
    *
+   * "pipeline_config" is reserved for PipelineConfig, it can not be used as a module name.
+   *
    * @param config_file JSON config file.
    *
    * @return Return 0 for success. Otherwise -1 will be returned. if parse json file failed, string will be thrown.
    */
   int BuildPipelineByJSONFile(const std::string& config_file) noexcept(false);
+  /**
+   * Set pipeline config.
+   *
+   * @param config Pipeline config.
+   *
+   * @note Call this function before call Pipeline::Start, or it will not be effective.
+   *
+   * @see PipelineConfig.
+   */
+  void SetPipelineConfig(const PipelineConfig& config);
+  /**
+   * Get pipeline config.
+   *
+   * @return Return pipeline config.
+   */
+  PipelineConfig GetPipelineConfig() const;
   /**
    * Get module in pipeline by name.
    *
@@ -327,6 +558,109 @@ class Pipeline : public Module {
    */
   uint32_t GetModuleParallelism(std::shared_ptr<Module> module);
 
+  /**
+   * Make the parallelism of the module elastic.
+   *
+   * The module gets max_parallelism data queues and threads, but only the first ones are dispatched to, starting
+   * with its parallelism clamped to [min_parallelism, max_parallelism]. While the pipeline runs, one more queue is
+   * used when the queues in use stay at least half full, and one less when they stay nearly empty and the threads
+   * are mostly idle. Each change is logged, the number of queues in use is LinkStatus::active_cnt of the input
+   * link. A stream only moves to another queue when its frames queued or processed on the old one are done, so its
+   * frames are still processed in order. An elastic module is never fused with its neighbours, see
+   * DisableModuleFusion. A module with more than one input link keeps a fixed parallelism.
+   *
+   * @param module The module to be config.
+   * @param min_parallelism Fewest data queues in use, at least 1.
+   * @param max_parallelism Most data queues in use, 0 for a fixed parallelism.
+   *
+   * @return Return true for success. Return false if this module has not been added into this pipeline or
+   * min_parallelism is greater than max_parallelism.
+   *
+   * @note Call this function before the module is linked, or it will not be effective.
+   *
+   * @see CNModuleConfig::minParallelism, CNModuleConfig::maxParallelism.
+   */
+  bool SetModuleParallelismRange(std::shared_ptr<Module> module, uint32_t min_parallelism,
+                                 uint32_t max_parallelism);
+
+  /**
+   * Disable or enable chain fusion for the module.
+   *
+   * When two modules are linked one to one (the upstream module has only this output link and the downstream module
+   * only this input link), have the same parallelism and placement, use DISPATCH_MODULO and neither transmits data by
+   * itself nor processes asynchronously, the downstream module is fused: it processes each frame right after the
+   * upstream module, on the same thread, and the data queues between them are not used. A downstream module which
+   * processes batches is only fused with an upstream module which does too, and gets its batches. The input links of
+   * the upstream module have to use DISPATCH_MODULO as well. Fusion is enabled by default.
+   *
+   * @param module The module to be config.
+   * @param disable Whether the module should never be fused with its upstream or downstream module.
+   *
+   * @return Return true for success. Return false if this module has not been added into this pipeline.
+   *
+   * @note Call this function before call Pipeline::Start, or it will not be effective.
+   *
+   * @see CNModuleConfig::disableFusion.
+   */
+  bool DisableModuleFusion(std::shared_ptr<Module> module, bool disable = true);
+
+  /**
+   * Bound how long a module with several input links waits for a frame to come from all of them.
+   *
+   * Once timeout_ms passed since a frame came from the first of its input links, the module processes it with what
+   * it has got. The frame is flagged CN_FRAME_FLAG_PARTIAL, and CNDataFrame::GetModulesMask tells the input links it
+   * came from. When it comes from the other links later, it is released there without being processed again.
+   * EOS always waits for all input links, the partial frames of its stream are processed before it.
+   *
+   * @param module The module to be config.
+   * @param timeout_ms How long a frame waits for all input links, 0 (the default) for as long as it takes.
+   *
+   * @return Return true for success. Return false if this module has not been added into this pipeline.
+   *
+   * @note Call this function before call Pipeline::Start, or it will not be effective.
+   *
+   * @see CNModuleConfig::joinTimeoutMs Module::GetPartialFrameNum Module::GetLateFrameNum.
+   */
+  bool SetModuleJoinTimeout(std::shared_ptr<Module> module, uint32_t timeout_ms);
+
+  /**
+   * Pin the threads of the module.
+   *
+   * Each thread the pipeline runs the module on is restricted to placement.cpus, or to the CPUs of
+   * placement.numa_node, or to the CPUs in both if both are set. Threads the module creates itself are pinned when
+   * it calls Module::ApplyPlacement on them. CNStreamMallocHost on these threads allocates on the NUMA node of the
+   * first downstream module with one, which reads the frames, or else on the node of the module itself.
+   * The tasks of a pipeline run by the worker pool are not pinned, as its threads run all modules.
+   * The effective placement is logged by Pipeline::Start, see also Pipeline::QueryModulePlacement.
+   *
+   * @param module The module to be config.
+   * @param placement CPUs and NUMA node.
+   *
+   * @return Return true for success. Return false if this module has not been added into this pipeline.
+   *
+   * @note Call this function before call Pipeline::Start, or it will not be effective.
+   *
+   * @see CNModuleConfig::placement.
+   */
+  bool SetModulePlacement(std::shared_ptr<Module> module, const ModulePlacement& placement);
+  /**
+   * Query the effective placement of the module, while the pipeline runs.
+   *
+   * @param module The module.
+   * @param placement CPUs its threads are pinned to (empty if not pinned), and the NUMA node CNStreamMallocHost
+   * allocates on for its threads (-1 for none).
+   *
+   * @return Return true for success. Return false if this module has not been added into this pipeline, or the
+   * pipeline is not running.
+   */
+  bool QueryModulePlacement(std::shared_ptr<Module> module, ModulePlacement* placement) const;
+  /**
+   * Pin the calling thread as a thread of the module, see Pipeline::SetModulePlacement.
+   *
+   * @note Useless for users, see Module::ApplyPlacement.
+   */
+  void ApplyModulePlacement(const Module* module) const;
+
   /**
    * Link two modules.
    * Upstream node will process data before downstream node.
@@ -344,6 +678,19 @@ class Pipeline : public Module {
    */
   std::string LinkModules(std::shared_ptr<Module> up_node, std::shared_ptr<Module> down_node,
                           size_t queue_capacity = 20);
+  /**
+   * Link two modules with link config.
+   *
+   * @param up_node Upstream module.
+   * @param down_node Downstream module.
+   * @param config Link config, e.g. capacity and implementation of the data queues.
+   *
+   * @return Return link-index for success. Return NULL if one of the two nodes has not been added into this pipeline.
+   *
+   * @see Pipeline::LinkModules LinkConfig.
+   */
+  std::string LinkModules(std::shared_ptr<Module> up_node, std::shared_ptr<Module> down_node,
+                          const LinkConfig& config);
 
  public:
   /**
@@ -394,9 +741,22 @@ class Pipeline : public Module {
   /* ------Internal methods------ */
 
  private:
-  void TransmitData(int64_t node_hashcode, std::shared_ptr<CNFrameInfo> data);
+  /*
+    node_idx is Module::GetId() of the module, the index of its routing entry built by Start.
+    returns false when a fused downstream module failed, see DisableModuleFusion.
+   */
+  bool TransmitData(size_t node_idx, std::shared_ptr<CNFrameInfo> data);
+
+  void TaskLoop(size_t node_idx, uint32_t conveyor_idx);
+
+  /* process one frame popped from input link input_idx, returns false when the task should stop */
+  bool ProcessData(size_t node_idx, uint32_t conveyor_idx, size_t input_idx, std::shared_ptr<CNFrameInfo> data);
+
+  /* process frames popped at once from the only input link, see Module::ProcessBatch */
+  bool ProcessDataBatch(size_t node_idx, uint32_t conveyor_idx, std::vector<std::shared_ptr<CNFrameInfo>>* data);
 
-  void TaskLoop(int64_t node_hashcode, uint32_t conveyor_idx);
+  /* posts the error event and stream message of a failed Process */
+  void ReportProcessError(Module* module, const std::shared_ptr<CNFrameInfo>& data, int ret);
 
   void EventLoop();
 
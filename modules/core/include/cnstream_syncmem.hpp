@@ -48,6 +48,21 @@ namespace cnstream {
  */
 void CNStreamMallocHost(void** ptr, size_t size);
 
+/**
+ * Set the NUMA node CNStreamMallocHost allocates on, for the calling thread.
+ *
+ * Pipeline sets it on the threads of a module to the node of its downstream module, which reads the frames, see
+ * ModulePlacement::numa_node.
+ *
+ * @param numa_node NUMA node, -1 for the default memory policy.
+ */
+void CNStreamSetHostMemoryNode(int numa_node);
+
+/**
+ * Get the NUMA node CNStreamMallocHost allocates on for the calling thread, -1 if not set.
+ */
+int CNStreamGetHostMemoryNode();
+
 /**
  * Free data allocated by CNStreamMallocHost.
  *
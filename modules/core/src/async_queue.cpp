@@ -0,0 +1,130 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#include "async_queue.hpp"
+
+#include <glog/logging.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace cnstream {
+
+Module::ProcessDone AsyncQueue::Push(const CNFrameInfoPtr& data, bool process) {
+  std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+  entry->data = data;
+  entry->start = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lk(mutex_);
+    streams_[data->channel_idx].push_back(entry);
+    if (process) {
+      in_flight_++;
+    } else {
+      entry->done = true;
+      dirty_.push_back(data->channel_idx);
+    }
+  }
+  if (!process) {
+    Drain();
+    return nullptr;
+  }
+  std::shared_ptr<AsyncQueue> self = shared_from_this();
+  return [self, entry](int ret) { self->Complete(entry, ret); };
+}
+
+bool AsyncQueue::WaitForSlot() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  slot_cond_.wait(lk, [this] { return stopped_ || failed_ || in_flight_ < depth_; });
+  return !stopped_ && !failed_;
+}
+
+bool AsyncQueue::Park(ConveyorNotifier* task) {
+  std::lock_guard<std::mutex> lk(mutex_);
+  if (stopped_ || failed_ || in_flight_ < depth_) return false;
+  parked_ = task;
+  return true;
+}
+
+void AsyncQueue::Wakeup() {
+  std::lock_guard<std::mutex> lk(mutex_);
+  stopped_ = true;
+  parked_ = nullptr;
+  slot_cond_.notify_all();
+}
+
+bool AsyncQueue::Failed() {
+  std::lock_guard<std::mutex> lk(mutex_);
+  return failed_;
+}
+
+void AsyncQueue::Complete(const std::shared_ptr<Entry>& entry, int ret) {
+  ConveyorNotifier* parked = nullptr;
+  {
+    std::lock_guard<std::mutex> lk(mutex_);
+    if (entry->done) {
+      LOG(ERROR) << "ProcessAsync done called more than once for frame " << entry->data->frame.frame_id;
+      return;
+    }
+    entry->done = true;
+    entry->ret = ret;
+    entry->cost_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - entry->start).count();
+    dirty_.push_back(entry->data->channel_idx);
+    in_flight_--;
+    std::swap(parked, parked_);
+    slot_cond_.notify_one();
+  }
+  Drain();
+  if (parked) parked->NotifySpace();
+}
+
+void AsyncQueue::Drain() {
+  std::unique_lock<std::mutex> lk(mutex_);
+  if (draining_) return;
+  draining_ = true;
+  std::vector<std::shared_ptr<Entry>> ready;
+  while (true) {
+    for (uint32_t chn_idx : dirty_) {
+      auto iter = streams_.find(chn_idx);
+      if (streams_.end() == iter) continue;
+      std::deque<std::shared_ptr<Entry>>& entries = iter->second;
+      while (!entries.empty() && entries.front()->done) {
+        ready.push_back(entries.front());
+        entries.pop_front();
+      }
+      if (entries.empty()) streams_.erase(iter);
+    }
+    dirty_.clear();
+    if (ready.empty()) break;
+    bool ok = !failed_;
+    lk.unlock();
+    for (auto& entry : ready) {
+      if (ok) ok = forward_(entry->data, entry->ret, entry->cost_ms);
+    }
+    ready.clear();
+    lk.lock();
+    if (!ok) {
+      failed_ = true;
+      slot_cond_.notify_all();
+    }
+  }
+  draining_ = false;
+}
+
+}  // namespace cnstream
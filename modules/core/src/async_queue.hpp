@@ -0,0 +1,101 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#ifndef MODULES_CORE_INCLUDE_ASYNC_QUEUE_HPP_
+#define MODULES_CORE_INCLUDE_ASYNC_QUEUE_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "cnstream_frame.hpp"
+#include "cnstream_module.hpp"
+#include "conveyor.hpp"
+
+namespace cnstream {
+
+/****************************************************************************
+ * @brief Frames in flight of one data queue of a module with
+ * Module::ProcessAsync.
+ *
+ * Frames are queued per stream in the order they are handed over and
+ * forwarded from the head once they are done, so the frames and EOS of a
+ * stream leave the module in order whatever order the done callbacks come
+ * in. One thread forwards at a time (draining_), the others only mark frames
+ * done. The done callbacks hold a reference, so the queue outlives a restart
+ * of the pipeline.
+ ****************************************************************************/
+class AsyncQueue : public std::enable_shared_from_this<AsyncQueue> {
+ public:
+  /* forwards a frame done with ret, returns false when the module failed */
+  using Forward = std::function<bool(const CNFrameInfoPtr& data, int ret, double cost_ms)>;
+
+  AsyncQueue(uint32_t depth, Forward forward) : depth_(depth), forward_(forward) {}
+
+  /*
+    queues data, returns the done callback for Module::ProcessAsync. with process false (EOS) data is
+    forwarded after the frames before it without being processed, the returned callback is empty then.
+   */
+  Module::ProcessDone Push(const CNFrameInfoPtr& data, bool process);
+
+  /* thread per data queue: blocks until one more frame may be handed over, false if failed or stopped */
+  bool WaitForSlot();
+
+  /* worker pool: returns true if no more frame may be handed over, task->NotifySpace() is called once it may */
+  bool Park(ConveyorNotifier* task);
+
+  /* wakes up the waiting thread, called when the pipeline stops */
+  void Wakeup();
+
+  bool Failed();
+
+ private:
+  struct Entry {
+    CNFrameInfoPtr data;
+    bool done = false;
+    int ret = 0;
+    double cost_ms = 0;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  void Complete(const std::shared_ptr<Entry>& entry, int ret);
+  void Drain();
+
+  const uint32_t depth_;
+  Forward forward_;
+  std::mutex mutex_;
+  std::condition_variable slot_cond_;
+  std::unordered_map<uint32_t, std::deque<std::shared_ptr<Entry>>> streams_;
+  std::vector<uint32_t> dirty_;  ///< streams with frames done since the last drain
+  uint32_t in_flight_ = 0;
+  bool draining_ = false;
+  bool failed_ = false;
+  bool stopped_ = false;
+  ConveyorNotifier* parked_ = nullptr;
+};  // class AsyncQueue
+
+}  // namespace cnstream
+
+#endif  // MODULES_CORE_INCLUDE_ASYNC_QUEUE_HPP_
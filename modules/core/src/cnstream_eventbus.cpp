@@ -70,13 +70,19 @@ bool EventBus::PostEvent(Event event) {
 Event EventBus::PollEvent() {
   Event event;
   event.type = EVENT_INVALID;
-  while (running_) {
-    if (d_ptr_->queue_.WaitAndTryPop(event, std::chrono::milliseconds(100))) {
-      break;
-    }
-  }
-  if (!running_) event.type = EVENT_STOP;
+  /* Stop wakes up the queue, there is no need to poll running_ while waiting */
+  if (!running_ || !d_ptr_->queue_.WaitAndPopUntilStop(event)) event.type = EVENT_STOP;
   return event;
 }
 
+void EventBus::Start() {
+  d_ptr_->queue_.Restart();
+  running_ = true;
+}
+
+void EventBus::Stop() {
+  running_ = false;
+  d_ptr_->queue_.Stop();
+}
+
 }  // namespace cnstream
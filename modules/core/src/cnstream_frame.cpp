@@ -22,7 +22,11 @@
 
 #include <cnrt.h>
 #include <glog/logging.h>
+#include <atomic>
+#include <bitset>
+#include <chrono>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -32,6 +36,150 @@
 
 namespace cnstream {
 
+/*
+  Memory held by frames, per stream and per module. The accounts are atomics, a frame looks its stream
+  account up at its first charge, a module once (see FrameMemoryOwner), so that charging and releasing
+  take no lock. memory_mutex only guards the maps of accounts, which are never erased once created: a
+  few bytes for each stream id and module name ever seen.
+ */
+struct FrameMemoryAccount {
+  std::atomic<uint64_t> host_bytes{0};
+  std::atomic<uint64_t> device_bytes{0};
+  std::atomic<uint64_t> budget_host_bytes{0};  ///< streams only, 0 for no limit
+  std::atomic<uint64_t> budget_device_bytes{0};
+  std::atomic<uint64_t> last_host_bytes{0};  ///< planes of the last frame, what the next one is expected to hold
+  std::atomic<uint64_t> last_device_bytes{0};
+};
+
+namespace {
+std::mutex memory_mutex;
+FrameMemoryAccount total_memory_account;
+std::atomic<size_t> stream_memory_budget_num{0};
+std::map<std::string, std::unique_ptr<FrameMemoryAccount>> stream_memory_accounts;
+std::map<std::string, std::unique_ptr<FrameMemoryAccount>> module_memory_accounts;
+thread_local FrameMemoryAccount* memory_owner = nullptr;
+}  // namespace
+
+/* with memory_mutex held */
+static FrameMemoryAccount* FindMemoryAccount(std::map<std::string, std::unique_ptr<FrameMemoryAccount>>* accounts,
+                                             const std::string& key) {
+  std::unique_ptr<FrameMemoryAccount>& account = (*accounts)[key];
+  if (!account) account.reset(new FrameMemoryAccount);
+  return account.get();
+}
+
+/* the calling thread mostly deals with one stream, e.g. a decoding thread */
+static FrameMemoryAccount* StreamMemoryAccount(const std::string& stream_id) {
+  thread_local std::string cached_stream_id;
+  thread_local FrameMemoryAccount* cached_account = nullptr;
+  if (!cached_account || cached_stream_id != stream_id) {
+    std::lock_guard<std::mutex> lk(memory_mutex);
+    cached_account = FindMemoryAccount(&stream_memory_accounts, stream_id);
+    cached_stream_id = stream_id;
+  }
+  return cached_account;
+}
+
+static CNFrameMemoryUsage GetUsage(const FrameMemoryAccount& account) {
+  CNFrameMemoryUsage usage;
+  usage.host_bytes = account.host_bytes.load(std::memory_order_relaxed);
+  usage.device_bytes = account.device_bytes.load(std::memory_order_relaxed);
+  return usage;
+}
+
+/* whether one more frame as large as last exceeds the budget of account, 0 in budget for no limit */
+static bool ExceedsBudget(const FrameMemoryAccount& account, uint64_t last_host_bytes, uint64_t last_device_bytes) {
+  const uint64_t budget_host_bytes = account.budget_host_bytes.load(std::memory_order_relaxed);
+  const uint64_t budget_device_bytes = account.budget_device_bytes.load(std::memory_order_relaxed);
+  return (budget_host_bytes && account.host_bytes.load() + last_host_bytes > budget_host_bytes) ||
+         (budget_device_bytes && account.device_bytes.load() + last_device_bytes > budget_device_bytes);
+}
+
+static bool MemoryBudgetEnabled() {
+  return total_memory_account.budget_host_bytes.load(std::memory_order_relaxed) ||
+         total_memory_account.budget_device_bytes.load(std::memory_order_relaxed) ||
+         stream_memory_budget_num.load(std::memory_order_relaxed) > 0;
+}
+
+static bool HasMemoryCredit(const std::string& stream_id) {
+  if (!MemoryBudgetEnabled()) return true;
+  const FrameMemoryAccount& account = *StreamMemoryAccount(stream_id);
+  if (0 == account.host_bytes.load() && 0 == account.device_bytes.load()) return true;
+  const uint64_t last_host_bytes = account.last_host_bytes.load(std::memory_order_relaxed);
+  const uint64_t last_device_bytes = account.last_device_bytes.load(std::memory_order_relaxed);
+  return !ExceedsBudget(account, last_host_bytes, last_device_bytes) &&
+         !ExceedsBudget(total_memory_account, last_host_bytes, last_device_bytes);
+}
+
+void SetFrameMemoryBudget(uint64_t host_bytes, uint64_t device_bytes) {
+  total_memory_account.budget_host_bytes.store(host_bytes);
+  total_memory_account.budget_device_bytes.store(device_bytes);
+  WakeupFrameCreditWaiters();
+}
+
+void SetStreamFrameMemoryBudget(const std::string& stream_id, uint64_t host_bytes, uint64_t device_bytes) {
+  {
+    std::lock_guard<std::mutex> lk(memory_mutex);
+    FrameMemoryAccount* account = FindMemoryAccount(&stream_memory_accounts, stream_id);
+    const bool had_budget = account->budget_host_bytes.load() || account->budget_device_bytes.load();
+    account->budget_host_bytes.store(host_bytes);
+    account->budget_device_bytes.store(device_bytes);
+    const bool has_budget = host_bytes || device_bytes;
+    if (has_budget && !had_budget) ++stream_memory_budget_num;
+    if (!has_budget && had_budget) --stream_memory_budget_num;
+  }
+  WakeupFrameCreditWaiters();
+}
+
+CNFrameMemoryUsage GetFrameMemoryUsage() { return GetUsage(total_memory_account); }
+
+CNFrameMemoryUsage GetStreamFrameMemoryUsage(const std::string& stream_id) {
+  std::lock_guard<std::mutex> lk(memory_mutex);
+  auto iter = stream_memory_accounts.find(stream_id);
+  return iter == stream_memory_accounts.end() ? CNFrameMemoryUsage() : GetUsage(*iter->second);
+}
+
+CNFrameMemoryUsage GetModuleFrameMemoryUsage(const std::string& module_name) {
+  std::lock_guard<std::mutex> lk(memory_mutex);
+  auto iter = module_memory_accounts.find(module_name);
+  return iter == module_memory_accounts.end() ? CNFrameMemoryUsage() : GetUsage(*iter->second);
+}
+
+FrameMemoryOwner::FrameMemoryOwner(Module* module) : prev_owner_(memory_owner) {
+  FrameMemoryAccount* account = module ? module->memory_account_.load(std::memory_order_acquire) : nullptr;
+  if (module && !account) {
+    std::lock_guard<std::mutex> lk(memory_mutex);
+    account = FindMemoryAccount(&module_memory_accounts, module->GetName());
+    module->memory_account_.store(account, std::memory_order_release);
+  }
+  memory_owner = account;
+}
+
+FrameMemoryOwner::~FrameMemoryOwner() { memory_owner = prev_owner_; }
+
+static void AddMemory(FrameMemoryAccount* account, uint64_t host_bytes, uint64_t device_bytes) {
+  account->host_bytes.fetch_add(host_bytes, std::memory_order_relaxed);
+  account->device_bytes.fetch_add(device_bytes, std::memory_order_relaxed);
+}
+
+static void SubMemory(FrameMemoryAccount* account, uint64_t host_bytes, uint64_t device_bytes) {
+  account->host_bytes.fetch_sub(host_bytes, std::memory_order_relaxed);
+  account->device_bytes.fetch_sub(device_bytes, std::memory_order_relaxed);
+}
+
+void CNDataFrame::ChargeMemory(uint64_t host_bytes, uint64_t device_bytes, bool planes) {
+  if (0 == host_bytes && 0 == device_bytes) return;
+  if (!memory_account_) memory_account_ = StreamMemoryAccount(stream_id);
+  AddMemory(memory_account_, host_bytes, device_bytes);
+  if (planes) {
+    memory_account_->last_host_bytes.store(host_bytes, std::memory_order_relaxed);
+    memory_account_->last_device_bytes.store(device_bytes, std::memory_order_relaxed);
+  }
+  if (memory_owner) AddMemory(memory_owner, host_bytes, device_bytes);
+  AddMemory(&total_memory_account, host_bytes, device_bytes);
+  memory_charges_.push_back(MemoryCharge{memory_owner, host_bytes, device_bytes});
+}
+
 CNDataFrame::~CNDataFrame() {
   if (nullptr != mlu_data) {
     CALL_CNRT_BY_CONTEXT(cnrtFree(mlu_data), ctx.dev_id, ctx.ddr_channel);
@@ -44,6 +192,19 @@ CNDataFrame::~CNDataFrame() {
     delete bgr_mat, bgr_mat = nullptr;
   }
 #endif
+  ReleaseMemory();
+}
+
+void CNDataFrame::ReleaseMemory() {
+  if (memory_charges_.empty()) return;
+  for (const MemoryCharge& charge : memory_charges_) {
+    SubMemory(memory_account_, charge.host_bytes, charge.device_bytes);
+    if (charge.module) SubMemory(charge.module, charge.host_bytes, charge.device_bytes);
+    SubMemory(&total_memory_account, charge.host_bytes, charge.device_bytes);
+  }
+  memory_charges_.clear();
+  /* sources held back by the budgets may go on */
+  if (MemoryBudgetEnabled()) WakeupFrameCreditWaiters();
 }
 
 #ifdef HAVE_OPENCV
@@ -55,7 +216,10 @@ cv::Mat* CNDataFrame::ImageBGR() {
   cv::Mat bgr(height, stride_, CV_8UC3);
   uint8_t* img_data = new uint8_t[GetBytes()];
   uint8_t* t = img_data;
+  uint64_t synced_bytes = 0;
   for (int i = 0; i < GetPlanes(); ++i) {
+    /* planes on MLU are synced to host memory held by the frame */
+    if (CNSyncedMemory::HEAD_AT_MLU == data[i]->GetHead()) synced_bytes += GetPlaneBytes(i);
     memcpy(t, data[i]->GetCpuData(), GetPlaneBytes(i));
     t += GetPlaneBytes(i);
   }
@@ -85,6 +249,7 @@ cv::Mat* CNDataFrame::ImageBGR() {
   bgr_mat = new cv::Mat();
   if (bgr_mat) {
     *bgr_mat = bgr;
+    ChargeMemory(synced_bytes + bgr_mat->total() * bgr_mat->elemSize(), 0, false);
   }
   return bgr_mat;
 }
@@ -127,6 +292,7 @@ void CNDataFrame::CopyToSyncMem() {
       this->data[i].reset(new CNSyncedMemory(plane_size, ctx.dev_id, ctx.ddr_channel));
       this->data[i]->SetMluData(this->ptr[i]);
     }
+    ChargeMemory(0, GetBytes(), true);
     return;
   }
   /*deep copy*/
@@ -146,6 +312,7 @@ void CNDataFrame::CopyToSyncMem() {
       this->data[i]->SetMluData(dst);
       dst = (void*)((uint8_t*)dst + plane_size);
     }
+    ChargeMemory(0, bytes, true);
   } else if (this->ctx.dev_type == DevContext::CPU) {
     if (cpu_data != nullptr) {
       LOG(FATAL) << "CopyToSyncMem should be called once for each frame";
@@ -164,44 +331,133 @@ void CNDataFrame::CopyToSyncMem() {
       this->data[i]->SetCpuData(dst);
       dst = (void*)((uint8_t*)dst + plane_size);
     }
+    ChargeMemory(bytes, 0, true);
   } else {
     LOG(FATAL) << "Device type not supported";
   }
 }
 
-void CNDataFrame::SetModuleMask(Module* module, Module* current) {
-  std::unique_lock<std::mutex> lock(modules_mutex);
-  auto iter = module_mask_map_.find(module->GetId());
-  if (iter != module_mask_map_.end()) {
-    iter->second |= (unsigned long)1 << current->GetId();
-  } else {
-    module_mask_map_[module->GetId()] = (unsigned long)1 << current->GetId();
+bool CNDataFrame::IsSpillable() const {
+  if (DevContext::CPU != ctx.dev_type || nullptr == cpu_data || deAllocator_ || (flags & CN_FRAME_FLAG_EOS)) {
+    return false;
+  }
+#ifdef HAVE_OPENCV
+  if (bgr_mat) return false;
+#endif
+  for (int i = 0; i < GetPlanes(); ++i) {
+    if (!data[i] || data[i].use_count() > 1) return false;
+  }
+  return true;
+}
+
+void CNDataFrame::SpillPlanes(void* dst) {
+  uint8_t* t = static_cast<uint8_t*>(dst);
+  for (int i = 0; i < GetPlanes(); ++i) {
+    memcpy(t, data[i]->GetCpuData(), GetPlaneBytes(i));
+    t += GetPlaneBytes(i);
   }
 }
 
-unsigned long CNDataFrame::GetModulesMask(Module* module) {
-  std::unique_lock<std::mutex> lock(modules_mutex);
-  auto iter = module_mask_map_.find(module->GetId());
-  if (iter != module_mask_map_.end()) {
-    return iter->second;
+void CNDataFrame::ReleasePlanes() {
+  for (int i = 0; i < GetPlanes(); ++i) data[i].reset();
+  CNStreamFreeHost(cpu_data), cpu_data = nullptr;
+  ReleaseMemory();
+}
+
+void CNDataFrame::RestorePlanes(const void* src) {
+  /* copied back as from a decoder buffer */
+  void* saved_ptr[CN_MAX_PLANES];
+  memcpy(saved_ptr, ptr, sizeof(ptr));
+  const uint8_t* t = static_cast<const uint8_t*>(src);
+  for (int i = 0; i < GetPlanes(); ++i) {
+    ptr[i] = const_cast<uint8_t*>(t);
+    t += GetPlaneBytes(i);
   }
-  return 0;
+  CopyToSyncMem();
+  memcpy(ptr, saved_ptr, sizeof(ptr));
 }
 
-void CNDataFrame::ClearModuleMask(Module* module) {
-  std::unique_lock<std::mutex> lock(modules_mutex);
-  auto iter = module_mask_map_.find(module->GetId());
-  if (iter != module_mask_map_.end()) {
-    iter->second = 0;
+constexpr size_t CNDataFrame::kInlineModuleMaskNum;
+constexpr int CNDataFrame::kJoinOpen;
+constexpr int CNDataFrame::kJoinComplete;
+constexpr int CNDataFrame::kJoinClosed;
+
+void CNDataFrame::InitModuleMask(size_t module_num) {
+  if (module_num_) return;
+  if (module_num > kInlineModuleMaskNum) {
+    module_masks_.reset(new ModuleMaskState[module_num]);
   }
+  module_num_ = module_num;
+}
+
+CNDataFrame::ModuleMaskState* CNDataFrame::ModuleMask(Module* module) {
+  size_t idx = module->GetId();
+  if (idx >= module_num_) return nullptr;
+  return module_masks_ ? &module_masks_[idx] : &inline_module_masks_[idx];
+}
+
+uint64_t CNDataFrame::SetModuleMask(Module* module, size_t input_idx) {
+  ModuleMaskState* mask = ModuleMask(module);
+  if (!mask) return 0;
+  const uint64_t bit = (uint64_t)1 << input_idx;
+  return mask->links.fetch_or(bit, std::memory_order_acq_rel) | bit;
+}
+
+uint64_t CNDataFrame::GetModulesMask(Module* module) {
+  ModuleMaskState* mask = ModuleMask(module);
+  return mask ? mask->links.load(std::memory_order_acquire) : 0;
+}
+
+void CNDataFrame::AddRoutedMask(Module* module) {
+  ModuleMaskState* mask = ModuleMask(module);
+  if (mask) mask->routed.fetch_add(1, std::memory_order_acq_rel);
+}
+
+bool CNDataFrame::ModuleMaskGot(Module* module, uint64_t links) {
+  /* each link is counted as routed before the frame is sent on it, so before its bit is set */
+  ModuleMaskState* mask = ModuleMask(module);
+  const uint32_t routed_num = mask ? mask->routed.load(std::memory_order_acquire) : 0;
+  return std::bitset<64>(links).count() > routed_num;
+}
+
+bool CNDataFrame::IsModuleMaskPassedOn(Module* module) {
+  ModuleMaskState* mask = ModuleMask(module);
+  if (!mask || 0 == mask->routed.load(std::memory_order_acquire)) return false;
+  return kJoinClosed != mask->join.load(std::memory_order_acquire) &&
+         !ModuleMaskGot(module, mask->links.load(std::memory_order_acquire));
+}
+
+bool CNDataFrame::CompleteModuleMask(Module* module) {
+  ModuleMaskState* mask = ModuleMask(module);
+  int join = kJoinOpen;
+  return !mask || mask->join.compare_exchange_strong(join, kJoinComplete, std::memory_order_acq_rel);
+}
+
+bool CNDataFrame::CloseModuleMask(Module* module, uint64_t join_mask) {
+  ModuleMaskState* mask = ModuleMask(module);
+  if (!mask) return false;
+  const uint64_t links = mask->links.load(std::memory_order_acquire);
+  if (0 == links || join_mask == links) return false;
+  /* the last link got meanwhile finds the frame closed, and counts it late */
+  int join = kJoinOpen;
+  return mask->join.compare_exchange_strong(join, kJoinClosed, std::memory_order_acq_rel);
 }
 
-unsigned long CNDataFrame::AddEOSMask(Module* module) {
-  std::lock_guard<std::mutex> lock(eos_mutex);
-  eos_mask |= (unsigned long)1 << module->GetId();
-  return eos_mask;
+bool CNDataFrame::IsModuleMaskJoined(Module* module) {
+  ModuleMaskState* mask = ModuleMask(module);
+  return mask && kJoinClosed == mask->join.load(std::memory_order_acquire);
+}
+
+void CNDataFrame::ClearModuleMask(Module* module) {
+  ModuleMaskState* mask = ModuleMask(module);
+  if (!mask) return;
+  mask->links.store(0, std::memory_order_relaxed);
+  mask->routed.store(0, std::memory_order_relaxed);
+  mask->join.store(kJoinOpen, std::memory_order_release);
 }
 
+size_t CNDataFrame::AddEOSMask(Module* module) { return eos_cnt_.fetch_add(1, std::memory_order_acq_rel) + 1; }
+
 bool CNInferObject::AddAttribute(const std::string& key, const CNInferAttr& value) {
   std::lock_guard<std::mutex> lk(attribute_mutex_);
 
@@ -248,9 +504,67 @@ std::vector<CNInferFeature> CNInferObject::GetFeatures() {
 
 std::mutex CNFrameInfo::mutex_;
 std::map<std::string, int> CNFrameInfo::stream_count_map_;
+std::condition_variable CNFrameInfo::credit_cond_;
+std::atomic<int> CNFrameInfo::credit_waiters_{0};
 int CNFrameInfo::parallelism_ = 0;
 
-void SetParallelism(int parallelism) { CNFrameInfo::parallelism_ = parallelism; }
+void SetParallelism(int parallelism) {
+  CNFrameInfo::parallelism_ = parallelism;
+  WakeupFrameCreditWaiters();
+}
+
+/* with CNFrameInfo::mutex_ held */
+static bool HasFrameCreditUnlocked(const std::map<std::string, int>& stream_count_map, const std::string& stream_id) {
+  if (CNFrameInfo::parallelism_ > 0) {
+    auto iter = stream_count_map.find(stream_id);
+    if (iter != stream_count_map.end() && iter->second >= CNFrameInfo::parallelism_) return false;
+  }
+  return HasMemoryCredit(stream_id);
+}
+
+bool HasFrameCredit(const std::string& stream_id) {
+  if (CNFrameInfo::parallelism_ <= 0) return HasMemoryCredit(stream_id);
+  std::lock_guard<std::mutex> lk(CNFrameInfo::mutex_);
+  return HasFrameCreditUnlocked(CNFrameInfo::stream_count_map_, stream_id);
+}
+
+/*
+  Same idea as ConveyorWaiter: a waiter registers in credit_waiters_ before it checks its credit, the
+  memory accounts are changed without CNFrameInfo::mutex_ and checked for waiters after. The seq_cst
+  fences on both sides make sure at least one of them sees the other. Frame counts are changed under
+  CNFrameInfo::mutex_, which orders them with the waiters already.
+ */
+bool WaitForFrameCredit(const std::string& stream_id, const std::function<bool()>& stop) {
+  CNFrameInfo::credit_waiters_.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool ret = false;
+  {
+    std::unique_lock<std::mutex> lk(CNFrameInfo::mutex_);
+    CNFrameInfo::credit_cond_.wait(
+        lk, [&] { return stop() || HasFrameCreditUnlocked(CNFrameInfo::stream_count_map_, stream_id); });
+    ret = HasFrameCreditUnlocked(CNFrameInfo::stream_count_map_, stream_id) && !stop();
+  }
+  CNFrameInfo::credit_waiters_.fetch_sub(1);
+  return ret;
+}
+
+void WakeupFrameCreditWaiters() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (CNFrameInfo::credit_waiters_.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lk(CNFrameInfo::mutex_);
+    CNFrameInfo::credit_cond_.notify_all();
+  }
+}
+
+static int64_t SteadyTimeUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+bool CNFrameInfo::IsStale() const {
+  if (0 == latency_budget_ms || (frame.flags & CN_FRAME_FLAG_EOS)) return false;
+  return SteadyTimeUs() - create_time_us > static_cast<int64_t>(latency_budget_ms) * 1000;
+}
 
 std::shared_ptr<CNFrameInfo> CNFrameInfo::Create(const std::string& stream_id, bool eos) {
   CNFrameInfo* frameInfo = new CNFrameInfo();
@@ -258,6 +572,7 @@ std::shared_ptr<CNFrameInfo> CNFrameInfo::Create(const std::string& stream_id, b
     return nullptr;
   }
   frameInfo->frame.stream_id = stream_id;
+  frameInfo->create_time_us = SteadyTimeUs();
   std::shared_ptr<CNFrameInfo> ptr(frameInfo);
   if (eos) {
     ptr->frame.flags |= cnstream::CN_FRAME_FLAG_EOS;
@@ -303,6 +618,7 @@ CNFrameInfo::~CNFrameInfo() {
         iter->second = count;
         // LOG(INFO) << "CNFrameInfo::~CNFrameInfo() update stream_id " << frame.stream_id << " : " << count;
       }
+      if (credit_waiters_.load(std::memory_order_relaxed) > 0) credit_cond_.notify_all();
     } else {
       LOG(ERROR) << "Invaid stream_id, please check\n";
     }
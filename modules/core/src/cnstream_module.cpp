@@ -24,34 +24,18 @@
 
 namespace cnstream {
 
-std::mutex Module::module_id_mutex_;
-uint64_t Module::module_id_mask_ = 0;
-
-/*maxModuleIdNum is sizeof(module_id_mask_) * 8  (bytes->bits)*/
-size_t Module::GetId() {
-  std::unique_lock<std::mutex> lock(module_id_mutex_);
-  if (id_ != INVALID_MODULE_ID) {
-    return id_;
-  }
-  for (size_t i = 0; i < sizeof(module_id_mask_) * 8; i++) {
-    if (!(module_id_mask_ & ((uint64_t)1 << i))) {
-      module_id_mask_ |= (uint64_t)1 << i;
-      id_ = i;
-      return i;
+int Module::ProcessBatch(std::vector<std::shared_ptr<CNFrameInfo>>& data) {
+  for (size_t i = 0; i < data.size(); ++i) {
+    int ret = Process(data[i]);
+    if (ret < 0) {
+      data.resize(i);
+      return ret;
     }
   }
-  id_ = INVALID_MODULE_ID;
-  return INVALID_MODULE_ID;
+  return 0;
 }
 
-void Module::ReturnId() {
-  std::unique_lock<std::mutex> lock(module_id_mutex_);
-  if (id_ < 0 || id_ >= sizeof(module_id_mask_) * 8) {
-    return;
-  }
-  module_id_mask_ &= ~(1 << id_);
-  id_ = INVALID_MODULE_ID;
-}
+void Module::ProcessAsync(std::shared_ptr<CNFrameInfo> data, ProcessDone done) { done(Process(data)); }
 
 bool Module::PostEvent(EventType type, const std::string& msg) const {
   Event event;
@@ -66,6 +50,10 @@ bool Module::PostEvent(EventType type, const std::string& msg) const {
   }
 }
 
+void Module::ApplyPlacement() const {
+  if (container_) container_->ApplyModulePlacement(this);
+}
+
 ModuleFactory* ModuleFactory::factory_ = nullptr;
 
 }  // namespace cnstream
@@ -24,22 +24,35 @@
 #include <rapidjson/writer.h>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "async_queue.hpp"
 #include "cnstream_module.hpp"
 #include "cnstream_pipeline.hpp"
 #include "cnstream_timer.hpp"
 #include "connector.hpp"
 #include "conveyor.hpp"
+#include "cpu_placement.hpp"
+#include "frame_reorder.hpp"
+#include "module_task.hpp"
+#include "pause_gate.hpp"
+#include "route_node.hpp"
 #include "threadsafe_queue.hpp"
+#include "worker_pool.hpp"
 
 namespace cnstream {
 
@@ -77,6 +90,150 @@ void CNModuleConfig::ParseByJSONStr(const std::string& jstr) {
     this->maxInputQueueSize = 20;
   }
 
+  // queueImpl
+  if (end != doc.FindMember("queue_impl")) {
+    if (!doc["queue_impl"].IsString()) throw std::string("queue_impl must be string type.");
+    std::string queue_impl = doc["queue_impl"].GetString();
+    if ("mutex" == queue_impl) {
+      this->queueImpl = QUEUE_IMPL_MUTEX;
+    } else if ("ring" == queue_impl) {
+      this->queueImpl = QUEUE_IMPL_RING;
+    } else if ("fair" == queue_impl) {
+      this->queueImpl = QUEUE_IMPL_FAIR;
+    } else if ("spill" == queue_impl) {
+      this->queueImpl = QUEUE_IMPL_SPILL;
+    } else {
+      throw "queue_impl must be \"mutex\", \"ring\", \"fair\" or \"spill\", not \"" + queue_impl + "\".";
+    }
+  } else {
+    this->queueImpl = QUEUE_IMPL_MUTEX;
+  }
+
+  // spillDir
+  if (end != doc.FindMember("spill_dir")) {
+    if (!doc["spill_dir"].IsString()) throw std::string("spill_dir must be string type.");
+    this->spillDir = doc["spill_dir"].GetString();
+  } else {
+    this->spillDir = "";
+  }
+
+  // dispatchPolicy
+  if (end != doc.FindMember("dispatch")) {
+    if (!doc["dispatch"].IsString()) throw std::string("dispatch must be string type.");
+    std::string dispatch = doc["dispatch"].GetString();
+    if ("modulo" == dispatch) {
+      this->dispatchPolicy = DISPATCH_MODULO;
+    } else if ("least_loaded" == dispatch) {
+      this->dispatchPolicy = DISPATCH_LEAST_LOADED;
+    } else if ("consistent_hash" == dispatch) {
+      this->dispatchPolicy = DISPATCH_CONSISTENT_HASH;
+    } else if ("spread" == dispatch) {
+      this->dispatchPolicy = DISPATCH_SPREAD;
+    } else {
+      throw "dispatch must be \"modulo\", \"least_loaded\", \"consistent_hash\" or \"spread\", not \"" +
+          dispatch + "\".";
+    }
+  } else {
+    this->dispatchPolicy = DISPATCH_MODULO;
+  }
+
+  // disableFusion
+  if (end != doc.FindMember("disable_fusion")) {
+    if (!doc["disable_fusion"].IsBool()) throw std::string("disable_fusion must be bool type.");
+    this->disableFusion = doc["disable_fusion"].GetBool();
+  } else {
+    this->disableFusion = false;
+  }
+
+  // minParallelism and maxParallelism
+  if (end != doc.FindMember("min_parallelism")) {
+    if (!doc["min_parallelism"].IsUint()) throw std::string("min_parallelism must be uint type.");
+    this->minParallelism = doc["min_parallelism"].GetUint();
+  } else {
+    this->minParallelism = 1;
+  }
+  if (end != doc.FindMember("max_parallelism")) {
+    if (!doc["max_parallelism"].IsUint()) throw std::string("max_parallelism must be uint type.");
+    this->maxParallelism = doc["max_parallelism"].GetUint();
+    if (this->maxParallelism < this->minParallelism) {
+      throw std::string("max_parallelism must not be less than min_parallelism.");
+    }
+  } else {
+    this->maxParallelism = 0;
+  }
+
+  // placement
+  this->placement = ModulePlacement();
+  if (end != doc.FindMember("cpu_affinity")) {
+    if (!doc["cpu_affinity"].IsString()) throw std::string("cpu_affinity must be string type.");
+    std::string cpu_affinity = doc["cpu_affinity"].GetString();
+    if (!ParseCpuList(cpu_affinity, &this->placement.cpus)) {
+      throw "cpu_affinity must be a cpu list like \"0-3,8\", not \"" + cpu_affinity + "\".";
+    }
+  }
+  if (end != doc.FindMember("numa_node")) {
+    if (!doc["numa_node"].IsUint()) throw std::string("numa_node must be uint type.");
+    this->placement.numa_node = doc["numa_node"].GetUint();
+  }
+
+  // dropPolicy and dropLowWatermark
+  if (end != doc.FindMember("drop_policy")) {
+    if (!doc["drop_policy"].IsString()) throw std::string("drop_policy must be string type.");
+    std::string drop_policy = doc["drop_policy"].GetString();
+    if ("none" == drop_policy) {
+      this->dropPolicy = DROP_NONE;
+    } else if ("oldest" == drop_policy) {
+      this->dropPolicy = DROP_OLDEST;
+    } else if ("newest" == drop_policy) {
+      this->dropPolicy = DROP_NEWEST;
+    } else if ("largest_stream" == drop_policy) {
+      this->dropPolicy = DROP_LARGEST_STREAM;
+    } else {
+      throw "drop_policy must be \"none\", \"oldest\", \"newest\" or \"largest_stream\", not \"" + drop_policy +
+          "\".";
+    }
+  } else {
+    this->dropPolicy = DROP_NONE;
+  }
+  if (end != doc.FindMember("drop_low_watermark")) {
+    if (!doc["drop_low_watermark"].IsUint()) throw std::string("drop_low_watermark must be uint type.");
+    this->dropLowWatermark = doc["drop_low_watermark"].GetUint();
+    if (this->dropLowWatermark >= this->maxInputQueueSize) {
+      throw std::string("drop_low_watermark must be less than max_input_queue_size.");
+    }
+  } else {
+    this->dropLowWatermark = 0;
+  }
+
+  // joinTimeoutMs
+  if (end != doc.FindMember("join_timeout_ms")) {
+    if (!doc["join_timeout_ms"].IsUint()) throw std::string("join_timeout_ms must be uint type.");
+    this->joinTimeoutMs = doc["join_timeout_ms"].GetUint();
+  } else {
+    this->joinTimeoutMs = 0;
+  }
+
+  // route
+  this->route = RoutePredicate();
+  if (end != doc.FindMember("route")) {
+    const rapidjson::Value& route = doc["route"];
+    if (!route.IsObject()) throw std::string("route must be an object.");
+    auto parse_strings = [&route](const char* key, std::vector<std::string>* values) {
+      if (route.MemberEnd() == route.FindMember(key)) return;
+      if (!route[key].IsArray()) throw "route " + std::string(key) + " must be array type.";
+      for (auto& value : route[key].GetArray()) {
+        if (!value.IsString()) throw "route " + std::string(key) + " must be an array of strings.";
+        values->push_back(value.GetString());
+      }
+    };
+    parse_strings("labels", &this->route.labels);
+    parse_strings("streams", &this->route.streams);
+    if (route.MemberEnd() != route.FindMember("every_n")) {
+      if (!route["every_n"].IsUint()) throw std::string("route every_n must be uint type.");
+      this->route.every_n = route["every_n"].GetUint();
+    }
+  }
+
   // next
   if (end != doc.FindMember("next_modules")) {
     if (!doc["next_modules"].IsArray()) {
@@ -130,13 +287,80 @@ void CNModuleConfig::ParseByJSONFile(const std::string& jfname) {
   ParseByJSONStr(jstr);
 }
 
+bool RoutePredicate::PassAll() const { return labels.empty() && every_n <= 1 && streams.empty() && !filter; }
+
+bool RoutePredicate::Pass(const CNFrameInfo& data) const {
+  if (data.frame.flags & CN_FRAME_FLAG_EOS) return true;
+  if (every_n > 1 && 0 != data.frame.frame_id % every_n) return false;
+  if (!streams.empty() && streams.end() == std::find(streams.begin(), streams.end(), data.frame.stream_id)) {
+    return false;
+  }
+  if (!labels.empty()) {
+    auto has_label = [this](const std::shared_ptr<CNInferObject>& obj) {
+      return labels.end() != std::find(labels.begin(), labels.end(), obj->id);
+    };
+    if (std::none_of(data.objs.begin(), data.objs.end(), has_label)) return false;
+  }
+  return !filter || filter(data);
+}
+
+void PipelineConfig::ParseByJSONStr(const std::string& jstr) {
+  rapidjson::Document doc;
+  if (doc.Parse(jstr.c_str()).HasParseError()) {
+    throw "Parse pipeline configuration failed. Error code [" + std::to_string(doc.GetParseError()) + "]" +
+        " Offset [" + std::to_string(doc.GetErrorOffset()) + "]. JSON:" + jstr;
+  }
+
+  const auto end = doc.MemberEnd();
+
+  // scheduler
+  if (end != doc.FindMember("scheduler")) {
+    if (!doc["scheduler"].IsString()) throw std::string("scheduler must be string type.");
+    std::string scheduler = doc["scheduler"].GetString();
+    if ("thread" == scheduler) {
+      this->scheduler = SCHEDULER_THREAD;
+    } else if ("worker_pool" == scheduler) {
+      this->scheduler = SCHEDULER_WORKER_POOL;
+    } else {
+      throw std::string("scheduler must be \"thread\" or \"worker_pool\".");
+    }
+  } else {
+    this->scheduler = SCHEDULER_THREAD;
+  }
+
+  // workerNum
+  if (end != doc.FindMember("worker_num")) {
+    if (!doc["worker_num"].IsUint()) throw std::string("worker_num must be uint type.");
+    this->workerNum = doc["worker_num"].GetUint();
+  } else {
+    this->workerNum = 0;
+  }
+
+  // openThreadNum
+  if (end != doc.FindMember("open_thread_num")) {
+    if (!doc["open_thread_num"].IsUint()) throw std::string("open_thread_num must be uint type.");
+    this->openThreadNum = doc["open_thread_num"].GetUint();
+  } else {
+    this->openThreadNum = 1;
+  }
+}
+
 struct ModuleAssociatedInfo {
   std::shared_ptr<Module> instance;
   uint32_t parallelism = 0;
+  /* elastic parallelism, see Pipeline::SetModuleParallelismRange. 0 max_parallelism for a fixed one */
+  uint32_t min_parallelism = 0;
+  uint32_t max_parallelism = 0;
+  bool fusion_disabled = false;
+  ModulePlacement placement;
+  uint32_t join_timeout_ms = 0;  ///< see Pipeline::SetModuleJoinTimeout
   std::vector<CNTimer> timers_;
+  std::vector<std::shared_ptr<ConveyorWaiter>> waiters_;  ///< one per thread, only for multiple input links
   std::set<int64_t> down_nodes;
   std::vector<std::string> input_connectors;
   std::vector<std::string> output_connectors;
+  /* number of data queues (and threads) */
+  uint32_t QueueNum() const { return std::max(parallelism, max_parallelism); }
 };
 
 StreamMsgObserver::~StreamMsgObserver() {}
@@ -145,11 +369,12 @@ class PipelinePrivate {
  private:
   explicit PipelinePrivate(Pipeline* q_ptr) : q_ptr_(q_ptr) {
     // stream message handle thread
-    exit_msg_loop_ = false;
     smsg_thread_ = std::thread(&PipelinePrivate::StreamMsgHandleFunc, this);
   }
   ~PipelinePrivate() {
-    exit_msg_loop_ = true;
+    StopJoinWatcher();
+    StopAutoscaler();
+    msgq_.Stop();
     if (smsg_thread_.joinable()) smsg_thread_.join();
   }
   std::unordered_map<std::string, std::shared_ptr<Connector>> links_;
@@ -157,20 +382,607 @@ class PipelinePrivate {
   std::thread event_thread_;
   std::map<int64_t, ModuleAssociatedInfo> modules_;
   std::mutex stop_mtx_;
-  uint64_t eos_mask_ = 0;
+  /* number of modules an EOS has to pass through, 0 while not running */
+  size_t eos_module_num_ = 0;
+  PipelineConfig config_;
+  std::unique_ptr<WorkerPool> worker_pool_;
+  std::vector<std::unique_ptr<ModuleTask>> module_tasks_;
+  PauseGate pause_gate_;
+  std::vector<RouteNode> route_table_;
+  /* by link, kept across runs with the frames they hold, see DISPATCH_SPREAD */
+  std::unordered_map<Connector*, std::unique_ptr<FrameReorder>> reorders_;
+  /* next frame_id of each channel, only taken by sources while some link reorders frames */
+  bool stamp_eos_ = false;
+  std::mutex next_frame_id_mtx_;
+  std::unordered_map<uint32_t, int64_t> next_frame_id_;
 
  private:
   std::unordered_map<std::string, CNModuleConfig> modules_config_;
   std::unordered_map<std::string, std::vector<std::string>> connections_config_;
   std::map<std::string, std::shared_ptr<Module>> modules_map_;
   DECLARE_PUBLIC(q_ptr_, Pipeline);
-  void SetEOSMask() {
-    for (const std::pair<int64_t, ModuleAssociatedInfo> module_info : modules_) {
-      auto instance = module_info.second.instance;
-      eos_mask_ |= (uint64_t)1 << instance->GetId();
+  void SetEOSMask() { eos_module_num_ = modules_.size(); }
+  void CompileRouteTable() {
+    route_table_.clear();
+    route_table_.resize(modules_.size());
+    for (auto& it : modules_) {
+      ModuleAssociatedInfo& module_info = it.second;
+      module_info.timers_.resize(module_info.QueueNum());
+      RouteNode& node = route_table_[module_info.instance->GetId()];
+      node.module = module_info.instance.get();
+      node.join_mask = node.module->GetModulesMask();
+      node.timers = module_info.timers_.data();
+      for (auto& link_id : module_info.input_connectors) node.inputs.push_back(links_[link_id].get());
+      for (auto& link_id : module_info.output_connectors) node.outputs.push_back(links_[link_id].get());
+    }
+    CompileReorders();
+    CompileFusion();
+    CompileElastic();
+    CompilePlacement();
+    CompileRoutes();
+    CompileJoins();
+  }
+  /*
+    a frame which does not pass the route of a link is passed on through the modules after it without being
+    processed, as far as they lead to a join module, which waits for it on each input link in order. the
+    branches which join no other one never get it. see RoutePredicate.
+   */
+  void CompileRoutes() {
+    std::unordered_map<Connector*, size_t> link_dst;
+    for (size_t node_idx = 0; node_idx < route_table_.size(); ++node_idx) {
+      for (Connector* connector : route_table_[node_idx].inputs) link_dst[connector] = node_idx;
+    }
+    enum { UNVISITED, VISITING, NO_JOIN, JOIN };
+    std::vector<int> joins(route_table_.size(), UNVISITED);
+    /* modules linked in a cycle lead to a join module, the one the cycle is entered at */
+    std::function<bool(size_t)> lead_to_join = [&](size_t node_idx) -> bool {
+      if (UNVISITED != joins[node_idx]) return NO_JOIN != joins[node_idx];
+      joins[node_idx] = VISITING;
+      const RouteNode& node = route_table_[node_idx];
+      bool join = node.inputs.size() > 1;
+      for (Connector* connector : node.outputs) join = lead_to_join(link_dst[connector]) || join;
+      joins[node_idx] = join ? JOIN : NO_JOIN;
+      return join;
+    };
+    has_routes_ = false;
+    for (RouteNode& node : route_table_) {
+      for (Connector* connector : node.outputs) {
+        node.routes.push_back(connector->GetRoute());
+        node.output_nodes.push_back(link_dst[connector]);
+        node.routes_through.push_back(lead_to_join(link_dst[connector]));
+        if (node.routes.back()) has_routes_ = true;
+      }
+    }
+  }
+  /*
+    returns whether data is pushed to the output_idx-th output link of node, passed on only if it does not pass
+    the route of the link or it is passed on by node itself.
+   */
+  bool RouteOutput(const RouteNode& node, size_t output_idx, const CNFrameInfoPtr& data, bool pass_on) {
+    if (!pass_on) {
+      const RoutePredicate* route = node.routes[output_idx];
+      if (!route || route->Pass(*data)) return true;
+      node.outputs[output_idx]->FrameRoutedPast();
+    }
+    if (node.routes_through[output_idx]) {
+      data->frame.AddRoutedMask(route_table_[node.output_nodes[output_idx]].module);
+      return true;
+    }
+    SkipBranch(node, output_idx, data);
+    return false;
+  }
+  /* data never goes through the branch from the output_idx-th output link of node, which joins no other one */
+  void SkipBranch(const RouteNode& node, size_t output_idx, const CNFrameInfoPtr& data) {
+    Connector* connector = node.outputs[output_idx];
+    if (node.reorders[output_idx]) {
+      /* like frames released by the dispatcher, they never wait for space */
+      node.reorders[output_idx]->Skip(data, [connector](const CNFrameInfoPtr& frame) {
+        int conveyor_idx = connector->DispatchConveyor(frame);
+        if (conveyor_idx >= 0) connector->GetConveyor(conveyor_idx)->PushDataBufferNoWait(frame);
+      });
+    }
+    const RouteNode& dst = route_table_[node.output_nodes[output_idx]];
+    for (size_t i = 0; i < dst.outputs.size(); ++i) SkipBranch(dst, i, data);
+  }
+  /*
+    frames are read by the downstream module, so they are allocated on its node (the node of the first
+    downstream module which has one), see Pipeline::SetModulePlacement.
+   */
+  void CompilePlacement() {
+    std::vector<int> numa_nodes(route_table_.size(), -1);
+    for (auto& it : modules_) {
+      const ModulePlacement& placement = it.second.placement;
+      RouteNode& node = route_table_[it.second.instance->GetId()];
+      node.cpus = placement.cpus;
+      if (placement.numa_node >= 0) {
+        std::vector<int> node_cpus = GetNumaNodeCpus(placement.numa_node);
+        if (node_cpus.empty()) {
+          LOG(WARNING) << "[" << node.module->GetName() << "] NUMA node " << placement.numa_node << " not found.";
+        } else {
+          numa_nodes[node.module->GetId()] = placement.numa_node;
+          std::vector<int> cpus;
+          std::set_intersection(placement.cpus.begin(), placement.cpus.end(), node_cpus.begin(), node_cpus.end(),
+                                std::back_inserter(cpus));
+          if (placement.cpus.empty()) {
+            node.cpus = node_cpus;
+          } else if (cpus.empty()) {
+            LOG(WARNING) << "[" << node.module->GetName() << "] cpu_affinity " << FormatCpuList(placement.cpus)
+                         << " is not on NUMA node " << placement.numa_node << ", cpu_affinity is used.";
+          } else {
+            node.cpus = cpus;
+          }
+        }
+      }
     }
+    std::unordered_map<Connector*, size_t> link_dst;
+    for (size_t node_idx = 0; node_idx < route_table_.size(); ++node_idx) {
+      for (Connector* connector : route_table_[node_idx].inputs) link_dst[connector] = node_idx;
+    }
+    for (size_t node_idx = 0; node_idx < route_table_.size(); ++node_idx) {
+      RouteNode& node = route_table_[node_idx];
+      node.memory_node = numa_nodes[node_idx];
+      for (Connector* connector : node.outputs) {
+        if (numa_nodes[link_dst[connector]] < 0) continue;
+        node.memory_node = numa_nodes[link_dst[connector]];
+        break;
+      }
+    }
+  }
+  void ApplyPlacement(size_t node_idx) {
+    const RouteNode& node = route_table_[node_idx];
+    if (!node.cpus.empty() && !PinCurrentThread(node.cpus)) {
+      LOG(WARNING) << "[" << node.module->GetName() << "] pin thread to cpus " << FormatCpuList(node.cpus)
+                   << " failed.";
+    }
+    CNStreamSetHostMemoryNode(node.memory_node);
+  }
+  /*
+    warm-up, see Module::WarmUp. a thread of a module warms up the modules fused after it too, as it processes
+    their data. Start waits for all the threads to be warm.
+   */
+  void WarmUp(size_t node_idx) {
+    for (size_t idx = node_idx;; idx = route_table_[idx].next_idx) {
+      route_table_[idx].module->WarmUp();
+      if (!route_table_[idx].fuse_next) break;
+    }
+  }
+  void WarmUpWorker() {
+    for (size_t node_idx = 0; node_idx < route_table_.size(); ++node_idx) {
+      if (!route_table_[node_idx].inputs.empty()) route_table_[node_idx].module->WarmUp();
+    }
+  }
+  void SetColdThreads(size_t num) {
+    std::lock_guard<std::mutex> lk(warm_mtx_);
+    cold_threads_ = num;
+  }
+  void ThreadWarm() {
+    {
+      std::lock_guard<std::mutex> lk(warm_mtx_);
+      --cold_threads_;
+    }
+    warm_cond_.notify_all();
+  }
+  void WaitWarm() {
+    std::unique_lock<std::mutex> lk(warm_mtx_);
+    warm_cond_.wait(lk, [this] { return 0 == cold_threads_; });
+  }
+  size_t cold_threads_ = 0;
+  std::mutex warm_mtx_;
+  std::condition_variable warm_cond_;
+
+  void ReportPlacement(bool use_worker_pool) {
+    for (const RouteNode& node : route_table_) {
+      if (node.cpus.empty() && node.memory_node < 0) continue;
+      LOG(INFO) << "[" << node.module->GetName() << "] placement: threads on cpus "
+                << (use_worker_pool || node.cpus.empty() ? std::string("any") : FormatCpuList(node.cpus))
+                << (use_worker_pool ? " (worker pool)" : "") << ", frames allocated on NUMA node "
+                << (node.memory_node < 0 ? std::string("any") : std::to_string(node.memory_node));
+    }
+  }
+  /*
+    frames of a stream are out of order after a link with DISPATCH_SPREAD, until they get to a module which
+    requires order. frames are put back in order on the links before that module (the ones they come out of
+    order from), see FrameReorder.
+   */
+  void CompileReorders() {
+    std::unordered_map<Connector*, size_t> link_src;
+    for (size_t node_idx = 0; node_idx < route_table_.size(); ++node_idx) {
+      for (Connector* connector : route_table_[node_idx].outputs) link_src[connector] = node_idx;
+    }
+    for (RouteNode& node : route_table_) {
+      /* all input links of a join module have to send a stream to the same thread */
+      bool join = node.inputs.size() > 1;
+      for (Connector* connector : node.inputs) {
+        DispatchPolicy policy = connector->GetDispatchPolicy();
+        if (DISPATCH_MODULO == policy) continue;
+        if (join || (DISPATCH_SPREAD == policy && node.module->IsFrameOrderRequired())) {
+          LOG(WARNING) << "[" << node.module->GetName() << "] "
+                       << (join ? "has more than one input link" : "requires frame order")
+                       << ", dispatch policy falls back to modulo.";
+          connector->SetDispatchPolicy(DISPATCH_MODULO);
+        }
+      }
+    }
+    /* whether the frames a module transmits may be out of order, modules linked in a cycle count as ordered */
+    enum { UNVISITED, VISITING, ORDERED, UNORDERED };
+    std::vector<int> order(route_table_.size(), UNVISITED);
+    std::unordered_set<Connector*> reorder_links;
+    std::function<bool(size_t)> unordered = [&](size_t node_idx) -> bool {
+      if (UNVISITED != order[node_idx]) return UNORDERED == order[node_idx];
+      order[node_idx] = VISITING;
+      const RouteNode& node = route_table_[node_idx];
+      bool out_of_order = false;
+      for (Connector* connector : node.inputs) {
+        bool link_unordered = DISPATCH_SPREAD == connector->GetDispatchPolicy() || unordered(link_src[connector]);
+        if (!link_unordered) continue;
+        if (node.module->IsFrameOrderRequired()) {
+          reorder_links.insert(connector);
+        } else {
+          out_of_order = true;
+        }
+      }
+      order[node_idx] = out_of_order ? UNORDERED : ORDERED;
+      return out_of_order;
+    };
+    for (size_t node_idx = 0; node_idx < route_table_.size(); ++node_idx) unordered(node_idx);
+
+    for (RouteNode& node : route_table_) {
+      node.reorders.assign(node.outputs.size(), nullptr);
+      for (size_t i = 0; i < node.outputs.size(); ++i) {
+        if (!reorder_links.count(node.outputs[i])) continue;
+        std::unique_ptr<FrameReorder>& reorder = reorders_[node.outputs[i]];
+        if (!reorder) reorder.reset(new FrameReorder);
+        node.reorders[i] = reorder.get();
+      }
+    }
+    stamp_eos_ = !reorder_links.empty();
+
+    /* a frame dropped on a link is skipped by the reorders after it, see DropPolicy */
+    std::unordered_map<Connector*, size_t> link_dst;
+    for (size_t node_idx = 0; node_idx < route_table_.size(); ++node_idx) {
+      for (Connector* connector : route_table_[node_idx].inputs) link_dst[connector] = node_idx;
+    }
+    for (auto& it : link_dst) {
+      std::vector<std::pair<FrameReorder*, Connector*>> targets;
+      std::vector<bool> visited(route_table_.size(), false);
+      std::function<void(size_t)> collect = [&](size_t node_idx) {
+        if (visited[node_idx]) return;
+        visited[node_idx] = true;
+        const RouteNode& node = route_table_[node_idx];
+        for (size_t i = 0; i < node.outputs.size(); ++i) {
+          if (node.reorders[i]) targets.emplace_back(node.reorders[i], node.outputs[i]);
+          collect(link_dst[node.outputs[i]]);
+        }
+      };
+      collect(it.second);
+      if (targets.empty()) {
+        it.first->SetDropListener(nullptr);
+        continue;
+      }
+      it.first->SetDropListener([targets](const CNFrameInfoPtr& data) {
+        for (auto& target : targets) {
+          Connector* connector = target.second;
+          /* like frames released by the dispatcher, they never wait for space */
+          target.first->Skip(data, [connector](const CNFrameInfoPtr& frame) {
+            int conveyor_idx = connector->DispatchConveyor(frame);
+            if (conveyor_idx >= 0) connector->GetConveyor(conveyor_idx)->PushDataBufferNoWait(frame);
+          });
+        }
+      });
+    }
+  }
+  /*
+    a module linked one to one with its upstream module processes frames right after it, on the same thread,
+    see Pipeline::DisableModuleFusion. a fused module may fuse its own downstream module in turn.
+   */
+  void CompileFusion() {
+    std::vector<const ModuleAssociatedInfo*> infos(route_table_.size());
+    for (auto& it : modules_) infos[it.second.instance->GetId()] = &it.second;
+    std::unordered_map<Connector*, size_t> link_dst;
+    for (size_t node_idx = 0; node_idx < route_table_.size(); ++node_idx) {
+      for (Connector* connector : route_table_[node_idx].inputs) link_dst[connector] = node_idx;
+    }
+    auto fusable = [&](size_t node_idx) {
+      const Module* module = route_table_[node_idx].module;
+      return !infos[node_idx]->fusion_disabled && 0 == infos[node_idx]->max_parallelism && !module->hasTranmit() &&
+             0 == module->GetAsyncDepth();
+    };
+    for (size_t node_idx = 0; node_idx < route_table_.size(); ++node_idx) {
+      RouteNode& node = route_table_[node_idx];
+      if (node.inputs.empty() || 1 != node.outputs.size() || !fusable(node_idx)) continue;
+      Connector* connector = node.outputs[0];
+      size_t next_idx = link_dst[connector];
+      RouteNode& next = route_table_[next_idx];
+      if (1 != next.inputs.size() || !fusable(next_idx)) continue;
+      /* a module which processes batches only gets them from another one */
+      if (next.module->GetBatchSize() > 1 && BatchSize(node) <= 1) continue;
+      if (0 == infos[node_idx]->parallelism || infos[node_idx]->parallelism != infos[next_idx]->parallelism) continue;
+      /* the threads of the upstream module are pinned for it */
+      const ModulePlacement& placement = infos[node_idx]->placement;
+      const ModulePlacement& next_placement = infos[next_idx]->placement;
+      if (placement.cpus != next_placement.cpus || placement.numa_node != next_placement.numa_node) continue;
+      /* the thread of each data queue of the upstream module serves the same streams downstream */
+      if (DISPATCH_MODULO != connector->GetDispatchPolicy() || node.reorders[0]) continue;
+      /*
+        so does the thread the upstream module runs a stream on, else two of its threads may run the fused module
+        with the same data queue index, and its timer, at once
+       */
+      if (std::any_of(node.inputs.begin(), node.inputs.end(),
+                      [](Connector* input) { return DISPATCH_MODULO != input->GetDispatchPolicy(); })) {
+        continue;
+      }
+      /* frames are routed one by one, see RoutePredicate */
+      if (connector->GetRoute()) continue;
+      node.fuse_next = true;
+      node.next_idx = next_idx;
+      next.fused = true;
+      LOG(INFO) << "[" << next.module->GetName() << "] is fused with [" << node.module->GetName() << "]";
+    }
+  }
+  /* the EOS of a stream is numbered after its last frame, so it is reordered after them */
+  void StampFrameId(CNFrameInfo* data) {
+    std::lock_guard<std::mutex> lk(next_frame_id_mtx_);
+    if (data->frame.flags & CN_FRAME_FLAG_EOS) {
+      auto iter = next_frame_id_.find(data->channel_idx);
+      data->frame.frame_id = next_frame_id_.end() == iter ? 0 : iter->second;
+      if (next_frame_id_.end() != iter) next_frame_id_.erase(iter);
+    } else {
+      next_frame_id_[data->channel_idx] = data->frame.frame_id + 1;
+    }
+  }
+  void ClearEOSMask() { eos_module_num_ = 0; }
+
+  /*
+    join timeout, see Pipeline::SetModuleJoinTimeout. a frame got from some of the input links of a join module
+    waits here from the first of them, and it is pushed to one more input link of the module at its deadline.
+   */
+  struct PendingJoin {
+    size_t node_idx;
+    uint32_t conveyor_idx;
+    CNFrameInfoPtr data;
+  };
+  void CompileJoins() {
+    has_join_timeout_ = false;
+    for (auto& it : modules_) {
+      ModuleAssociatedInfo& module_info = it.second;
+      RouteNode& node = route_table_[module_info.instance->GetId()];
+      if (0 == module_info.join_timeout_ms) continue;
+      if (node.inputs.size() < 2) {
+        LOG(WARNING) << "[" << node.module->GetName() << "] has less than two input links, join timeout is ignored.";
+        continue;
+      }
+      /* kept across runs with the frames it holds */
+      std::unique_ptr<Connector>& link = join_links_[node.module];
+      if (!link || link->GetConveyorCount() != module_info.QueueNum()) {
+        link.reset(new Connector(module_info.QueueNum(), LinkConfig()));
+      }
+      node.join_timeout_ms = module_info.join_timeout_ms;
+      node.join_timeout_input = link.get();
+      node.inputs.push_back(link.get());
+      has_join_timeout_ = true;
+    }
+  }
+  void StartJoinWatcher() {
+    if (!has_join_timeout_) return;
+    exit_join_watcher_ = false;
+    join_watcher_thread_ = std::thread(&PipelinePrivate::JoinWatcherFunc, this);
+  }
+  void StopJoinWatcher() {
+    {
+      std::lock_guard<std::mutex> lk(join_mtx_);
+      exit_join_watcher_ = true;
+    }
+    join_cond_.notify_all();
+    if (join_watcher_thread_.joinable()) join_watcher_thread_.join();
+  }
+  void WaitJoin(size_t node_idx, uint32_t conveyor_idx, const CNFrameInfoPtr& data) {
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(route_table_[node_idx].join_timeout_ms);
+    bool earliest = false;
+    {
+      std::lock_guard<std::mutex> lk(join_mtx_);
+      auto iter = pending_joins_.emplace(deadline, PendingJoin{node_idx, conveyor_idx, data});
+      earliest = pending_joins_.begin() == iter;
+    }
+    if (earliest) join_cond_.notify_one();
+  }
+  void JoinWatcherFunc() {
+    std::unique_lock<std::mutex> lk(join_mtx_);
+    while (!exit_join_watcher_) {
+      if (pending_joins_.empty() || join_paused_) {
+        join_cond_.wait(lk);
+      } else if (std::chrono::steady_clock::now() < pending_joins_.begin()->first) {
+        join_cond_.wait_until(lk, pending_joins_.begin()->first);
+      } else {
+        ForwardJoin(pending_joins_.begin()->second);
+        pending_joins_.erase(pending_joins_.begin());
+      }
+    }
+  }
+  /* the frames of the slower links are held up by a pause too, so the deadlines are put off by the pause */
+  void PauseJoins() {
+    std::lock_guard<std::mutex> lk(join_mtx_);
+    join_paused_ = true;
+    join_paused_at_ = std::chrono::steady_clock::now();
+  }
+  void ResumeJoins() {
+    {
+      std::lock_guard<std::mutex> lk(join_mtx_);
+      const auto paused = std::chrono::steady_clock::now() - join_paused_at_;
+      std::multimap<std::chrono::steady_clock::time_point, PendingJoin> pending_joins;
+      for (auto& it : pending_joins_) pending_joins.emplace(it.first + paused, it.second);
+      pending_joins_.swap(pending_joins);
+      join_paused_ = false;
+    }
+    join_cond_.notify_all();
+  }
+  /* with join_mtx_ held. nothing to do if the frame has been got from all input links meanwhile */
+  void ForwardJoin(const PendingJoin& pending) {
+    const RouteNode& node = route_table_[pending.node_idx];
+    if (!pending.data->frame.CloseModuleMask(node.module, node.join_mask)) return;
+    node.join_timeout_input->GetConveyor(pending.conveyor_idx)->PushDataBufferNoWait(pending.data);
+  }
+  /* the EOS has been got from all input links, the frames of its stream still waiting go on before it */
+  void ForwardJoinEOS(size_t node_idx, uint32_t conveyor_idx, const CNFrameInfoPtr& eos) {
+    std::lock_guard<std::mutex> lk(join_mtx_);
+    for (auto iter = pending_joins_.begin(); iter != pending_joins_.end();) {
+      if (node_idx == iter->second.node_idx && eos->channel_idx == iter->second.data->channel_idx) {
+        ForwardJoin(iter->second);
+        iter = pending_joins_.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+    route_table_[node_idx].join_timeout_input->GetConveyor(conveyor_idx)->PushDataBufferNoWait(eos);
+  }
+
+  /*
+    elastic parallelism, see Pipeline::SetModuleParallelismRange. the input link of an elastic module
+    dispatches to its first active queues only, the threads (or tasks) of the other queues sleep.
+   */
+  struct ElasticModule {
+    std::string name;
+    Connector* input = nullptr;
+    uint32_t min_parallelism = 1;
+    uint32_t max_parallelism = 1;
+    uint32_t up_samples = 0;    ///< samples in a row the queues were busy
+    uint32_t down_samples = 0;  ///< samples in a row the queues were idle
+    double last_busy_ms = 0;
+  };
+  static constexpr std::chrono::milliseconds kScaleInterval{100};
+  static constexpr uint32_t kScaleUpSamples = 3;
+  static constexpr uint32_t kScaleDownSamples = 10;
+  /* queued frames over the capacity of the queues in use */
+  static constexpr double kScaleUpOccupancy = 0.5;
+  static constexpr double kScaleDownOccupancy = 0.1;
+  /* one queue less while the others would still be busy less than this */
+  static constexpr double kScaleDownUtilization = 0.5;
+  void CompileElastic() {
+    elastic_.clear();
+    for (auto& it : modules_) {
+      ModuleAssociatedInfo& module_info = it.second;
+      RouteNode& node = route_table_[module_info.instance->GetId()];
+      for (Connector* connector : node.inputs) connector->SetElastic(false);
+      if (0 == module_info.max_parallelism || node.inputs.empty()) continue;
+      if (node.inputs.size() > 1) {
+        /* all input links of a join module have to send a stream to the same thread */
+        LOG(WARNING) << "[" << node.module->GetName() << "] has more than one input link, parallelism is fixed.";
+        continue;
+      }
+      ElasticModule elastic;
+      elastic.name = node.module->GetName();
+      elastic.input = node.inputs[0];
+      elastic.min_parallelism = module_info.min_parallelism;
+      elastic.max_parallelism = module_info.max_parallelism;
+      elastic.input->SetElastic(true);
+      elastic.input->SetActiveCount(
+          std::max(module_info.min_parallelism, std::min(module_info.parallelism, module_info.max_parallelism)));
+      LinkStatus status;
+      elastic.input->GetDispatchStatus(&status);
+      for (double busy_ms : status.busy_ms) elastic.last_busy_ms += busy_ms;
+      elastic_.push_back(elastic);
+    }
+  }
+  void StartAutoscaler() {
+    if (elastic_.empty()) return;
+    exit_autoscaler_ = false;
+    autoscaler_thread_ = std::thread(&PipelinePrivate::AutoscalerFunc, this);
+  }
+  void StopAutoscaler() {
+    {
+      std::lock_guard<std::mutex> lk(autoscaler_mtx_);
+      exit_autoscaler_ = true;
+    }
+    autoscaler_cond_.notify_all();
+    if (autoscaler_thread_.joinable()) autoscaler_thread_.join();
+  }
+  void AutoscalerFunc() {
+    std::unique_lock<std::mutex> lk(autoscaler_mtx_);
+    while (!autoscaler_cond_.wait_for(lk, kScaleInterval, [this] { return exit_autoscaler_; })) {
+      /* no load to sample while paused */
+      if (pause_gate_.IsClosed()) continue;
+      for (ElasticModule& elastic : elastic_) Autoscale(&elastic);
+    }
+  }
+  /*
+    scales up on queues which stay busy, down on queues which stay nearly empty while the threads have little
+    to do. the busy time of the link is used for the load, as it is counted by the threads themselves.
+   */
+  void Autoscale(ElasticModule* elastic) {
+    Connector* input = elastic->input;
+    const uint32_t active = input->GetActiveCount();
+    size_t queued = 0;
+    for (uint32_t i = 0; i < active; ++i) queued += input->GetConveyor(i)->GetBufferSize();
+    double occupancy = static_cast<double>(queued) / (active * std::max<size_t>(input->GetConveyorCapacity(), 1));
+    LinkStatus status;
+    input->GetDispatchStatus(&status);
+    double busy_ms = 0;
+    for (double it : status.busy_ms) busy_ms += it;
+    /* number of busy threads on average */
+    double utilization = (busy_ms - elastic->last_busy_ms) / kScaleInterval.count();
+    elastic->last_busy_ms = busy_ms;
+
+    uint32_t target = active;
+    if (occupancy >= kScaleUpOccupancy) {
+      elastic->down_samples = 0;
+      if (++elastic->up_samples >= kScaleUpSamples && active < elastic->max_parallelism) target = active + 1;
+    } else if (occupancy < kScaleDownOccupancy && utilization < kScaleDownUtilization * (active - 1)) {
+      elastic->up_samples = 0;
+      if (++elastic->down_samples >= kScaleDownSamples && active > elastic->min_parallelism) target = active - 1;
+    } else {
+      elastic->up_samples = 0;
+      elastic->down_samples = 0;
+    }
+    if (target == active) return;
+    elastic->up_samples = 0;
+    elastic->down_samples = 0;
+    input->SetActiveCount(target);
+    LOG(INFO) << "[" << elastic->name << "] parallelism " << active << " -> " << target << ", queue occupancy "
+              << occupancy << ", busy threads " << utilization;
+  }
+
+  /*
+    opens the modules on at most PipelineConfig::openThreadNum threads, the calling thread is one of them.
+    the modules are taken in the order of their ids and no more are taken once an Open failed. whatever order the
+    opens end in, the failures are logged in the order of the ids and the modules opened are closed in that order,
+    as Stop does.
+   */
+  bool OpenModules() {
+    std::vector<Module*> modules(modules_.size());
+    for (auto& it : modules_) modules[it.second.instance->GetId()] = it.second.instance.get();
+    uint32_t thread_num = config_.openThreadNum;
+    if (0 == thread_num) thread_num = std::thread::hardware_concurrency();
+    thread_num = std::max(1u, std::min(thread_num, static_cast<uint32_t>(modules.size())));
+    /* 0 not opened, 1 opened, -1 failed. each slot is written by a single thread */
+    std::vector<int> results(modules.size(), 0);
+    std::atomic<size_t> next_module{0};
+    std::atomic<bool> failed{false};
+    auto open_func = [&] {
+      while (!failed.load()) {
+        const size_t idx = next_module.fetch_add(1);
+        if (idx >= modules.size()) return;
+        if (modules[idx]->Open(q_ptr_->GetModuleParamSet(modules[idx]->GetName()))) {
+          results[idx] = 1;
+        } else {
+          results[idx] = -1;
+          failed.store(true);
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < thread_num; ++i) threads.emplace_back(open_func);
+    open_func();
+    for (std::thread& it : threads) it.join();
+    if (!failed.load()) return true;
+
+    for (size_t idx = 0; idx < modules.size(); ++idx) {
+      LOG_IF(ERROR, results[idx] < 0) << modules[idx]->GetName() << " start failed!";
+    }
+    for (size_t idx = 0; idx < modules.size(); ++idx) {
+      if (results[idx] > 0) modules[idx]->Close();
+    }
+    return false;
   }
-  void ClearEOSMask() { eos_mask_ = 0; }
 
   /*
     stream message
@@ -181,11 +993,8 @@ class PipelinePrivate {
     msgq_.Push(msg);
   }
   void StreamMsgHandleFunc() {
-    while (!exit_msg_loop_) {
-      StreamMsg msg;
-      while (!exit_msg_loop_ && !msgq_.WaitAndTryPop(msg, std::chrono::microseconds(200)))
-        ;
-      if (exit_msg_loop_) return;
+    StreamMsg msg;
+    while (msgq_.WaitAndPopUntilStop(msg)) {
       switch (msg.type) {
         case StreamMsgType::EOS_MSG:
         case StreamMsgType::ERROR_MSG:
@@ -211,9 +1020,99 @@ class PipelinePrivate {
 
   ThreadSafeQueue<StreamMsg> msgq_;
   std::thread smsg_thread_;
-  volatile bool exit_msg_loop_ = false;
+
+  std::vector<ElasticModule> elastic_;
+  std::thread autoscaler_thread_;
+  std::mutex autoscaler_mtx_;
+  std::condition_variable autoscaler_cond_;
+  bool exit_autoscaler_ = false;
+
+  /* whether any link has a route, see RoutePredicate */
+  bool has_routes_ = false;
+  /* by join module, see CompileJoins */
+  std::unordered_map<Module*, std::unique_ptr<Connector>> join_links_;
+  bool has_join_timeout_ = false;
+  std::multimap<std::chrono::steady_clock::time_point, PendingJoin> pending_joins_;
+  std::thread join_watcher_thread_;
+  std::mutex join_mtx_;
+  std::condition_variable join_cond_;
+  bool exit_join_watcher_ = false;
+  bool join_paused_ = false;
+  std::chrono::steady_clock::time_point join_paused_at_;
+
+  /*
+    a module which transmits data by itself may still hold a frame once Process returned, e.g. in a batch.
+    the input link is told the frame is done with when it is transmitted, so that the stream is not moved to
+    another data queue before, see StreamDispatcher.
+   */
+  struct PendingDone {
+    Connector* connector;
+    uint32_t conveyor_idx;
+    double cost_ms;
+    bool in_process;   ///< Process has not returned yet, the cost is not known
+    bool transmitted;  ///< transmitted while in process
+  };
+  using PendingDoneKey = std::pair<size_t, const CNFrameInfo*>;  ///< (node_idx, frame)
+  std::multimap<PendingDoneKey, PendingDone> pending_dones_;
+  std::mutex pending_done_mtx_;
+
+  void AddPendingDone(size_t node_idx, const CNFrameInfoPtr& data, Connector* connector, uint32_t conveyor_idx) {
+    std::lock_guard<std::mutex> lk(pending_done_mtx_);
+    pending_dones_.emplace(PendingDoneKey(node_idx, data.get()), PendingDone{connector, conveyor_idx, 0, true, false});
+  }
+  /* Process returned, reports the frame if it has been transmitted meanwhile */
+  void ProcessedPendingDone(size_t node_idx, const CNFrameInfoPtr& data, Connector* connector, double cost_ms) {
+    std::vector<PendingDone> dones;
+    {
+      std::lock_guard<std::mutex> lk(pending_done_mtx_);
+      auto range = pending_dones_.equal_range(PendingDoneKey(node_idx, data.get()));
+      for (auto it = range.first; it != range.second;) {
+        if (it->second.connector != connector || !it->second.in_process) {
+          ++it;
+          continue;
+        }
+        it->second.cost_ms = cost_ms;
+        it->second.in_process = false;
+        if (!it->second.transmitted) break;
+        dones.push_back(it->second);
+        it = pending_dones_.erase(it);
+        break;
+      }
+    }
+    for (auto& it : dones) it.connector->FrameDone(it.conveyor_idx, data, it.cost_ms);
+  }
+  /* the frame is done with by the module on all its input links, connector only for that one.
+     a frame transmitted while in process is reported once Process returns, see ProcessedPendingDone */
+  void ReportPendingDone(size_t node_idx, const CNFrameInfoPtr& data, Connector* connector = nullptr) {
+    std::vector<PendingDone> dones;
+    {
+      std::lock_guard<std::mutex> lk(pending_done_mtx_);
+      auto range = pending_dones_.equal_range(PendingDoneKey(node_idx, data.get()));
+      for (auto it = range.first; it != range.second;) {
+        if (connector && it->second.connector != connector) {
+          ++it;
+          continue;
+        }
+        if (it->second.in_process) {
+          it->second.transmitted = true;
+          ++it;
+          continue;
+        }
+        dones.push_back(it->second);
+        it = pending_dones_.erase(it);
+      }
+    }
+    for (auto& it : dones) it.connector->FrameDone(it.conveyor_idx, data, it.cost_ms);
+  }
+  /* the dispatchers are reset when the links stop */
+  void ClearPendingDones() {
+    std::lock_guard<std::mutex> lk(pending_done_mtx_);
+    pending_dones_.clear();
+  }
 };  // class PipelinePrivate
 
+constexpr std::chrono::milliseconds PipelinePrivate::kScaleInterval;
+
 Pipeline::Pipeline(const std::string& name) : Module(name) {
   d_ptr_ = new PipelinePrivate(this);
 
@@ -224,6 +1123,7 @@ Pipeline::Pipeline(const std::string& name) : Module(name) {
 
 Pipeline::~Pipeline() {
   running_ = false;
+  for (auto& it : d_ptr_->modules_) it.second.instance->SetId(INVALID_MODULE_ID);
   delete event_bus_;
   delete d_ptr_;
 }
@@ -270,11 +1170,13 @@ EventHandleFlag Pipeline::DefaultBusWatch(const Event& event, Module* module) {
 }
 
 bool Pipeline::ProvideData(const Module* module, std::shared_ptr<CNFrameInfo> data) {
-  int64_t hashcode = reinterpret_cast<int64_t>(module);
-
-  if (d_ptr_->modules_.find(hashcode) == d_ptr_->modules_.end()) return false;
+  const size_t node_idx = module->GetId();
+  if (node_idx >= d_ptr_->route_table_.size() || d_ptr_->route_table_[node_idx].module != module) return false;
 
-  TransmitData(hashcode, data);
+  data->frame.InitModuleMask(d_ptr_->route_table_.size());
+  if (d_ptr_->stamp_eos_ && d_ptr_->route_table_[node_idx].inputs.empty()) d_ptr_->StampFrameId(data.get());
+  d_ptr_->ReportPendingDone(node_idx, data);
+  TransmitData(node_idx, data);
 
   return true;
 }
@@ -288,11 +1190,13 @@ bool Pipeline::AddModule(std::shared_ptr<Module> module) {
   }
 
   LOG(INFO) << "Add Module " << module->GetName() << " to pipeline";
-  if (module->GetId() == Module::INVALID_MODULE_ID) {
-    LOG(ERROR) << "Failed to get module Id";
+  if (module->GetId() != INVALID_MODULE_ID) {
+    LOG(ERROR) << "Module [" << module->GetName() << "] has already been added to another pipeline";
     return false;
   }
 
+  /* dense index in this pipeline, see CNDataFrame::SetModuleMask */
+  module->SetId(d_ptr_->modules_.size());
   ModuleAssociatedInfo associated_info;
   associated_info.instance = module;
   associated_info.parallelism = 1;
@@ -315,8 +1219,67 @@ uint32_t Pipeline::GetModuleParallelism(std::shared_ptr<Module> module) {
   return d_ptr_->modules_[hashcode].parallelism;
 }
 
+bool Pipeline::SetModuleParallelismRange(std::shared_ptr<Module> module, uint32_t min_parallelism,
+                                         uint32_t max_parallelism) {
+  int64_t hashcode = reinterpret_cast<int64_t>(module.get());
+  if (d_ptr_->modules_.find(hashcode) == d_ptr_->modules_.end()) return false;
+  if (max_parallelism > 0 && (0 == min_parallelism || min_parallelism > max_parallelism)) {
+    LOG(ERROR) << "[" << module->GetName() << "] invalid parallelism range [" << min_parallelism << ", "
+               << max_parallelism << "]";
+    return false;
+  }
+  d_ptr_->modules_[hashcode].min_parallelism = min_parallelism;
+  d_ptr_->modules_[hashcode].max_parallelism = max_parallelism;
+  return true;
+}
+
+bool Pipeline::SetModulePlacement(std::shared_ptr<Module> module, const ModulePlacement& placement) {
+  int64_t hashcode = reinterpret_cast<int64_t>(module.get());
+  if (d_ptr_->modules_.find(hashcode) == d_ptr_->modules_.end()) return false;
+  ModulePlacement& dst = d_ptr_->modules_[hashcode].placement;
+  dst = placement;
+  std::sort(dst.cpus.begin(), dst.cpus.end());
+  dst.cpus.erase(std::unique(dst.cpus.begin(), dst.cpus.end()), dst.cpus.end());
+  return true;
+}
+
+bool Pipeline::QueryModulePlacement(std::shared_ptr<Module> module, ModulePlacement* placement) const {
+  int64_t hashcode = reinterpret_cast<int64_t>(module.get());
+  if (d_ptr_->modules_.find(hashcode) == d_ptr_->modules_.end() || !IsRunning()) return false;
+  const RouteNode& node = d_ptr_->route_table_[module->GetId()];
+  placement->cpus = SCHEDULER_WORKER_POOL == d_ptr_->config_.scheduler ? std::vector<int>() : node.cpus;
+  placement->numa_node = node.memory_node;
+  return true;
+}
+
+void Pipeline::ApplyModulePlacement(const Module* module) const {
+  if (!IsRunning() || module->GetId() >= d_ptr_->route_table_.size()) return;
+  d_ptr_->ApplyPlacement(module->GetId());
+}
+
+bool Pipeline::DisableModuleFusion(std::shared_ptr<Module> module, bool disable) {
+  int64_t hashcode = reinterpret_cast<int64_t>(module.get());
+  if (d_ptr_->modules_.find(hashcode) == d_ptr_->modules_.end()) return false;
+  d_ptr_->modules_[hashcode].fusion_disabled = disable;
+  return true;
+}
+
+bool Pipeline::SetModuleJoinTimeout(std::shared_ptr<Module> module, uint32_t timeout_ms) {
+  int64_t hashcode = reinterpret_cast<int64_t>(module.get());
+  if (d_ptr_->modules_.find(hashcode) == d_ptr_->modules_.end()) return false;
+  d_ptr_->modules_[hashcode].join_timeout_ms = timeout_ms;
+  return true;
+}
+
 std::string Pipeline::LinkModules(std::shared_ptr<Module> up_node, std::shared_ptr<Module> down_node,
                                   size_t queue_capacity) {
+  LinkConfig config;
+  config.queue_capacity = queue_capacity;
+  return LinkModules(up_node, down_node, config);
+}
+
+std::string Pipeline::LinkModules(std::shared_ptr<Module> up_node, std::shared_ptr<Module> down_node,
+                                  const LinkConfig& config) {
   int64_t up_node_hashcode = reinterpret_cast<int64_t>(up_node.get());
   int64_t down_node_hashcode = reinterpret_cast<int64_t>(down_node.get());
 
@@ -328,6 +1291,11 @@ std::string Pipeline::LinkModules(std::shared_ptr<Module> up_node, std::shared_p
 
   ModuleAssociatedInfo& up_node_info = d_ptr_->modules_.find(up_node_hashcode)->second;
   ModuleAssociatedInfo& down_node_info = d_ptr_->modules_.find(down_node_hashcode)->second;
+  /* one bit for each in the module masks of frames, see CNDataFrame::SetModuleMask */
+  if (down_node_info.input_connectors.size() >= 64) {
+    LOG(ERROR) << "module [" << down_node->GetName() << "] supports no more than 64 input links";
+    return "";
+  }
 
   std::string link_id = up_node->GetName() + "-->" + down_node->GetName();
   auto ret = up_node_info.down_nodes.insert(down_node_hashcode);
@@ -339,7 +1307,7 @@ std::string Pipeline::LinkModules(std::shared_ptr<Module> up_node, std::shared_p
   LOG(INFO) << "Link Module " << link_id;
 
   // create connector
-  std::shared_ptr<Connector> con = std::make_shared<Connector>(down_node_info.parallelism, queue_capacity);
+  std::shared_ptr<Connector> con = std::make_shared<Connector>(down_node_info.QueueNum(), config);
   up_node_info.output_connectors.push_back(link_id);
   down_node_info.input_connectors.push_back(link_id);
   d_ptr_->links_[link_id] = con;
@@ -359,8 +1327,14 @@ bool Pipeline::QueryLinkStatus(LinkStatus* status, const std::string& link_id) {
     return false;
   }
   status->stopped = con->IsStopped();
+  con->GetDispatchStatus(status);
+  con->GetDropStatus(status);
+  con->GetRouteStatus(status);
+  status->cache_size.clear();
+  status->spilled.clear();
   for (uint32_t i = 0; i < con->GetConveyorCount(); ++i) {
     status->cache_size.emplace_back(con->GetConveyor(i)->GetBufferSize());
+    status->spilled.emplace_back(con->GetConveyor(i)->GetSpilledSize());
   }
   return true;
 }
@@ -368,44 +1342,133 @@ bool Pipeline::QueryLinkStatus(LinkStatus* status, const std::string& link_id) {
 bool Pipeline::Start() {
   // set eos mask
   d_ptr_->SetEOSMask();
+  d_ptr_->CompileRouteTable();
   // open modules
-  std::vector<std::shared_ptr<Module>> opened_modules;
-  bool open_module_failed = false;
-  for (auto& it : d_ptr_->modules_) {
-    if (!it.second.instance->Open(GetModuleParamSet(it.second.instance->GetName()))) {
-      open_module_failed = true;
-      LOG(ERROR) << it.second.instance->GetName() << " start failed!";
-      break;
-    } else {
-      opened_modules.push_back(it.second.instance);
-    }
-  }
-
-  if (open_module_failed) {
-    for (auto it : opened_modules) it->Close();
+  if (!d_ptr_->OpenModules()) {
     d_ptr_->ClearEOSMask();
     return false;
   }
 
   // start data transmit
   running_ = true;
-  event_bus_->running_ = true;
+  event_bus_->Start();
   d_ptr_->event_thread_ = std::thread(&Pipeline::EventLoop, this);
 
+  const bool use_worker_pool = SCHEDULER_WORKER_POOL == d_ptr_->config_.scheduler;
+  d_ptr_->module_tasks_.clear();
+  if (use_worker_pool) {
+    d_ptr_->worker_pool_.reset(new WorkerPool(d_ptr_->config_.workerNum));
+  }
+
+  for (auto& it : d_ptr_->modules_) {
+    ModuleAssociatedInfo& module_info = it.second;
+    const size_t node_idx = module_info.instance->GetId();
+    RouteNode& node = d_ptr_->route_table_[node_idx];
+    /*
+      with the worker pool every data queue of a module is a task, queued when data is pushed.
+      otherwise a thread of a module with several input links sleeps on all of them at once, see TaskLoop.
+     */
+    module_info.waiters_.clear();
+    node.waiters.clear();
+    node.async_queues.clear();
+    if (module_info.instance->GetAsyncDepth() > 0 && !module_info.instance->hasTranmit()) {
+      for (uint32_t conveyor_idx = 0; conveyor_idx < module_info.QueueNum() && !node.inputs.empty();
+           ++conveyor_idx) {
+        CNTimer* timer = &node.timers[conveyor_idx];
+        Connector* input = node.inputs[0];
+        Module* module = node.module;
+        AsyncQueue::Forward forward = [this, node_idx, conveyor_idx, timer, input, module](
+                                          const CNFrameInfoPtr& data, int ret, double cost_ms) -> bool {
+          /* join modules always use modulo dispatch, which only counts busy time, so the first link will do */
+          input->FrameDone(conveyor_idx, data, cost_ms);
+          if (!(CN_FRAME_FLAG_EOS & data->frame.flags)) timer->Dot(cost_ms, 1);
+          if (ret < 0) {
+            ReportProcessError(module, data, ret);
+            return false;
+          }
+          return TransmitData(node_idx, data);
+        };
+        node.async_queues.push_back(std::make_shared<AsyncQueue>(module_info.instance->GetAsyncDepth(), forward));
+      }
+    }
+    const uint32_t batch_size = BatchSize(node);
+    for (uint32_t conveyor_idx = 0; conveyor_idx < module_info.QueueNum() && !node.inputs.empty() && !node.fused;
+         ++conveyor_idx) {
+      ConveyorNotifier* notifier = nullptr;
+      if (use_worker_pool) {
+        d_ptr_->module_tasks_.emplace_back(new ModuleTask(
+            d_ptr_->worker_pool_.get(), &d_ptr_->pause_gate_, node.inputs, conveyor_idx,
+            std::bind(&Pipeline::ProcessData, this, node_idx, conveyor_idx, std::placeholders::_1,
+                      std::placeholders::_2)));
+        if (!node.async_queues.empty()) {
+          d_ptr_->module_tasks_.back()->SetAsync(node.async_queues[conveyor_idx].get());
+        }
+        if (batch_size > 1) {
+          d_ptr_->module_tasks_.back()->SetBatch(
+              batch_size, std::bind(&Pipeline::ProcessDataBatch, this, node_idx, conveyor_idx, std::placeholders::_1));
+        }
+        notifier = d_ptr_->module_tasks_.back().get();
+      } else if (node.inputs.size() > 1) {
+        module_info.waiters_.push_back(std::make_shared<ConveyorWaiter>());
+        node.waiters.push_back(module_info.waiters_.back().get());
+        notifier = module_info.waiters_.back().get();
+      }
+      for (Connector* connector : node.inputs) {
+        connector->SetConveyorNotifier(conveyor_idx, notifier);
+      }
+    }
+    /*
+      only the single pipeline thread of a module pushes to its output links, unless the module
+      transmits data by itself or is a source (no input link) which is fed by any thread.
+      worker pool tasks of one data queue run on any worker, but never at the same time.
+     */
+    bool single_producer = 1 == module_info.QueueNum() && !module_info.instance->hasTranmit() &&
+                           !node.inputs.empty();
+    for (Connector* connector : node.outputs) {
+      connector->SetSingleProducer(single_producer);
+    }
+  }
   for (std::pair<std::string, std::shared_ptr<Connector>> connector : d_ptr_->links_) {
     connector.second->Start();
   }
+  for (auto& it : d_ptr_->join_links_) it.second->Start();
+  d_ptr_->StartJoinWatcher();
+  d_ptr_->StartAutoscaler();
+  d_ptr_->ReportPlacement(use_worker_pool);
+
+  auto warm_start = std::chrono::steady_clock::now();
+  if (use_worker_pool) {
+    d_ptr_->worker_pool_->Start(std::bind(&PipelinePrivate::WarmUpWorker, d_ptr_));
+    LOG(INFO) << "Pipeline warm in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - warm_start).count()
+              << " ms";
+    /* data left in the queues by the last run */
+    for (auto& task : d_ptr_->module_tasks_) task->Notify();
+    LOG(INFO) << "Pipeline Start";
+    LOG(INFO) << "Total module tasks :" << d_ptr_->module_tasks_.size() << ", workers :"
+              << d_ptr_->worker_pool_->GetWorkerNum();
+    return true;
+  }
 
   // create process threads
+  size_t cold_threads = 0;
+  for (auto& it : d_ptr_->modules_) {
+    const RouteNode& node = d_ptr_->route_table_[it.second.instance->GetId()];
+    if (!node.fused && !node.inputs.empty()) cold_threads += it.second.QueueNum();
+  }
+  d_ptr_->SetColdThreads(cold_threads);
   for (auto& it : d_ptr_->modules_) {
-    const int64_t node_hashcode = it.first;
     ModuleAssociatedInfo& module_info = it.second;
-    uint32_t parallelism = module_info.parallelism;
-    module_info.timers_.resize(parallelism);
-    for (uint32_t conveyor_idx = 0; conveyor_idx < parallelism; ++conveyor_idx) {
-      d_ptr_->threads_.push_back(std::thread(&Pipeline::TaskLoop, this, node_hashcode, conveyor_idx));
+    if (d_ptr_->route_table_[module_info.instance->GetId()].fused) continue;
+    for (uint32_t conveyor_idx = 0; conveyor_idx < module_info.QueueNum(); ++conveyor_idx) {
+      d_ptr_->threads_.push_back(
+          std::thread(&Pipeline::TaskLoop, this, module_info.instance->GetId(), conveyor_idx));
     }
   }
+  d_ptr_->WaitWarm();
+  LOG(INFO) << "Pipeline warm in "
+            << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - warm_start).count()
+            << " ms";
   LOG(INFO) << "Pipeline Start";
   LOG(INFO) << "Total Module's threads :" << d_ptr_->threads_.size();
   return true;
@@ -415,16 +1478,28 @@ bool Pipeline::Stop() {
   std::lock_guard<std::mutex> lk(d_ptr_->stop_mtx_);
   if (!IsRunning()) return true;
 
+  d_ptr_->StopJoinWatcher();
+  d_ptr_->StopAutoscaler();
   // stop data transmit
   for (std::pair<std::string, std::shared_ptr<Connector>> connector : d_ptr_->links_) {
     connector.second->Stop();
   }
+  for (auto& it : d_ptr_->join_links_) it.second->Stop();
+  for (auto& node : d_ptr_->route_table_) {
+    for (auto& async_queue : node.async_queues) async_queue->Wakeup();
+  }
   running_ = false;
-  event_bus_->running_ = false;
+  event_bus_->Stop();
+  /* threads held up by a pause go on to see the links stopped */
+  if (d_ptr_->pause_gate_.IsClosed()) {
+    d_ptr_->ResumeJoins();
+    d_ptr_->pause_gate_.Open();
+  }
   for (std::thread& it : d_ptr_->threads_) {
     if (it.joinable()) it.join();
   }
   d_ptr_->threads_.clear();
+  if (d_ptr_->worker_pool_) d_ptr_->worker_pool_->Stop();
   if (d_ptr_->event_thread_.joinable()) {
     d_ptr_->event_thread_.join();
   }
@@ -434,10 +1509,31 @@ bool Pipeline::Stop() {
   }
 
   d_ptr_->ClearEOSMask();
+  d_ptr_->ClearPendingDones();
   LOG(INFO) << "Pipeline Stop";
   return true;
 }
 
+bool Pipeline::Pause() {
+  std::lock_guard<std::mutex> lk(d_ptr_->stop_mtx_);
+  if (!IsRunning() || d_ptr_->pause_gate_.IsClosed()) return false;
+  d_ptr_->PauseJoins();
+  d_ptr_->pause_gate_.Close();
+  LOG(INFO) << "Pipeline Pause";
+  return true;
+}
+
+bool Pipeline::Resume() {
+  std::lock_guard<std::mutex> lk(d_ptr_->stop_mtx_);
+  if (!IsRunning() || !d_ptr_->pause_gate_.IsClosed()) return false;
+  d_ptr_->ResumeJoins();
+  d_ptr_->pause_gate_.Open();
+  LOG(INFO) << "Pipeline Resume";
+  return true;
+}
+
+bool Pipeline::IsPaused() const { return d_ptr_->pause_gate_.IsClosed(); }
+
 EventBus* Pipeline::GetEventBus() const { return event_bus_; }
 
 void Pipeline::EventLoop() {
@@ -480,13 +1576,20 @@ void Pipeline::PrintPerformanceInformation() const {
     for (size_t i = 0; i < fps_calculators.size(); ++i) {
       fps_calculators[i].PrintFps("thread " + std::to_string(i) + ": ");
     }
+    if (module_info.instance->GetSkippedFrameNum() > 0) {
+      printf("stale frames skipped: %s\n", std::to_string(module_info.instance->GetSkippedFrameNum()).c_str());
+    }
+    if (module_info.instance->GetPartialFrameNum() > 0) {
+      printf("partial frames: %s, late frames released: %s\n",
+             std::to_string(module_info.instance->GetPartialFrameNum()).c_str(),
+             std::to_string(module_info.instance->GetLateFrameNum()).c_str());
+    }
   }
 }
 
-void Pipeline::TransmitData(int64_t node_hashcode, std::shared_ptr<CNFrameInfo> data) {
-  LOG_IF(FATAL, d_ptr_->modules_.find(node_hashcode) == d_ptr_->modules_.end());
-
-  const ModuleAssociatedInfo& module_info = d_ptr_->modules_[node_hashcode];
+bool Pipeline::TransmitData(size_t node_idx, std::shared_ptr<CNFrameInfo> data) {
+  const RouteNode& node = d_ptr_->route_table_[node_idx];
+  Module* module = node.module;
 
   const uint32_t chn_idx = data->channel_idx;
 
@@ -494,16 +1597,15 @@ void Pipeline::TransmitData(int64_t node_hashcode, std::shared_ptr<CNFrameInfo>
     eos
    */
   if (data->frame.flags & CN_FRAME_FLAG_EOS) {
-    LOG(INFO) << "[" << module_info.instance->GetName() << "]"
+    LOG(INFO) << "[" << module->GetName() << "]"
               << " Channel " << data->channel_idx << " got eos.";
     Event e;
     e.type = EventType::EVENT_EOS;
-    e.module = module_info.instance.get();
-    e.message = module_info.instance->GetName() + " received eos from channel " + std::to_string(chn_idx);
+    e.module = module;
+    e.message = module->GetName() + " received eos from channel " + std::to_string(chn_idx);
     e.thread_id = std::this_thread::get_id();
     event_bus_->PostEvent(e);
-    const uint64_t eos_mask = data->frame.AddEOSMask(module_info.instance.get());
-    if (eos_mask == d_ptr_->eos_mask_) {
+    if (data->frame.AddEOSMask(module) == d_ptr_->eos_module_num_) {
       StreamMsg msg;
       msg.type = StreamMsgType::EOS_MSG;
       msg.chn_idx = chn_idx;
@@ -512,103 +1614,320 @@ void Pipeline::TransmitData(int64_t node_hashcode, std::shared_ptr<CNFrameInfo>
     }
   }
 
-  /*
-    set module mask
-   */
-  for (auto& down_node_hashcode : module_info.down_nodes) {
-    ModuleAssociatedInfo& down_node_info = d_ptr_->modules_.find(down_node_hashcode)->second;
-    data->frame.SetModuleMask(down_node_info.instance.get(), module_info.instance.get());
+  /* see RoutePredicate */
+  const bool has_routes = d_ptr_->has_routes_;
+  const bool pass_on = has_routes && data->frame.IsModuleMaskPassedOn(module);
+  if (pass_on) data->frame.ClearModuleMask(module);
+
+  if (node.fuse_next) {
+    if (has_routes && !d_ptr_->RouteOutput(node, 0, data, pass_on)) return true;
+    /* the next module runs right here, with the data queue it would have popped the frame from */
+    int conveyor_idx = node.outputs[0]->DispatchConveyor(data);
+    return ProcessData(node.next_idx, conveyor_idx, 0, data);
   }
 
   // broadcast
-  const std::vector<std::string>& connector_ids = module_info.output_connectors;
-  for (auto& id : connector_ids) {
-    std::shared_ptr<Connector>& connector = d_ptr_->links_[id];
-    int conveyor_idx = chn_idx % connector->GetConveyorCount();
-    connector->PushDataBufferToConveyor(conveyor_idx, data);
+  ModuleTask* task = ModuleTask::Current();
+  for (size_t i = 0; i < node.outputs.size(); ++i) {
+    if (has_routes && !d_ptr_->RouteOutput(node, i, data, pass_on)) continue;
+    Connector* connector = node.outputs[i];
+    auto push = [connector, task](const std::shared_ptr<CNFrameInfo>& data) {
+      int conveyor_idx = connector->DispatchConveyor(data);
+      /* held back while its stream moves to another data queue, see Pipeline::SetModuleParallelismRange */
+      if (conveyor_idx < 0) return;
+      if (nullptr == task) {
+        /* may block until the next module pops, which is held up while the pipeline is paused */
+        PauseGate::Unguard pause_unguard;
+        connector->PushDataBufferToConveyor(conveyor_idx, data);
+      } else {
+        /* worker pool, see ModuleTask */
+        Conveyor* conveyor = connector->GetConveyor(conveyor_idx);
+        if (!conveyor->PushDataBufferNoWait(data)) task->AddFullConveyor(conveyor);
+      }
+    };
+    if (node.reorders[i]) {
+      node.reorders[i]->Push(data, push);
+    } else {
+      push(data);
+    }
   }
+  return true;
 }
 
-void Pipeline::TaskLoop(int64_t node_hashcode, uint32_t conveyor_idx) {
-  LOG_IF(FATAL, d_ptr_->modules_.find(node_hashcode) == d_ptr_->modules_.end());
-
-  ModuleAssociatedInfo& module_info = d_ptr_->modules_[node_hashcode];
-
-  LOG_IF(FATAL, conveyor_idx >= module_info.timers_.size());
-  CNTimer& timer = module_info.timers_[conveyor_idx];
+/*
+  Pops from whichever input link has data, input_idx is set to the index of that link. Links are served round-robin, starting after the one
+  served last time, so a busy link can not starve the others. Sleeps until any link has data and
+  returns nullptr once all of them stopped.
+ */
+static CNFrameInfoPtr PopDataFromAnyConnector(const std::vector<Connector*>& connectors,
+                                              uint32_t conveyor_idx, ConveyorWaiter* waiter,
+                                              size_t* next_input, size_t* input_idx) {
+  const size_t count = connectors.size();
+  while (true) {
+    uint64_t key = waiter->PrepareWait();
+    bool all_stopped = true;
+    for (size_t i = 0; i < count; ++i) {
+      *input_idx = (*next_input + i) % count;
+      CNFrameInfoPtr data = connectors[*input_idx]->TryPopDataBufferFromConveyor(conveyor_idx);
+      if (nullptr != data.get()) {
+        waiter->CancelWait();
+        *next_input = (*input_idx + 1) % count;
+        return data;
+      }
+      if (!connectors[*input_idx]->IsStopped()) all_stopped = false;
+    }
+    if (all_stopped) {
+      waiter->CancelWait();
+      return nullptr;
+    }
+    waiter->CommitWait(key);
+  }
+}
 
-  std::vector<std::shared_ptr<Connector>> input_connectors;
-  std::transform(module_info.input_connectors.begin(), module_info.input_connectors.end(),
-                 std::back_inserter(input_connectors),
-                 [&](std::string idx) -> std::shared_ptr<Connector> { return d_ptr_->links_[idx]; });
+void Pipeline::TaskLoop(size_t node_idx, uint32_t conveyor_idx) {
+  const RouteNode& node = d_ptr_->route_table_[node_idx];
+  const std::vector<Connector*>& input_connectors = node.inputs;
 
   if (input_connectors.size() == 0) return;
+  d_ptr_->ApplyPlacement(node_idx);
+  d_ptr_->WarmUp(node_idx);
+  d_ptr_->ThreadWarm();
+
+  ConveyorWaiter* waiter = nullptr;
+  if (input_connectors.size() > 1) {
+    LOG_IF(FATAL, conveyor_idx >= node.waiters.size());
+    waiter = node.waiters[conveyor_idx];
+  }
+  size_t next_input = 0;
+
+  const uint32_t batch_size = BatchSize(node);
+  if (batch_size > 1) {
+    const uint32_t timeout_us = node.module->GetBatchTimeout();
+    while (true) {
+      std::vector<std::shared_ptr<CNFrameInfo>> data =
+          input_connectors[0]->PopDataBufferBatchFromConveyor(conveyor_idx, batch_size, timeout_us);
+      /* empty when the connector stops */
+      if (data.empty()) break;
+      PauseGate::Guard pause_guard(&d_ptr_->pause_gate_);
+      if (!ProcessDataBatch(node_idx, conveyor_idx, &data)) return;
+    }
+    return;
+  }
 
-  volatile bool has_data = true;
-  while (has_data) {
-    has_data = false;
+  AsyncQueue* async_queue = node.async_queues.empty() ? nullptr : node.async_queues[conveyor_idx].get();
+  while (true) {
+    /* wait for a frame in flight to be done */
+    if (async_queue && !async_queue->WaitForSlot()) break;
     std::shared_ptr<CNFrameInfo> data;
-    // sync data
-    for (std::shared_ptr<Connector> connector : input_connectors) {
-      data = connector->PopDataBufferFromConveyor(conveyor_idx);
-      if (nullptr == data.get()) {
-        /*
-          nullptr will be received when connector stops.
-          maybe only part of the connectors stopped.
-         */
-        continue;
-      }
+    size_t input_idx = 0;
+    if (nullptr == waiter) {
+      data = input_connectors[0]->PopDataBufferFromConveyor(conveyor_idx);
+    } else {
+      data = PopDataFromAnyConnector(input_connectors, conveyor_idx, waiter, &next_input, &input_idx);
+    }
+    if (nullptr == data.get()) {
+      /*
+        nullptr will be received when the connectors stop.
+       */
+      break;
+    }
+    PauseGate::Guard pause_guard(&d_ptr_->pause_gate_);
+    if (!ProcessData(node_idx, conveyor_idx, input_idx, data)) return;
+  }  // while
+}
 
-      has_data = true;
+/* counts the skip */
+static bool IsSkipped(Module* module, const std::shared_ptr<CNFrameInfo>& data) {
+  if (!module->IsStaleFrameSkippable() || module->hasTranmit() || !data->IsStale()) return false;
+  module->AddSkippedFrame();
+  return true;
+}
 
-      if (data->frame.GetModulesMask(module_info.instance.get()) == module_info.instance->GetModulesMask()) {
-        data->frame.ClearModuleMask(module_info.instance.get());
-        int flags = data->frame.flags;
+bool Pipeline::ProcessData(size_t node_idx, uint32_t conveyor_idx, size_t input_idx,
+                           std::shared_ptr<CNFrameInfo> data) {
+  const RouteNode& node = d_ptr_->route_table_[node_idx];
+  Module* module = node.module;
+  CNTimer& timer = node.timers[conveyor_idx];
+
+  /* tell the input link when the frame is done with, whatever way this function returns */
+  struct DoneNotifier {
+    Connector* connector;
+    uint32_t conveyor_idx;
+    const std::shared_ptr<CNFrameInfo>& data;
+    double cost_ms;
+    ~DoneNotifier() {
+      if (connector) connector->FrameDone(conveyor_idx, data, cost_ms);
+    }
+  } done_notifier = {node.inputs[input_idx], conveyor_idx, data, 0};
 
-        if (!module_info.instance->hasTranmit() && (CN_FRAME_FLAG_EOS & flags)) {
-          /*normal module, transmit EOS by the framework*/
-          TransmitData(node_hashcode, data);
-          continue;
+  /*
+    a module with several input links processes a frame once it has been popped from all of them.
+    each link keeps the frames in order, so frames are processed in order too.
+    with a join timeout, a frame may go on with some of them, see Pipeline::SetModuleJoinTimeout.
+   */
+  if (node.inputs.size() > 1) {
+    const bool eos = CN_FRAME_FLAG_EOS & data->frame.flags;
+    if (node.join_timeout_input == node.inputs[input_idx]) {
+      /* forwarded at its deadline, or before an EOS */
+      if (!eos) {
+        data->frame.flags |= CN_FRAME_FLAG_PARTIAL;
+        module->AddPartialFrame();
+      }
+    } else {
+      const uint64_t bit = (uint64_t)1 << input_idx;
+      const uint64_t mask = data->frame.SetModuleMask(module, input_idx);
+      if (mask != node.join_mask) {
+        if (data->frame.IsModuleMaskJoined(module)) {
+          /* went on without this link */
+          module->AddLateFrame();
+        } else if (node.join_timeout_ms && !eos && !data->frame.ModuleMaskGot(module, mask & ~bit)) {
+          /* the deadline is counted from the first link the frame is got from */
+          d_ptr_->WaitJoin(node_idx, conveyor_idx, data);
         }
+        return true;
+      }
+      if (!data->frame.CompleteModuleMask(module)) {
+        /* went on without this link */
+        module->AddLateFrame();
+        return true;
+      }
+      /* kept for TransmitData if the frame is only passed on, see RoutePredicate */
+      if (data->frame.ModuleMaskGot(module, mask)) data->frame.ClearModuleMask(module);
+      if (node.join_timeout_ms && eos) {
+        d_ptr_->ForwardJoinEOS(node_idx, conveyor_idx, data);
+        return true;
+      }
+    }
+  }
+  int flags = data->frame.flags;
+  /* see RoutePredicate, modules which transmit data by themselves never get these frames either */
+  const bool passed_on = d_ptr_->has_routes_ && data->frame.IsModuleMaskPassedOn(module);
+  /* too late to be worth processing, see Module::SetStaleFrameSkippable */
+  const bool skip = passed_on || IsSkipped(module, data);
+
+  if (!node.async_queues.empty()) {
+    /* reported to the input link when forwarded, see AsyncQueue */
+    done_notifier.connector = nullptr;
+    AsyncQueue* async_queue = node.async_queues[conveyor_idx].get();
+    if (async_queue->Failed()) return false;
+    if ((CN_FRAME_FLAG_EOS & flags) || skip) {
+      async_queue->Push(data, false);
+    } else {
+      FrameMemoryOwner memory_owner(module);
+      module->ProcessAsync(data, async_queue->Push(data, true));
+    }
+    return !async_queue->Failed();
+  }
 
-        {
-          auto start_time = std::chrono::high_resolution_clock::now();
-          int ret = module_info.instance->Process(data);
-          auto end_time = std::chrono::high_resolution_clock::now();
-          std::chrono::duration<double, std::milli> diff = end_time - start_time;
-          timer.Dot(diff.count(), 1);
+  if ((!module->hasTranmit() && ((CN_FRAME_FLAG_EOS & flags) || skip)) || passed_on) {
+    /*normal module, transmit EOS and skipped frames by the framework*/
+    return TransmitData(node_idx, data);
+  }
 
-          /*process failed*/
-          if (ret < 0) {
-            Event e;
-            e.type = EventType::EVENT_ERROR;
-            e.module = module_info.instance.get();
-            e.message = module_info.instance->GetName() + " process failed, return number: " + std::to_string(ret);
-            e.thread_id = std::this_thread::get_id();
-            event_bus_->PostEvent(e);
-            StreamMsg msg;
-            msg.type = StreamMsgType::ERROR_MSG;
-            msg.chn_idx = data->channel_idx;
-            msg.stream_id = data->frame.stream_id;
-            d_ptr_->UpdateByStreamMsg(msg);
-            return;
-          } else if (ret > 0) {
-            // data has been transmitted by the module itself
-            if (!module_info.instance->hasTranmit()) {
-              LOG(ERROR) << "Module::Process() should not return 1\n";
-              return;
-            }
-            continue;
-          }
-        }
-        TransmitData(node_hashcode, data);
-      }  // if
-      else {
-        // LOG(INFO) << std::hex << data->frame.GetModulesMask(module_info.instance.get()) << " : " <<
-        // module_info.instance->GetModulesMask();
-      }
-    }  // for
-  }    // while
+  /* a module transmitting data by itself is done with the frame when it transmits it, see ProvideData */
+  Connector* input = node.inputs.empty() ? nullptr : node.inputs[input_idx];
+  const bool defer_done = module->hasTranmit() && input;
+  if (defer_done) {
+    d_ptr_->AddPendingDone(node_idx, data, input, conveyor_idx);
+    done_notifier.connector = nullptr;
+  }
+
+  /* frame memory the module allocates is charged to it, see GetModuleFrameMemoryUsage */
+  FrameMemoryOwner memory_owner(module);
+  auto start_time = std::chrono::high_resolution_clock::now();
+  int ret = module->Process(data);
+  auto end_time = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> diff = end_time - start_time;
+  timer.Dot(diff.count(), 1);
+  done_notifier.cost_ms = diff.count();
+  if (defer_done) d_ptr_->ProcessedPendingDone(node_idx, data, input, diff.count());
+
+  /*process failed*/
+  if (ret < 0) {
+    if (defer_done) d_ptr_->ReportPendingDone(node_idx, data, input);
+    ReportProcessError(module, data, ret);
+    return false;
+  } else if (ret > 0) {
+    // data has been transmitted by the module itself
+    if (!module->hasTranmit()) {
+      LOG(ERROR) << "Module::Process() should not return 1\n";
+      return false;
+    }
+    return true;
+  }
+  if (defer_done) d_ptr_->ReportPendingDone(node_idx, data, input);
+  return TransmitData(node_idx, data);
+}
+
+bool Pipeline::ProcessDataBatch(size_t node_idx, uint32_t conveyor_idx, std::vector<std::shared_ptr<CNFrameInfo>>* data) {
+  const RouteNode& node = d_ptr_->route_table_[node_idx];
+  Module* module = node.module;
+  CNTimer& timer = node.timers[conveyor_idx];
+  Connector* connector = node.inputs[0];
+  /* a fused module which processes batches too gets the whole batch */
+  const bool fuse_batch = node.fuse_next && BatchSize(d_ptr_->route_table_[node.next_idx]) > 1;
+
+  std::vector<std::shared_ptr<CNFrameInfo>> batch;
+  auto transmit = [&](std::vector<std::shared_ptr<CNFrameInfo>>* frames) -> bool {
+    if (fuse_batch) {
+      for (auto& it : *frames) node.outputs[0]->DispatchConveyor(it);
+      return ProcessDataBatch(node.next_idx, conveyor_idx, frames);
+    }
+    for (auto& it : *frames) {
+      if (!TransmitData(node_idx, it)) return false;
+    }
+    return true;
+  };
+  auto process_batch = [&]() -> bool {
+    if (batch.empty()) return true;
+    std::vector<std::shared_ptr<CNFrameInfo>> processed = batch;
+    FrameMemoryOwner memory_owner(module);
+    auto start_time = std::chrono::high_resolution_clock::now();
+    int ret = module->ProcessBatch(processed);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> diff = end_time - start_time;
+    timer.Dot(diff.count(), batch.size());
+    for (auto& it : batch) connector->FrameDone(conveyor_idx, it, diff.count() / batch.size());
+    if (ret < 0) {
+      size_t processed_num = std::min(processed.size(), batch.size() - 1);
+      std::vector<std::shared_ptr<CNFrameInfo>> done(batch.begin(), batch.begin() + processed_num);
+      transmit(&done);
+      ReportProcessError(module, batch[processed_num], ret);
+      return false;
+    }
+    if (!transmit(&batch)) return false;
+    batch.clear();
+    return true;
+  };
+
+  /* EOS, stale frames and frames passed on are transmitted by the framework after the frames before them */
+  const bool has_routes = d_ptr_->has_routes_;
+  for (auto& it : *data) {
+    if ((CN_FRAME_FLAG_EOS & it->frame.flags) || (module->IsStaleFrameSkippable() && it->IsStale()) ||
+        (has_routes && it->frame.IsModuleMaskPassedOn(module))) {
+      if (!process_batch()) return false;
+      if (!ProcessData(node_idx, conveyor_idx, 0, it)) return false;
+    } else {
+      batch.push_back(it);
+      /* batches handed over by a fused module may be larger */
+      if (batch.size() >= module->GetBatchSize() && !process_batch()) return false;
+    }
+  }
+  return process_batch();
+}
+
+void Pipeline::ReportProcessError(Module* module, const std::shared_ptr<CNFrameInfo>& data, int ret) {
+  Event e;
+  e.type = EventType::EVENT_ERROR;
+  e.module = module;
+  e.message = module->GetName() + " process failed, return number: " + std::to_string(ret);
+  e.thread_id = std::this_thread::get_id();
+  event_bus_->PostEvent(e);
+  StreamMsg msg;
+  msg.type = StreamMsgType::ERROR_MSG;
+  msg.chn_idx = data->channel_idx;
+  msg.stream_id = data->frame.stream_id;
+  d_ptr_->UpdateByStreamMsg(msg);
 }
 
 /* ------config/auto-graph methods------ */
@@ -645,19 +1964,31 @@ CNModuleConfig Pipeline::GetModuleConfig(const std::string& module_name) {
 int Pipeline::BuildPipeline(const std::vector<CNModuleConfig>& configs) {
   /*TODO,check configs*/
   ModuleCreatorWorker creator;
-  std::map<std::string, int> queues_size;
+  std::map<std::string, LinkConfig> link_configs;
   for (auto& v : configs) {
     this->AddModuleConfig(v);
     Module* module = creator.Create(v.className, v.name);
     std::shared_ptr<Module> instance(module);
     d_ptr_->modules_map_[v.name] = instance;
-    queues_size[v.name] = v.maxInputQueueSize;
+    link_configs[v.name].queue_capacity = v.maxInputQueueSize;
+    link_configs[v.name].queue_impl = v.queueImpl;
+    link_configs[v.name].dispatch_policy = v.dispatchPolicy;
+    link_configs[v.name].drop_policy = v.dropPolicy;
+    link_configs[v.name].drop_low_watermark = v.dropLowWatermark;
+    link_configs[v.name].route = v.route;
+    link_configs[v.name].spill_dir = v.spillDir;
     this->AddModule(instance);
     this->SetModuleParallelism(instance, v.parallelism);
+    this->DisableModuleFusion(instance, v.disableFusion);
+    this->SetModulePlacement(instance, v.placement);
+    this->SetModuleJoinTimeout(instance, v.joinTimeoutMs);
+    if (v.maxParallelism > 0) {
+      this->SetModuleParallelismRange(instance, std::max(v.minParallelism, 1), v.maxParallelism);
+    }
   }
   for (auto& v : d_ptr_->connections_config_) {
     for (auto& name : v.second) {
-      if (this->LinkModules(d_ptr_->modules_map_[v.first], d_ptr_->modules_map_[name], queues_size[name]).empty()) {
+      if (this->LinkModules(d_ptr_->modules_map_[v.first], d_ptr_->modules_map_[name], link_configs[name]).empty()) {
         LOG(ERROR) << "Link [" << v.first << "] with [" << name << "] failed.";
         return -1;
       }
@@ -684,6 +2015,19 @@ int Pipeline::BuildPipelineByJSONFile(const std::string& config_file) {
   }
 
   for (rapidjson::Document::ConstMemberIterator iter = doc.MemberBegin(); iter != doc.MemberEnd(); ++iter) {
+    if (std::string(iter->name.GetString()) == "pipeline_config") {
+      PipelineConfig pconf;
+      try {
+        rapidjson::StringBuffer sbuf;
+        rapidjson::Writer<rapidjson::StringBuffer> jwriter(sbuf);
+        iter->value.Accept(jwriter);
+        pconf.ParseByJSONStr(std::string(sbuf.GetString()));
+      } catch (std::string e) {
+        throw "Parse pipeline config failed. Error message: " + e;
+      }
+      SetPipelineConfig(pconf);
+      continue;
+    }
     CNModuleConfig mconf;
     mconf.name = iter->name.GetString();
     try {
@@ -700,6 +2044,10 @@ int Pipeline::BuildPipelineByJSONFile(const std::string& config_file) {
   return BuildPipeline(mconfs);
 }
 
+void Pipeline::SetPipelineConfig(const PipelineConfig& config) { d_ptr_->config_ = config; }
+
+PipelineConfig Pipeline::GetPipelineConfig() const { return d_ptr_->config_; }
+
 Module* Pipeline::GetModule(const std::string& moduleName) {
   auto iter = d_ptr_->modules_map_.find(moduleName);
   if (iter != d_ptr_->modules_map_.end()) {
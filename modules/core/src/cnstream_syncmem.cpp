@@ -29,14 +29,54 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <cnrt.h>
 #include <glog/logging.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
 
 #include "cnstream_common.hpp"
 #include "cnstream_syncmem.hpp"
 
 namespace cnstream {
 
+/* see CNStreamSetHostMemoryNode */
+static thread_local int host_memory_node = -1;
+
+void CNStreamSetHostMemoryNode(int numa_node) { host_memory_node = numa_node; }
+
+int CNStreamGetHostMemoryNode() { return host_memory_node; }
+
+/*
+  whole pages preferably taken from numa_node, when first touched. nullptr if the memory policy could not be
+  set, the pages are then placed on the node of the thread which touches them first.
+ */
+static void* MallocOnNode(size_t size, int numa_node) {
+  /* from linux/mempolicy.h, there is no dependency on libnuma */
+  const int kMpolPreferred = 1;
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t bytes = (size + page_size - 1) / page_size * page_size;
+  void* ptr = nullptr;
+  if (0 != posix_memalign(&ptr, page_size, bytes)) return nullptr;
+  const size_t bits = 8 * sizeof(unsigned long);  // NOLINT
+  std::vector<unsigned long> node_mask(numa_node / bits + 1, 0);  // NOLINT
+  node_mask[numa_node / bits] = 1UL << (numa_node % bits);
+  if (0 != syscall(SYS_mbind, ptr, bytes, kMpolPreferred, node_mask.data(), node_mask.size() * bits + 1, 0)) {
+    LOG(WARNING) << "Bind host memory to NUMA node " << numa_node << " failed, errno: " << errno
+                 << ". Not tried again on this thread.";
+    free(ptr);
+    return nullptr;
+  }
+  return ptr;
+}
+
 void CNStreamMallocHost(void** ptr, size_t size) {
-  void* __ptr = malloc(size);
+  void* __ptr = nullptr;
+  if (host_memory_node >= 0 && size > 0) {
+    __ptr = MallocOnNode(size, host_memory_node);
+    if (nullptr == __ptr) host_memory_node = -1;
+  }
+  if (nullptr == __ptr) __ptr = malloc(size);
   LOG_IF(FATAL, nullptr == __ptr) << "Malloc memory on CPU failed, malloc size:" << size;
   *ptr = __ptr;
 }
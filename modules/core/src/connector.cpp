@@ -20,9 +20,13 @@
 
 #include "connector.hpp"
 
+#include <atomic>
+#include <map>
+#include <mutex>
 #include <vector>
 
 #include "conveyor.hpp"
+#include "stream_dispatcher.hpp"
 
 namespace cnstream {
 
@@ -31,11 +35,22 @@ class ConnectorPrivate {
   explicit ConnectorPrivate(Connector* q);
   ~ConnectorPrivate();
   Conveyor* GetConveyorByIdx(int idx) const;
+  /*
+    pushes frames released by the dispatcher. they already passed the upstream, so they never wait, a
+    conveyor may go over its capacity for a while.
+   */
+  void PushReleased(const StreamDispatcher::Released& released);
 
   DECLARE_PUBLIC(q_ptr_, Connector);
   std::vector<Conveyor*> vec_conveyor_;
+  std::unique_ptr<StreamDispatcher> dispatcher_;
   size_t conveyor_capacity_ = 20;
-  bool stop_ = false;
+  std::atomic<bool> stop_{false};
+  std::function<void(const CNFrameInfoPtr&)> drop_listener_;
+  mutable std::mutex drop_mtx_;
+  std::map<uint32_t, uint64_t> dropped_;  ///< by channel_idx
+  RoutePredicate route_;
+  std::atomic<uint64_t> routed_past_{0};
   DISABLE_COPY_AND_ASSIGN(ConnectorPrivate);
 };  // class ConnectorPrivate
 
@@ -44,7 +59,33 @@ Connector::Connector(const size_t conveyor_count, size_t conveyor_capacity) : d_
   d_ptr_->vec_conveyor_.reserve(conveyor_count);
   for (size_t i = 0; i < conveyor_count; ++i) {
     d_ptr_->vec_conveyor_.push_back(new Conveyor(this, conveyor_capacity));
+    d_ptr_->vec_conveyor_.back()->idx_ = static_cast<int>(i);
   }
+  d_ptr_->dispatcher_.reset(new StreamDispatcher(DISPATCH_MODULO, conveyor_count));
+}
+
+Connector::Connector(const size_t conveyor_count, const LinkConfig& config)
+    : d_ptr_(new ConnectorPrivate(this)) {
+  d_ptr_->conveyor_capacity_ = config.queue_capacity;
+  d_ptr_->vec_conveyor_.reserve(conveyor_count);
+  QueueImpl queue_impl = config.queue_impl;
+  if (QUEUE_IMPL_RING == queue_impl && DROP_NONE != config.drop_policy) {
+    LOG(WARNING) << "The ring queue does not drop, queue implementation falls back to mutex.";
+    queue_impl = QUEUE_IMPL_MUTEX;
+  }
+  if (QUEUE_IMPL_SPILL == queue_impl && DROP_NONE != config.drop_policy) {
+    LOG(WARNING) << "The spill queue does not drop, queue implementation falls back to mutex.";
+    queue_impl = QUEUE_IMPL_MUTEX;
+  }
+  for (size_t i = 0; i < conveyor_count; ++i) {
+    Conveyor* conveyor = new Conveyor(this, config.queue_capacity, false, queue_impl);
+    conveyor->SetDropPolicy(config.drop_policy, config.drop_low_watermark);
+    conveyor->SetSpillDir(config.spill_dir);
+    conveyor->idx_ = static_cast<int>(i);
+    d_ptr_->vec_conveyor_.push_back(conveyor);
+  }
+  d_ptr_->dispatcher_.reset(new StreamDispatcher(config.dispatch_policy, conveyor_count));
+  d_ptr_->route_ = config.route;
 }
 
 Connector::~Connector() { delete d_ptr_; }
@@ -63,14 +104,94 @@ void Connector::PushDataBufferToConveyor(int conveyor_idx, CNFrameInfoPtr data)
   GetConveyor(conveyor_idx)->PushDataBuffer(data);
 }
 
+int Connector::DispatchConveyor(const CNFrameInfoPtr& data) { return d_ptr_->dispatcher_->Dispatch(data); }
+
+void Connector::FrameDone(int conveyor_idx, const CNFrameInfoPtr& data, double cost_ms) {
+  StreamDispatcher::Released released;
+  d_ptr_->dispatcher_->Done(conveyor_idx, data, cost_ms, &released);
+  d_ptr_->PushReleased(released);
+}
+
+void Connector::SetElastic(bool elastic) { d_ptr_->dispatcher_->SetElastic(elastic); }
+
+uint32_t Connector::GetActiveCount() const { return d_ptr_->dispatcher_->GetActiveCount(); }
+
+void Connector::SetActiveCount(uint32_t active_count) { d_ptr_->dispatcher_->SetActiveCount(active_count); }
+
+DispatchPolicy Connector::GetDispatchPolicy() const { return d_ptr_->dispatcher_->GetPolicy(); }
+
+void Connector::SetDispatchPolicy(DispatchPolicy policy) { d_ptr_->dispatcher_->SetPolicy(policy); }
+
+void Connector::GetDispatchStatus(LinkStatus* status) const { d_ptr_->dispatcher_->GetStatus(status); }
+
+void Connector::FrameDropped(int conveyor_idx, const CNFrameInfoPtr& data) {
+  {
+    std::lock_guard<std::mutex> lk(d_ptr_->drop_mtx_);
+    d_ptr_->dropped_[data->channel_idx]++;
+  }
+  /* it will never be processed, see StreamDispatcher::Done */
+  FrameDone(conveyor_idx, data, 0);
+  if (d_ptr_->drop_listener_) d_ptr_->drop_listener_(data);
+}
+
+void Connector::SetDropListener(std::function<void(const CNFrameInfoPtr&)> listener) {
+  d_ptr_->drop_listener_ = std::move(listener);
+}
+
+void Connector::GetDropStatus(LinkStatus* status) const {
+  std::lock_guard<std::mutex> lk(d_ptr_->drop_mtx_);
+  status->dropped = d_ptr_->dropped_;
+}
+
+const RoutePredicate* Connector::GetRoute() const { return d_ptr_->route_.PassAll() ? nullptr : &d_ptr_->route_; }
+
+void Connector::FrameRoutedPast() { d_ptr_->routed_past_.fetch_add(1, std::memory_order_relaxed); }
+
+void Connector::GetRouteStatus(LinkStatus* status) const { status->routed_past = d_ptr_->routed_past_.load(); }
+
+std::vector<CNFrameInfoPtr> Connector::PopDataBufferBatchFromConveyor(int conveyor_idx, size_t max_num,
+                                                                      uint32_t timeout_us) {
+  return GetConveyor(conveyor_idx)->PopDataBufferBatch(max_num, timeout_us);
+}
+
+CNFrameInfoPtr Connector::TryPopDataBufferFromConveyor(int conveyor_idx) {
+  return GetConveyor(conveyor_idx)->TryPopDataBuffer();
+}
+
+void Connector::SetConveyorNotifier(int conveyor_idx, ConveyorNotifier* notifier) {
+  GetConveyor(conveyor_idx)->SetNotifier(notifier);
+}
+
+void Connector::SetSingleProducer(bool single_producer) {
+  for (Conveyor* it : d_ptr_->vec_conveyor_) {
+    it->SetSingleProducer(single_producer);
+  }
+}
+
 bool Connector::IsStopped() const { return d_ptr_->stop_; }
 
-void Connector::Start() { d_ptr_->stop_ = false; }
+void Connector::Start() {
+  d_ptr_->stop_ = false;
+  StreamDispatcher::Released released;
+  d_ptr_->dispatcher_->Reset(&released);
+  d_ptr_->PushReleased(released);
+}
 
-void Connector::Stop() { d_ptr_->stop_ = true; }
+void Connector::Stop() {
+  d_ptr_->stop_ = true;
+  for (Conveyor* it : d_ptr_->vec_conveyor_) {
+    it->Wakeup();
+  }
+}
 
 ConnectorPrivate::ConnectorPrivate(Connector* q) : q_ptr_(q), stop_(false) {}
 
+void ConnectorPrivate::PushReleased(const StreamDispatcher::Released& released) {
+  for (const auto& it : released) {
+    GetConveyorByIdx(it.first)->PushDataBufferNoWait(it.second);
+  }
+}
+
 ConnectorPrivate::~ConnectorPrivate() {
   for (Conveyor* it : vec_conveyor_) {
     delete it;
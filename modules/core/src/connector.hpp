@@ -21,9 +21,12 @@
 #ifndef MODULES_CORE_INCLUDE_CONNECTOR_HPP_
 #define MODULES_CORE_INCLUDE_CONNECTOR_HPP_
 
+#include <functional>
 #include <memory>
+#include <vector>
 
 #include "cnstream_frame.hpp"
+#include "cnstream_pipeline.hpp"
 
 namespace cnstream {
 
@@ -31,6 +34,7 @@ using CNFrameInfoPtr = std::shared_ptr<CNFrameInfo>;
 
 class ConnectorPrivate;
 class Conveyor;
+class ConveyorNotifier;
 
 /****************************************************************
  * @brief Connect two modules.
@@ -63,6 +67,13 @@ class Connector {
    *   [conveyor_capacity]: the maximum buffer number of a conveyor.
    ***************************************************************************/
   explicit Connector(const size_t conveyor_count, size_t conveyor_capacity = 20);
+  /****************************************************************************
+   * @brief Connector constructor.
+   * @param
+   *   [conveyor_count]: the conveyor num of this connector.
+   *   [config]: link config, capacity and implementation of conveyors.
+   ***************************************************************************/
+  Connector(const size_t conveyor_count, const LinkConfig& config);
   ~Connector();
 
   const size_t GetConveyorCount() const;
@@ -71,7 +82,45 @@ class Connector {
 
   CNFrameInfoPtr PopDataBufferFromConveyor(int conveyor_idx);
   void PushDataBufferToConveyor(int conveyor_idx, CNFrameInfoPtr data);
+  /*
+    picks the conveyor of data with the dispatch policy of the link, see DispatchPolicy. returns -1 if data is
+    held back while its stream moves to another conveyor, it is pushed by FrameDone or Start then.
+   */
+  int DispatchConveyor(const CNFrameInfoPtr& data);
+  /* data dispatched to conveyor_idx is done with by the downstream module, cost_ms spent processing it */
+  void FrameDone(int conveyor_idx, const CNFrameInfoPtr& data, double cost_ms);
+  /* DISPATCH_MODULO pins streams too on an elastic link. Call it before Start. */
+  void SetElastic(bool elastic);
+  /* number of conveyors dispatched to, the first ones */
+  uint32_t GetActiveCount() const;
+  /* streams move to the first active_count conveyors (clamped to [1, conveyor count]) as they go on */
+  void SetActiveCount(uint32_t active_count);
+  DispatchPolicy GetDispatchPolicy() const;
+  /* call it before Start */
+  void SetDispatchPolicy(DispatchPolicy policy);
+  /* fills the dispatch counters of status */
+  void GetDispatchStatus(LinkStatus* status) const;
+  /* data queued to conveyor_idx is dropped by the drop policy of the link, called by the conveyor */
+  void FrameDropped(int conveyor_idx, const CNFrameInfoPtr& data);
+  /* called for each data dropped, nullptr for none. Call it before Start. */
+  void SetDropListener(std::function<void(const CNFrameInfoPtr&)> listener);
+  /* fills the drop counters of status */
+  void GetDropStatus(LinkStatus* status) const;
+  /* data the link passes on, see LinkConfig::route. nullptr if it passes all data */
+  const RoutePredicate* GetRoute() const;
+  /* a frame did not pass the route of the link */
+  void FrameRoutedPast();
+  /* fills the route counters of status */
+  void GetRouteStatus(LinkStatus* status) const;
+  /* see Conveyor::PopDataBufferBatch */
+  std::vector<CNFrameInfoPtr> PopDataBufferBatchFromConveyor(int conveyor_idx, size_t max_num, uint32_t timeout_us);
+  /* returns nullptr at once if the conveyor is empty or the connector stopped */
+  CNFrameInfoPtr TryPopDataBufferFromConveyor(int conveyor_idx);
+  /* Notifier told about every push to the conveyor, nullptr to detach. Call it before Start. */
+  void SetConveyorNotifier(int conveyor_idx, ConveyorNotifier* notifier);
 
+  /* Declare that only one thread pushes data to this connector. Call it before Start. */
+  void SetSingleProducer(bool single_producer);
   void Start();
   void Stop();
   bool IsStopped() const;
@@ -20,57 +20,488 @@
 
 #include "conveyor.hpp"
 
-#include <chrono>
+#include <algorithm>
 #include <memory>
-#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "connector.hpp"
 
 namespace cnstream {
 
-Conveyor::Conveyor(Connector* container, size_t max_size, bool enable_drop)
+Conveyor::Conveyor(Connector* container, size_t max_size, bool enable_drop, QueueImpl queue_impl)
     : container_(container), max_size_(max_size), enable_drop_(enable_drop) {
   LOG_IF(FATAL, nullptr == container) << "container should not be nullptr.";
+  if (QUEUE_IMPL_RING == queue_impl) {
+    /*
+      dropping pops on the producer side, the consumer is not the only one then.
+      twice the size leaves room for PushDataBufferNoWait going over max size.
+     */
+    ringq_.reset(new RingQueue<CNFrameInfoPtr>(2 * max_size, false, !enable_drop));
+  } else if (QUEUE_IMPL_FAIR == queue_impl) {
+    fairq_.reset(new FairQueue);
+  } else if (QUEUE_IMPL_SPILL == queue_impl) {
+    spill_ = true;
+  }
+  if (enable_drop && !ringq_) SetDropPolicy(fairq_ ? DROP_LARGEST_STREAM : DROP_OLDEST, 0);
+}
+
+void Conveyor::SetDropPolicy(DropPolicy policy, size_t low_watermark) {
+  LOG_IF(FATAL, ringq_ && DROP_NONE != policy) << "the ring queue does not support drop policies.";
+  LOG_IF(FATAL, spill_ && DROP_NONE != policy) << "the spill queue does not support drop policies.";
+  drop_policy_ = policy;
+  low_watermark_ = 0 == low_watermark ? std::max<size_t>(max_size_, 1) - 1 : std::min(low_watermark, max_size_);
+}
+
+void Conveyor::SetSingleProducer(bool single_producer) {
+  if (ringq_) ringq_->SetSingleProducer(single_producer && !enable_drop_);
+}
+
+uint32_t Conveyor::GetBufferSize() const {
+  if (ringq_) return ringq_->Size();
+  std::lock_guard<std::mutex> lk(data_mutex_);
+  return SizeUnlocked();
 }
 
-uint32_t Conveyor::GetBufferSize() const { return dataq_.Size(); }
+uint32_t Conveyor::GetSpilledSize() const {
+  std::lock_guard<std::mutex> lk(data_mutex_);
+  return spilled_.size();
+}
 
 void Conveyor::PushDataBuffer(CNFrameInfoPtr data) {
-  while (!container_->IsStopped() && dataq_.Size() >= max_size_) {
-    if (enable_drop_) {
-      CNFrameInfoPtr drop;
-      dataq_.TryPop(drop);
-      break;
-    } else {
-      std::this_thread::sleep_for(std::chrono::milliseconds(20));
-    }
+  if (ringq_) {
+    PushToRing(data);
+    return;
+  }
+  std::vector<CNFrameInfoPtr> dropped;
+  std::vector<CNFrameInfoPtr> releasable;
+  bool spilled = false;
+  std::unique_lock<std::mutex> lk(data_mutex_);
+  if (DROP_NONE == drop_policy_) {
+    bool spill = false;
+    auto ready = [&] {
+      spill = false;
+      if (container_->IsStopped() || ResidentSizeUnlocked() < max_size_) return true;
+      return spill = CanSpillUnlocked(data);
+    };
+    /* woken up by pops, and by the end of a spill for the next one */
+    do {
+      notfull_cond_.wait(lk, ready);
+    } while (spill && !(spilled = SpillUnlocked(&lk, data)) && !container_->IsStopped());
   }
   if (container_->IsStopped()) return;
-  dataq_.Push(data);
+  bool push = ShedUnlocked(data, &dropped);
+  if (push) PushUnlocked(data, spilled);
+  if (!unreleased_.empty()) releasable = ReleasableUnlocked();
+  lk.unlock();
+  ReportDropped(dropped);
+  if (push) {
+    notempty_cond_.notify_one();
+    if (notifier_) notifier_->Notify();
+  }
+  ReleaseSpilled(&releasable);
 }
 
-CNFrameInfoPtr Conveyor::PopDataBuffer() {
-  CNFrameInfoPtr data;
-  while (!container_->IsStopped()) {
-    if (dataq_.WaitAndTryPop(data, std::chrono::milliseconds(20))) {
-      break;
+bool Conveyor::PushDataBufferNoWait(CNFrameInfoPtr data) {
+  if (ringq_) {
+    if (container_->IsStopped()) return true;
+    if (enable_drop_ || !ringq_->TryPush(CNFrameInfoPtr(data))) {
+      /* the ring itself is full, should hardly happen */
+      PushToRing(data);
+      return true;
+    }
+    NotifyRingWaiters(&pop_waiters_, &notempty_cond_);
+    if (notifier_) notifier_->Notify();
+    return ringq_->Size() < max_size_;
+  }
+  std::vector<CNFrameInfoPtr> dropped;
+  std::vector<CNFrameInfoPtr> releasable;
+  bool spilled = false;
+  std::unique_lock<std::mutex> lk(data_mutex_);
+  if (container_->IsStopped()) return true;
+  if (ResidentSizeUnlocked() >= max_size_ && CanSpillUnlocked(data)) {
+    spilled = SpillUnlocked(&lk, data);
+    if (container_->IsStopped()) return true;
+  }
+  bool push = ShedUnlocked(data, &dropped);
+  if (push) PushUnlocked(data, spilled);
+  if (!unreleased_.empty()) releasable = ReleasableUnlocked();
+  /* the next data is expected to be spilled as well */
+  bool full = DROP_NONE == drop_policy_ && !spilled && ResidentSizeUnlocked() >= max_size_;
+  lk.unlock();
+  ReportDropped(dropped);
+  if (push) {
+    notempty_cond_.notify_one();
+    if (notifier_) notifier_->Notify();
+  }
+  ReleaseSpilled(&releasable);
+  return !push || !full;
+}
+
+bool Conveyor::WaitForSpace(ConveyorNotifier* notifier) {
+  std::lock_guard<std::mutex> lk(data_mutex_);
+  if (container_->IsStopped()) return false;
+  space_waiters_.push_back(notifier);
+  space_waiter_cnt_.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (ResidentSizeUnlocked() < max_size_) {
+    space_waiters_.pop_back();
+    space_waiter_cnt_.fetch_sub(1);
+    return false;
+  }
+  return true;
+}
+
+void Conveyor::NotifySpaceWaiters() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (space_waiter_cnt_.load(std::memory_order_relaxed) > 0) {
+    std::vector<ConveyorNotifier*> waiters;
+    {
+      std::lock_guard<std::mutex> lk(data_mutex_);
+      if (ResidentSizeUnlocked() >= max_size_) return;
+      waiters.swap(space_waiters_);
+      space_waiter_cnt_.store(0);
     }
+    for (auto waiter : waiters) waiter->NotifySpace();
   }
+}
+
+CNFrameInfoPtr Conveyor::PopDataBuffer() {
+  if (ringq_) return PopFromRing();
+  std::unique_lock<std::mutex> lk(data_mutex_);
+  notempty_cond_.wait(lk, [this] { return container_->IsStopped() || SizeUnlocked() > 0; });
   if (container_->IsStopped()) {
     return nullptr;
   }
+  std::vector<CNFrameInfoPtr> spilled;
+  CNFrameInfoPtr data = PopUnlocked(&spilled);
+  RestoreSpilled(&lk, spilled);
+  notfull_cond_.notify_one();
+  NotifySpaceWaiters();
   return data;
 }
 
+CNFrameInfoPtr Conveyor::TryPopDataBuffer() {
+  if (container_->IsStopped()) return nullptr;
+  CNFrameInfoPtr data;
+  if (ringq_) {
+    if (ringq_->TryPop(data)) {
+      NotifyRingWaiters(&push_waiters_, &notfull_cond_);
+      NotifySpaceWaiters();
+    }
+    return data;
+  }
+  std::unique_lock<std::mutex> lk(data_mutex_);
+  if (0 == SizeUnlocked()) return nullptr;
+  std::vector<CNFrameInfoPtr> spilled;
+  data = PopUnlocked(&spilled);
+  RestoreSpilled(&lk, spilled);
+  notfull_cond_.notify_one();
+  NotifySpaceWaiters();
+  return data;
+}
+
+std::vector<CNFrameInfoPtr> Conveyor::PopDataBufferBatch(size_t max_num, uint32_t timeout_us) {
+  std::vector<CNFrameInfoPtr> vec_data;
+  CNFrameInfoPtr data = PopDataBuffer();
+  if (nullptr == data.get()) return vec_data;
+  vec_data.push_back(data);
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_us);
+  while (vec_data.size() < max_num) {
+    if (PopQueuedDataBuffer(&vec_data, max_num)) continue;
+    if (0 == timeout_us || !WaitForData(deadline)) break;
+  }
+  return vec_data;
+}
+
+bool Conveyor::PopQueuedDataBuffer(std::vector<CNFrameInfoPtr>* vec_data, size_t max_num) {
+  const size_t size = vec_data->size();
+  if (container_->IsStopped()) return false;
+  if (ringq_) {
+    CNFrameInfoPtr data;
+    while (vec_data->size() < max_num && ringq_->TryPop(data)) vec_data->push_back(std::move(data));
+    if (size == vec_data->size()) return false;
+    NotifyRingWaiters(&push_waiters_, &notfull_cond_);
+    NotifySpaceWaiters();
+    return true;
+  }
+  {
+    std::unique_lock<std::mutex> lk(data_mutex_);
+    std::vector<CNFrameInfoPtr> spilled;
+    while (vec_data->size() < max_num && SizeUnlocked() > 0) vec_data->push_back(PopUnlocked(&spilled));
+    RestoreSpilled(&lk, spilled);
+  }
+  if (size == vec_data->size()) return false;
+  notfull_cond_.notify_all();
+  NotifySpaceWaiters();
+  return true;
+}
+
+bool Conveyor::WaitForData(std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lk(data_mutex_);
+  pop_waiters_.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool ret = notempty_cond_.wait_until(lk, deadline, [this] { return container_->IsStopped() || SizeUnlocked() > 0; });
+  pop_waiters_.fetch_sub(1);
+  return ret && !container_->IsStopped();
+}
+
 std::vector<CNFrameInfoPtr> Conveyor::PopAllDataBuffer() {
   std::vector<CNFrameInfoPtr> vec_data;
-  CNFrameInfoPtr data;
-  while (!dataq_.Empty()) {
-    dataq_.TryPop(data);
-    vec_data.push_back(data);
+  if (ringq_) {
+    CNFrameInfoPtr data;
+    while (ringq_->TryPop(data)) vec_data.push_back(data);
+    NotifyRingWaiters(&push_waiters_, &notfull_cond_);
+    NotifySpaceWaiters();
+    return vec_data;
+  }
+  {
+    std::unique_lock<std::mutex> lk(data_mutex_);
+    std::vector<CNFrameInfoPtr> spilled;
+    while (SizeUnlocked() > 0) vec_data.push_back(PopUnlocked(&spilled));
+    RestoreSpilled(&lk, spilled);
   }
+  notfull_cond_.notify_all();
+  NotifySpaceWaiters();
   return vec_data;
 }
 
+/*
+  Lock-free path. A thread only takes data_mutex_ to sleep. Before sleeping it registers itself
+  in push_waiters_/pop_waiters_ and tries the ring again, the other side checks the waiter count
+  after touching the ring. The seq_cst fences on both sides make sure at least one of them sees
+  the other, so a wakeup can not be lost.
+ */
+void Conveyor::PushToRing(CNFrameInfoPtr data) {
+  auto try_push = [&]() -> bool {
+    if (enable_drop_ && ringq_->Size() >= max_size_) {
+      CNFrameInfoPtr drop;
+      ringq_->TryPop(drop);
+    }
+    return ringq_->Size() < max_size_ && ringq_->TryPush(std::move(data));
+  };
+  if (container_->IsStopped()) return;
+  if (!try_push()) {
+    std::unique_lock<std::mutex> lk(data_mutex_);
+    push_waiters_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    notfull_cond_.wait(lk, [&] { return container_->IsStopped() || try_push(); });
+    push_waiters_.fetch_sub(1);
+    if (container_->IsStopped()) return;
+  }
+  NotifyRingWaiters(&pop_waiters_, &notempty_cond_);
+  if (notifier_) notifier_->Notify();
+}
+
+CNFrameInfoPtr Conveyor::PopFromRing() {
+  CNFrameInfoPtr data;
+  if (container_->IsStopped()) return nullptr;
+  if (!ringq_->TryPop(data)) {
+    std::unique_lock<std::mutex> lk(data_mutex_);
+    pop_waiters_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    notempty_cond_.wait(lk, [&] { return container_->IsStopped() || ringq_->TryPop(data); });
+    pop_waiters_.fetch_sub(1);
+    if (container_->IsStopped()) return nullptr;
+  }
+  NotifyRingWaiters(&push_waiters_, &notfull_cond_);
+  NotifySpaceWaiters();
+  return data;
+}
+
+void Conveyor::NotifyRingWaiters(std::atomic<int>* waiters, std::condition_variable* cond) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiters->load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lk(data_mutex_);
+    cond->notify_all();
+  }
+}
+
+bool Conveyor::CanSpillUnlocked(const CNFrameInfoPtr& data) const {
+  return spill_ && !spill_full_ && !spilling_ && data->frame.IsSpillable();
+}
+
+bool Conveyor::SpillUnlocked(std::unique_lock<std::mutex>* lk, const CNFrameInfoPtr& data) {
+  spilling_ = true;
+  lk->unlock();
+  bool created = true;
+  bool spilled = false;
+  {
+    std::lock_guard<std::mutex> spill_lk(spill_mutex_);
+    if (!spill_file_) spill_file_ = SpillFile::Create(spill_dir_);
+    created = nullptr != spill_file_;
+    spilled = created && spill_file_->Spill(data);
+  }
+  lk->lock();
+  spilling_ = false;
+  if (!created) {
+    /* blocks as QUEUE_IMPL_MUTEX from now on */
+    spill_ = false;
+  } else if (!spilled) {
+    /* no room left, until some is restored */
+    spill_full_ = true;
+  }
+  /* the next one may be spilled */
+  notfull_cond_.notify_all();
+  return spilled;
+}
+
+std::vector<CNFrameInfoPtr> Conveyor::ReleasableUnlocked() {
+  std::vector<CNFrameInfoPtr> frames;
+  if (releasing_) return frames;
+  for (auto it = unreleased_.begin(); it != unreleased_.end();) {
+    if (1 == it->use_count()) {
+      frames.push_back(it->lock());
+      it = unreleased_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  releasing_ = !frames.empty();
+  return frames;
+}
+
+void Conveyor::ReleaseSpilled(std::vector<CNFrameInfoPtr>* frames) {
+  if (frames->empty()) return;
+  {
+    std::lock_guard<std::mutex> spill_lk(spill_mutex_);
+    /* kept in memory if it got shared meanwhile, e.g. by CNDataFrame::ImageBGR */
+    for (auto& it : *frames) spill_file_->Release(it);
+  }
+  frames->clear();
+  {
+    std::lock_guard<std::mutex> lk(data_mutex_);
+    releasing_ = false;
+  }
+  spilled_cond_.notify_all();
+}
+
+void Conveyor::PushUnlocked(const CNFrameInfoPtr& data, bool spilled) {
+  if (fairq_) {
+    fairq_->Push(data);
+    return;
+  }
+  dataq_.push_back(data);
+  if (spilled) {
+    spilled_.push_back(data.get());
+    unreleased_.push_back(data);
+  }
+}
+
+CNFrameInfoPtr Conveyor::PopUnlocked(std::vector<CNFrameInfoPtr>* spilled) {
+  if (fairq_) return fairq_->Pop();
+  CNFrameInfoPtr data = dataq_.front();
+  dataq_.pop_front();
+  if (!spilled_.empty() && spilled_.front() == data.get()) {
+    spilled_.pop_front();
+    /* not to be released any more, the queue does not hold it */
+    if (!unreleased_.empty() && unreleased_.front().lock() == data) unreleased_.pop_front();
+    spilled->push_back(data);
+  }
+  return data;
+}
+
+void Conveyor::RestoreSpilled(std::unique_lock<std::mutex>* lk, const std::vector<CNFrameInfoPtr>& spilled) {
+  /* a frame popped while its planes are being freed is restored once they are */
+  if (!spilled.empty()) spilled_cond_.wait(*lk, [this] { return !releasing_; });
+  lk->unlock();
+  if (spilled.empty()) return;
+  {
+    std::lock_guard<std::mutex> spill_lk(spill_mutex_);
+    for (auto& it : spilled) spill_file_->Restore(it);
+  }
+  spill_full_ = false;
+}
+
+static bool IsEos(const CNFrameInfoPtr& data) { return data->frame.flags & CN_FRAME_FLAG_EOS; }
+
+CNFrameInfoPtr Conveyor::DropUnlocked() {
+  if (fairq_) return DROP_LARGEST_STREAM == drop_policy_ ? fairq_->DropOne() : fairq_->DropOldest();
+  auto victim = dataq_.end();
+  if (DROP_LARGEST_STREAM == drop_policy_) {
+    /* the queue is short, count the streams in it */
+    std::unordered_map<uint32_t, size_t> counts;
+    size_t largest = 0;
+    for (const CNFrameInfoPtr& it : dataq_) {
+      if (!IsEos(it)) largest = std::max(largest, ++counts[it->channel_idx]);
+    }
+    victim = std::find_if(dataq_.begin(), dataq_.end(), [&](const CNFrameInfoPtr& it) {
+      return !IsEos(it) && counts[it->channel_idx] == largest;
+    });
+  } else {
+    victim = std::find_if(dataq_.begin(), dataq_.end(), [](const CNFrameInfoPtr& it) { return !IsEos(it); });
+  }
+  if (dataq_.end() == victim) return nullptr;
+  CNFrameInfoPtr data = *victim;
+  dataq_.erase(victim);
+  return data;
+}
+
+bool Conveyor::ShedUnlocked(const CNFrameInfoPtr& data, std::vector<CNFrameInfoPtr>* dropped) {
+  if (DROP_NONE == drop_policy_) return true;
+  const size_t size = SizeUnlocked();
+  if (DROP_NEWEST == drop_policy_) {
+    if (size >= max_size_) {
+      dropping_ = true;
+    } else if (size <= low_watermark_) {
+      dropping_ = false;
+    }
+    if (!dropping_ || IsEos(data)) return true;
+    dropped->push_back(data);
+    return false;
+  }
+  if (size < max_size_) return true;
+  while (SizeUnlocked() > low_watermark_) {
+    CNFrameInfoPtr victim = DropUnlocked();
+    if (!victim) break;
+    dropped->push_back(victim);
+  }
+  return true;
+}
+
+void Conveyor::ReportDropped(const std::vector<CNFrameInfoPtr>& dropped) {
+  /* not one of the conveyors of container_ */
+  if (idx_ < 0) return;
+  for (const CNFrameInfoPtr& it : dropped) container_->FrameDropped(idx_, it);
+}
+
+void Conveyor::Wakeup() {
+  /* take the lock so that a waiter can not miss the stop flag between its check and its wait */
+  std::lock_guard<std::mutex> lk(data_mutex_);
+  notempty_cond_.notify_all();
+  notfull_cond_.notify_all();
+  /* tasks waiting for space do not run any more once the connector stops */
+  space_waiters_.clear();
+  space_waiter_cnt_.store(0);
+  if (notifier_) notifier_->Notify();
+}
+
+/*
+  Same idea as the ring waiters above: the reader registers in waiters_ before it checks the
+  conveyors, a writer checks waiters_ after it pushed. seq_ is only bumped under mutex_, so a reader
+  holding a key older than seq_ never goes to sleep.
+ */
+void ConveyorWaiter::Notify() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiters_.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    seq_.fetch_add(1);
+    cond_.notify_all();
+  }
+}
+
+uint64_t ConveyorWaiter::PrepareWait() {
+  waiters_.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return seq_.load();
+}
+
+void ConveyorWaiter::CancelWait() { waiters_.fetch_sub(1); }
+
+void ConveyorWaiter::CommitWait(uint64_t key) {
+  std::unique_lock<std::mutex> lk(mutex_);
+  cond_.wait(lk, [&] { return seq_.load(std::memory_order_relaxed) != key; });
+  waiters_.fetch_sub(1);
+}
+
 }  // namespace cnstream
@@ -21,11 +21,20 @@
 #ifndef MODULES_CORE_INCLUDE_CONVEYOR_HPP_
 #define MODULES_CORE_INCLUDE_CONVEYOR_HPP_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 #include "cnstream_frame.hpp"
-#include "threadsafe_queue.hpp"
+#include "cnstream_pipeline.hpp"
+#include "fair_queue.hpp"
+#include "ring_queue.hpp"
+#include "spill_file.hpp"
 
 namespace cnstream {
 
@@ -33,6 +42,45 @@ using CNFrameInfoPtr = std::shared_ptr<CNFrameInfo>;
 
 class Connector;
 
+/****************************************************************************
+ * @brief Told by conveyors about every push.
+ ****************************************************************************/
+class ConveyorNotifier {
+ public:
+  virtual ~ConveyorNotifier() = default;
+  virtual void Notify() = 0;
+  /* a conveyor waited on by Conveyor::WaitForSpace is not full any more */
+  virtual void NotifySpace() {}
+};  // class ConveyorNotifier
+
+/****************************************************************************
+ * @brief Lets one thread wait on several conveyors at the same time.
+ *
+ * A reader waits like this:
+ *
+ *   uint64_t key = waiter.PrepareWait();
+ *   if (try to pop from every conveyor succeeds) waiter.CancelWait();
+ *   else waiter.CommitWait(key);
+ *
+ * Data pushed after PrepareWait() always ends CommitWait(), so no wakeup
+ * is lost. Notify() takes no lock while nobody is waiting.
+ ****************************************************************************/
+class ConveyorWaiter : public ConveyorNotifier {
+ public:
+  ConveyorWaiter() = default;
+  void Notify() override;
+  uint64_t PrepareWait();
+  void CancelWait();
+  void CommitWait(uint64_t key);
+
+ private:
+  std::atomic<uint64_t> seq_{0};
+  std::atomic<int> waiters_{0};
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  DISABLE_COPY_AND_ASSIGN(ConveyorWaiter);
+};  // class ConveyorWaiter
+
 /****************************************************************************
  * @brief used to transmit data between two modules.
  *
@@ -49,27 +97,146 @@ class Connector;
  * until it is not.
  * Or if the queue is full, the module could not push buffer, unless
  * the other module pop a buffer from it.
+ *
+ * Both sides block on condition variables (not empty / not full), and
+ * are woken up at once when the connector stops.
+ *
+ * With QUEUE_IMPL_RING the data queue is a preallocated lock-free ring.
+ * Push and pop then take no lock unless the ring is full or empty and the
+ * thread has to sleep.
+ *
+ * With QUEUE_IMPL_FAIR the data queue keeps a sub-queue for each stream,
+ * see FairQueue. A flooding stream can not delay the others for long.
+ *
+ * With QUEUE_IMPL_SPILL the max size only counts the data kept in memory.
+ * Beyond it, the planes of a host frame pushed are copied to a SpillFile
+ * instead of blocking the pushing side, and copied back when it is popped.
+ * Other branches of the pipeline may still use the frame, its planes are
+ * freed once the queue alone holds it, checked at the next pushes. The
+ * copies are made under spill_mutex_, not data_mutex_.
+ *
+ * With a drop policy (see DropPolicy) a full queue drops data instead of
+ * blocking the pushing side. Each dropped data is reported to the
+ * connector after the lock is released.
+ *
+ * A module with several input links waits on all of them at once through
+ * a ConveyorWaiter, see Pipeline::TaskLoop.
  ****************************************************************************/
 class Conveyor {
  public:
   friend class Connector;
   // ~Conveyor();
   void PushDataBuffer(CNFrameInfoPtr data);
+  /*
+    never blocks, the queue may go over max size. returns false when the queue is full after the push,
+    the caller should then wait for space (WaitForSpace) before it pushes again.
+   */
+  bool PushDataBufferNoWait(CNFrameInfoPtr data);
+  /*
+    returns false if the queue is not full (or stopped). otherwise returns true, and notifier->NotifySpace()
+    is called once when it is not full any more.
+   */
+  bool WaitForSpace(ConveyorNotifier* notifier);
   CNFrameInfoPtr PopDataBuffer();
+  /* returns nullptr at once if there is no data or the connector stopped */
+  CNFrameInfoPtr TryPopDataBuffer();
+  /*
+    blocks until there is data, then pops up to max_num buffers, waiting at most timeout_us after the
+    first one for more. 0 timeout_us takes the buffers already queued only. empty once the connector stopped.
+   */
+  std::vector<CNFrameInfoPtr> PopDataBufferBatch(size_t max_num, uint32_t timeout_us);
   std::vector<CNFrameInfoPtr> PopAllDataBuffer();
   uint32_t GetBufferSize() const;
+  /* number of buffers queued whose planes are spilled, see QUEUE_IMPL_SPILL */
+  uint32_t GetSpilledSize() const;
 
  private:
 #ifdef TEST
  public:
 #endif
-  Conveyor(Connector* container, size_t max_size, bool enable_drop = false);
+  Conveyor(Connector* container, size_t max_size, bool enable_drop = false,
+           QueueImpl queue_impl = QUEUE_IMPL_MUTEX);
+  /* no other thread may use this conveyor while it is being set */
+  void SetSingleProducer(bool single_producer);
+  /*
+    DROP_NONE to block while full. low_watermark is the size dropping stops at once started, 0 for max size - 1.
+    Not for QUEUE_IMPL_RING. Call it before the connector starts.
+   */
+  void SetDropPolicy(DropPolicy policy, size_t low_watermark);
+  /* directory of the spill file of QUEUE_IMPL_SPILL, created at the first spill. Call it before the connector starts */
+  void SetSpillDir(const std::string& dir) { spill_dir_ = dir; }
+  /* notifier told about every push, nullptr to detach. Call it before the connector starts */
+  void SetNotifier(ConveyorNotifier* notifier) { notifier_ = notifier; }
+  /* wake up all threads blocked in PushDataBuffer/PopDataBuffer, called by Connector::Stop */
+  void Wakeup();
 
  private:
+  void PushToRing(CNFrameInfoPtr data);
+  CNFrameInfoPtr PopFromRing();
+  /* wake up threads sleeping on the other side of the ring, if there is any */
+  void NotifyRingWaiters(std::atomic<int>* waiters, std::condition_variable* cond);
+  /* called after a pop */
+  void NotifySpaceWaiters();
+  /* pops the queued buffers into vec_data until it holds max_num, returns false if nothing was popped */
+  bool PopQueuedDataBuffer(std::vector<CNFrameInfoPtr>* vec_data, size_t max_num);
+  /* returns false if there is still no data at deadline or the connector stopped */
+  bool WaitForData(std::chrono::steady_clock::time_point deadline);
+  size_t SizeUnlocked() const { return ringq_ ? ringq_->Size() : fairq_ ? fairq_->Size() : dataq_.size(); }
+  /* the buffers counted against max size, all but the spilled ones */
+  size_t ResidentSizeUnlocked() const { return SizeUnlocked() - spilled_.size(); }
+  /* data may be pushed beyond max size by a spill of its planes. One spill at a time */
+  bool CanSpillUnlocked(const CNFrameInfoPtr& data) const;
+  /*
+    releases lk on data_mutex_ while the planes of data are copied to the spill file, returns false if they
+    could not be. The planes stay in memory until the queue alone holds data, see ReleaseSpilled
+   */
+  bool SpillUnlocked(std::unique_lock<std::mutex>* lk, const CNFrameInfoPtr& data);
+  /* spilled frames the queue alone holds, their planes are to be freed by ReleaseSpilled. One release at a time */
+  std::vector<CNFrameInfoPtr> ReleasableUnlocked();
+  void ReleaseSpilled(std::vector<CNFrameInfoPtr>* frames);
+  /* the data queue of the mutex implementations, under data_mutex_. spilled if SpillUnlocked copied data */
+  void PushUnlocked(const CNFrameInfoPtr& data, bool spilled = false);
+  /* data whose planes are spilled is added to spilled, to be passed to RestoreSpilled */
+  CNFrameInfoPtr PopUnlocked(std::vector<CNFrameInfoPtr>* spilled);
+  /* releases lk on data_mutex_, then restores the planes of the popped frames */
+  void RestoreSpilled(std::unique_lock<std::mutex>* lk, const std::vector<CNFrameInfoPtr>& spilled);
+  /* a frame picked by the drop policy, nullptr if there is none to drop */
+  CNFrameInfoPtr DropUnlocked();
+  /*
+    makes room for data by the drop policy, dropped frames are added to dropped. returns false if data itself
+    is dropped.
+   */
+  bool ShedUnlocked(const CNFrameInfoPtr& data, std::vector<CNFrameInfoPtr>* dropped);
+  void ReportDropped(const std::vector<CNFrameInfoPtr>& dropped);
+
   Connector* container_;
   size_t max_size_;
-  bool enable_drop_;
-  ThreadSafeQueue<CNFrameInfoPtr> dataq_;
+  bool enable_drop_;  ///< ring only, the mutex implementations use drop_policy_
+  DropPolicy drop_policy_ = DROP_NONE;
+  size_t low_watermark_ = 0;
+  bool dropping_ = false;  ///< DROP_NEWEST got full and is not down to low_watermark_ yet
+  int idx_ = -1;           ///< in the connector
+  std::deque<CNFrameInfoPtr> dataq_;
+  std::unique_ptr<RingQueue<CNFrameInfoPtr>> ringq_;
+  std::unique_ptr<FairQueue> fairq_;                   ///< instead of dataq_ with QUEUE_IMPL_FAIR
+  bool spill_ = false;                                 ///< QUEUE_IMPL_SPILL, until the spill file failed to be created
+  std::atomic<bool> spill_full_{false};                ///< the last spill found no room in the spill file
+  std::string spill_dir_;
+  std::deque<const CNFrameInfo*> spilled_;             ///< queued frames spilled, in queue order
+  std::deque<std::weak_ptr<CNFrameInfo>> unreleased_;  ///< spilled, planes still in memory, in queue order
+  bool spilling_ = false;                              ///< a copy to the spill file is going on, see SpillUnlocked
+  bool releasing_ = false;                             ///< frames popped may not be restored yet, see ReleaseSpilled
+  std::condition_variable spilled_cond_;               ///< releasing_ is done
+  std::mutex spill_mutex_;                             ///< guards spill_file_, never held together with data_mutex_
+  std::unique_ptr<SpillFile> spill_file_;
+  std::atomic<int> push_waiters_{0};
+  std::atomic<int> pop_waiters_{0};
+  mutable std::mutex data_mutex_;
+  std::condition_variable notempty_cond_;
+  std::condition_variable notfull_cond_;
+  ConveyorNotifier* notifier_ = nullptr;
+  std::vector<ConveyorNotifier*> space_waiters_;
+  std::atomic<int> space_waiter_cnt_{0};
   DISABLE_COPY_AND_ASSIGN(Conveyor);
 };  // class Conveyor
 
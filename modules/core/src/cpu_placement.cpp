@@ -0,0 +1,86 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#include "cpu_placement.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace cnstream {
+
+bool ParseCpuList(const std::string& str, std::vector<int>* cpus) {
+  cpus->clear();
+  std::istringstream ss(str);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+    if (range.empty()) return false;
+    size_t dash = range.find('-');
+    std::string first = range.substr(0, dash);
+    std::string last = std::string::npos == dash ? first : range.substr(dash + 1);
+    if (first.empty() || last.empty() || std::string::npos != first.find_first_not_of("0123456789") ||
+        std::string::npos != last.find_first_not_of("0123456789") || first.size() > 6 || last.size() > 6) {
+      return false;
+    }
+    int begin = std::stoi(first), end = std::stoi(last);
+    if (begin > end || end >= CPU_SETSIZE) return false;
+    for (int cpu = begin; cpu <= end; ++cpu) cpus->push_back(cpu);
+  }
+  std::sort(cpus->begin(), cpus->end());
+  cpus->erase(std::unique(cpus->begin(), cpus->end()), cpus->end());
+  return !cpus->empty();
+}
+
+std::string FormatCpuList(const std::vector<int>& cpus) {
+  std::string str;
+  for (size_t i = 0; i < cpus.size();) {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+    if (!str.empty()) str += ",";
+    str += std::to_string(cpus[i]);
+    if (j > i) str += "-" + std::to_string(cpus[j]);
+    i = j + 1;
+  }
+  return str;
+}
+
+std::vector<int> GetNumaNodeCpus(int numa_node) {
+  std::vector<int> cpus;
+  if (numa_node < 0) return cpus;
+  std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(numa_node) + "/cpulist");
+  std::string str;
+  if (!ifs.is_open() || !std::getline(ifs, str) || !ParseCpuList(str, &cpus)) cpus.clear();
+  return cpus;
+}
+
+bool PinCurrentThread(const std::vector<int>& cpus) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int cpu : cpus) CPU_SET(cpu, &cpu_set);
+  return 0 == pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+}
+
+}  // namespace cnstream
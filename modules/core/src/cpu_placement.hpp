@@ -0,0 +1,40 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#ifndef MODULES_CORE_INCLUDE_CPU_PLACEMENT_HPP_
+#define MODULES_CORE_INCLUDE_CPU_PLACEMENT_HPP_
+
+#include <string>
+#include <vector>
+
+namespace cnstream {
+
+/* "0-3,8" to {0, 1, 2, 3, 8}, sorted without duplicates. returns false if str is malformed */
+bool ParseCpuList(const std::string& str, std::vector<int>* cpus);
+/* {0, 1, 2, 3, 8} to "0-3,8" */
+std::string FormatCpuList(const std::vector<int>& cpus);
+/* cpus of a NUMA node, read from sysfs. empty if there is no such node */
+std::vector<int> GetNumaNodeCpus(int numa_node);
+/* restricts the calling thread to cpus, returns false if the system refused */
+bool PinCurrentThread(const std::vector<int>& cpus);
+
+}  // namespace cnstream
+
+#endif  // MODULES_CORE_INCLUDE_CPU_PLACEMENT_HPP_
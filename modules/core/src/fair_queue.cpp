@@ -0,0 +1,118 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#include "fair_queue.hpp"
+
+#include <algorithm>
+
+namespace cnstream {
+
+void FairQueue::Push(const CNFrameInfoPtr& data) {
+  Class& cls = classes_[data->priority];
+  auto iter = cls.flows.find(data->channel_idx);
+  if (cls.flows.end() == iter) {
+    iter = cls.flows.emplace(data->channel_idx, Flow()).first;
+    cls.active.push_back(data->channel_idx);
+  }
+  iter->second.weight = std::max<uint32_t>(1, data->weight);
+  iter->second.frames.push_back(Entry{next_seq_++, data});
+  size_++;
+}
+
+CNFrameInfoPtr FairQueue::Pop() {
+  for (auto class_iter = classes_.begin(); class_iter != classes_.end(); ++class_iter) {
+    Class& cls = class_iter->second;
+    if (cls.active.empty()) continue;
+    uint32_t chn_idx = cls.active.front();
+    Flow& flow = cls.flows[chn_idx];
+    if (0 == flow.deficit) flow.deficit = flow.weight;
+    flow.deficit--;
+    if (0 == flow.deficit && flow.frames.size() > 1) {
+      /* used up its share of this round */
+      cls.active.splice(cls.active.end(), cls.active, cls.active.begin());
+    }
+    return PopFrom(class_iter, chn_idx);
+  }
+  return nullptr;
+}
+
+CNFrameInfoPtr FairQueue::DropOne() {
+  auto longest_class = classes_.end();
+  uint32_t longest_chn = 0;
+  size_t longest_size = 0;
+  size_t longest_pos = 0;
+  for (auto class_iter = classes_.begin(); class_iter != classes_.end(); ++class_iter) {
+    for (auto& it : class_iter->second.flows) {
+      if (it.second.frames.size() <= longest_size) continue;
+      size_t pos = FirstDroppable(it.second);
+      if (pos == it.second.frames.size()) continue;
+      longest_class = class_iter;
+      longest_chn = it.first;
+      longest_size = it.second.frames.size();
+      longest_pos = pos;
+    }
+  }
+  if (classes_.end() == longest_class) return nullptr;
+  return PopFrom(longest_class, longest_chn, longest_pos);
+}
+
+CNFrameInfoPtr FairQueue::DropOldest() {
+  auto oldest_class = classes_.end();
+  uint32_t oldest_chn = 0;
+  uint64_t oldest_seq = 0;
+  size_t oldest_pos = 0;
+  for (auto class_iter = classes_.begin(); class_iter != classes_.end(); ++class_iter) {
+    for (auto& it : class_iter->second.flows) {
+      size_t pos = FirstDroppable(it.second);
+      if (pos == it.second.frames.size()) continue;
+      if (classes_.end() != oldest_class && it.second.frames[pos].seq >= oldest_seq) continue;
+      oldest_class = class_iter;
+      oldest_chn = it.first;
+      oldest_seq = it.second.frames[pos].seq;
+      oldest_pos = pos;
+    }
+  }
+  if (classes_.end() == oldest_class) return nullptr;
+  return PopFrom(oldest_class, oldest_chn, oldest_pos);
+}
+
+size_t FairQueue::FirstDroppable(const Flow& flow) {
+  size_t pos = 0;
+  while (pos < flow.frames.size() && (flow.frames[pos].data->frame.flags & CN_FRAME_FLAG_EOS)) pos++;
+  return pos;
+}
+
+CNFrameInfoPtr FairQueue::PopFrom(ClassIter class_iter, uint32_t chn_idx, size_t pos) {
+  Class& cls = class_iter->second;
+  auto flow_iter = cls.flows.find(chn_idx);
+  std::deque<Entry>& frames = flow_iter->second.frames;
+  CNFrameInfoPtr data = frames[pos].data;
+  frames.erase(frames.begin() + pos);
+  size_--;
+  if (frames.empty()) {
+    /* an idle stream starts the next round with a fresh share */
+    cls.flows.erase(flow_iter);
+    cls.active.remove(chn_idx);
+    if (cls.active.empty()) classes_.erase(class_iter);
+  }
+  return data;
+}
+
+}  // namespace cnstream
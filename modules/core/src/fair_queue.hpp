@@ -0,0 +1,88 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#ifndef MODULES_CORE_INCLUDE_FAIR_QUEUE_HPP_
+#define MODULES_CORE_INCLUDE_FAIR_QUEUE_HPP_
+
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+#include "cnstream_frame.hpp"
+
+namespace cnstream {
+
+using CNFrameInfoPtr = std::shared_ptr<CNFrameInfo>;
+
+/****************************************************************************
+ * @brief Data queue of a conveyor with QUEUE_IMPL_FAIR.
+ *
+ * Frames are queued per stream (channel_idx), so each stream stays in
+ * order. A stream belongs to the priority class of CNFrameInfo::priority,
+ * a class is only served while all the higher ones are empty. Within a
+ * class the streams are served by deficit round robin, each one gets
+ * CNFrameInfo::weight frames a round, so a stream which floods the queue
+ * only delays the others of its class by a round.
+ *
+ * Not thread-safe, guarded by the conveyor.
+ ****************************************************************************/
+class FairQueue {
+ public:
+  void Push(const CNFrameInfoPtr& data);
+  /* the next frame to serve, nullptr if empty */
+  CNFrameInfoPtr Pop();
+  /* drops the oldest frame of the longest stream, nullptr if nothing can be dropped. EOS frames are kept */
+  CNFrameInfoPtr DropOne();
+  /* drops the frame pushed first, nullptr if nothing can be dropped. EOS frames are kept */
+  CNFrameInfoPtr DropOldest();
+  size_t Size() const { return size_; }
+  bool Empty() const { return 0 == size_; }
+
+ private:
+  struct Entry {
+    uint64_t seq;  ///< push order
+    CNFrameInfoPtr data;
+  };
+  struct Flow {
+    std::deque<Entry> frames;
+    uint32_t weight = 1;
+    uint32_t deficit = 0;  ///< frames it may still send in this round
+  };
+  struct Class {
+    std::unordered_map<uint32_t, Flow> flows;  ///< only the streams with frames queued
+    std::list<uint32_t> active;                ///< round robin order of flows
+  };
+  using ClassIter = std::map<int, Class, std::greater<int>>::iterator;
+  /* the flow leaves its class when it has no frame left */
+  CNFrameInfoPtr PopFrom(ClassIter class_iter, uint32_t chn_idx, size_t pos = 0);
+  /* position of the first frame of flow which may be dropped, frames.size() if none */
+  static size_t FirstDroppable(const Flow& flow);
+
+  std::map<int, Class, std::greater<int>> classes_;  ///< highest priority first
+  size_t size_ = 0;
+  uint64_t next_seq_ = 0;
+};  // class FairQueue
+
+}  // namespace cnstream
+
+#endif  // MODULES_CORE_INCLUDE_FAIR_QUEUE_HPP_
@@ -0,0 +1,103 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+
+#include "frame_reorder.hpp"
+
+#include <glog/logging.h>
+#include <algorithm>
+
+namespace cnstream {
+
+void FrameReorder::Push(const CNFrameInfoPtr& data, const Release& release) {
+  std::lock_guard<std::mutex> lk(mutex_);
+  const uint32_t chn_idx = data->channel_idx;
+  StreamState& state = streams_[chn_idx];
+  const int64_t frame_id = data->frame.frame_id;
+
+  if (frame_id > state.next_id) {
+    if (state.held.emplace(frame_id, data).second) {
+      held_num_++;
+      return;
+    }
+    LOG(WARNING) << "Channel " << chn_idx << " frame " << frame_id << " is not unique, it is not reordered.";
+    release(data);
+    return;
+  }
+  if (frame_id < state.next_id) {
+    /* numbered from somewhere else, let it go as it is */
+    LOG(WARNING) << "Channel " << chn_idx << " frame " << frame_id << " comes after frame " << state.next_id - 1
+                 << ", it is not reordered.";
+    if (!ReleaseNext(&state, data, release)) streams_.erase(chn_idx);
+    return;
+  }
+
+  if (!ReleaseNext(&state, data, release) || !ReleaseHeld(&state, release)) streams_.erase(chn_idx);
+}
+
+void FrameReorder::Skip(const CNFrameInfoPtr& data, const Release& release) {
+  std::lock_guard<std::mutex> lk(mutex_);
+  const uint32_t chn_idx = data->channel_idx;
+  StreamState& state = streams_[chn_idx];
+  const int64_t frame_id = data->frame.frame_id;
+  if (frame_id < state.next_id) return;
+  state.skipped.insert(frame_id);
+  SkipDropped(&state);
+  /* the EOS may be held already, nothing else would release it */
+  if (!ReleaseHeld(&state, release)) streams_.erase(chn_idx);
+}
+
+bool FrameReorder::ReleaseHeld(StreamState* state, const Release& release) {
+  while (!state->held.empty() && state->held.begin()->first == state->next_id) {
+    CNFrameInfoPtr next = state->held.begin()->second;
+    state->held.erase(state->held.begin());
+    held_num_--;
+    if (!ReleaseNext(state, next, release)) return false;
+  }
+  return true;
+}
+
+void FrameReorder::SkipDropped(StreamState* state) {
+  while (!state->skipped.empty() && *state->skipped.begin() <= state->next_id) {
+    if (*state->skipped.begin() == state->next_id) state->next_id++;
+    state->skipped.erase(state->skipped.begin());
+  }
+}
+
+bool FrameReorder::ReleaseNext(StreamState* state, const CNFrameInfoPtr& data, const Release& release) {
+  release(data);
+  if (!(data->frame.flags & CN_FRAME_FLAG_EOS)) {
+    state->next_id = std::max(state->next_id, data->frame.frame_id + 1);
+    SkipDropped(state);
+    return true;
+  }
+  /* nothing of the stream should be left, a new stream on the channel is numbered from 0 again */
+  for (auto& it : state->held) release(it.second);
+  held_num_ -= state->held.size();
+  state->held.clear();
+  return false;
+}
+
+size_t FrameReorder::GetHeldNum() const {
+  std::lock_guard<std::mutex> lk(mutex_);
+  return held_num_;
+}
+
+}  // namespace cnstream
@@ -0,0 +1,83 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+
+#ifndef MODULES_CORE_INCLUDE_FRAME_REORDER_HPP_
+#define MODULES_CORE_INCLUDE_FRAME_REORDER_HPP_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+#include "cnstream_frame.hpp"
+
+namespace cnstream {
+
+using CNFrameInfoPtr = std::shared_ptr<CNFrameInfo>;
+
+/****************************************************************************
+ * @brief Puts the frames of each stream back in order of frame_id.
+ *
+ * Used on the links before modules which require frame order, when frames
+ * went through a link with DISPATCH_SPREAD on the way. Frames of a stream are
+ * numbered from 0 without gaps, and the EOS of a stream takes the number
+ * after its last frame (see Pipeline::ProvideData).
+ ****************************************************************************/
+class FrameReorder {
+ public:
+  using Release = std::function<void(const CNFrameInfoPtr&)>;
+
+  /*
+    takes data and calls release for each frame which is next in its stream, in order. release is called
+    under the lock of this object, so frames pushed by several threads reach the link in order too.
+   */
+  void Push(const CNFrameInfoPtr& data, const Release& release);
+
+  /* data was dropped on its way here and never comes, the frames after it are not held back for it */
+  void Skip(const CNFrameInfoPtr& data, const Release& release);
+
+  /* number of frames waiting for an earlier one */
+  size_t GetHeldNum() const;
+
+ private:
+  struct StreamState {
+    int64_t next_id = 0;
+    std::map<int64_t, CNFrameInfoPtr> held;
+    std::set<int64_t> skipped;  ///< dropped frames after next_id
+  };
+
+  /* releases data, returns false once the stream is over */
+  bool ReleaseNext(StreamState* state, const CNFrameInfoPtr& data, const Release& release);
+  /* releases the held frames which are next now, returns false once the stream is over */
+  bool ReleaseHeld(StreamState* state, const Release& release);
+  /* moves next_id past the skipped frames */
+  void SkipDropped(StreamState* state);
+
+  mutable std::mutex mutex_;
+  std::unordered_map<uint32_t, StreamState> streams_;  ///< by channel_idx
+  size_t held_num_ = 0;
+};  // class FrameReorder
+
+}  // namespace cnstream
+
+#endif  // MODULES_CORE_INCLUDE_FRAME_REORDER_HPP_
@@ -0,0 +1,98 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#include "module_task.hpp"
+
+#include <vector>
+
+namespace cnstream {
+
+ModuleTask*& ModuleTask::Current() {
+  static thread_local ModuleTask* current = nullptr;
+  return current;
+}
+
+void ModuleTask::Run() {
+  Current() = this;
+  RunFrames();
+  Current() = nullptr;
+}
+
+void ModuleTask::RunFrames() {
+  for (int i = 0; i < kMaxFramesPerRun; ++i) {
+    /* the worker waits here while the pipeline is paused */
+    PauseGate::Guard pause_guard(pause_gate_);
+    if (Park()) return;
+    /* wait for a frame in flight to be done */
+    if (async_queue_ && async_queue_->Park(this)) return;
+    size_t input_idx = 0;
+    CNFrameInfoPtr data = TryPopData(&input_idx);
+    if (nullptr == data.get()) {
+      /* exchange pairs with the one in Notify, data pushed before a failed Notify is seen by HasData */
+      scheduled_.exchange(false);
+      if (HasData()) Notify();
+      return;
+    }
+    /* scheduled_ is left set on failure, so the task is never queued again */
+    if (batch_size_ > 1) {
+      batch_.assign(1, data);
+      while (batch_.size() < batch_size_ && nullptr != (data = TryPopData(&input_idx)).get()) {
+        batch_.push_back(data);
+      }
+      if (!process_batch_(&batch_)) return;
+    } else if (!process_(input_idx, data)) {
+      return;
+    }
+  }
+  if (Park()) return;
+  /* give the other tasks on this worker a chance */
+  pool_->Submit(this, true);
+}
+
+bool ModuleTask::Park() {
+  while (!full_conveyors_.empty()) {
+    Conveyor* conveyor = full_conveyors_.back();
+    full_conveyors_.pop_back();
+    if (conveyor->WaitForSpace(this)) return true;
+  }
+  return false;
+}
+
+CNFrameInfoPtr ModuleTask::TryPopData(size_t* input_idx) {
+  const size_t count = connectors_.size();
+  for (size_t i = 0; i < count; ++i) {
+    *input_idx = (next_input_ + i) % count;
+    CNFrameInfoPtr data = connectors_[*input_idx]->TryPopDataBufferFromConveyor(conveyor_idx_);
+    if (nullptr != data.get()) {
+      next_input_ = (*input_idx + 1) % count;
+      return data;
+    }
+  }
+  return nullptr;
+}
+
+bool ModuleTask::HasData() const {
+  for (Connector* connector : connectors_) {
+    if (!connector->IsStopped() && connector->GetConveyor(conveyor_idx_)->GetBufferSize() > 0) return true;
+  }
+  return false;
+}
+
+}  // namespace cnstream
@@ -0,0 +1,109 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#ifndef MODULES_CORE_INCLUDE_MODULE_TASK_HPP_
+#define MODULES_CORE_INCLUDE_MODULE_TASK_HPP_
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "async_queue.hpp"
+#include "connector.hpp"
+#include "conveyor.hpp"
+#include "pause_gate.hpp"
+#include "worker_pool.hpp"
+
+namespace cnstream {
+
+/****************************************************************************
+ * @brief Runs one data queue of a module on the worker pool, in place of a
+ * TaskLoop thread.
+ *
+ * The task is queued or running at most once at a time (scheduled_), so the
+ * frames of the queue are processed one after another, in the same order as
+ * TaskLoop would do.
+ *
+ * Workers must never block on a full downstream queue, the task which would
+ * empty it may be waiting for a worker. So a task pushes without waiting,
+ * and when a queue it pushed to is full it parks itself on that queue (still
+ * scheduled) until the queue has space again.
+ ****************************************************************************/
+class ModuleTask : public ConveyorNotifier, public PoolTask {
+ public:
+  ModuleTask(WorkerPool* pool, PauseGate* pause_gate, const std::vector<Connector*>& connectors,
+             uint32_t conveyor_idx, std::function<bool(size_t, CNFrameInfoPtr)> process)
+      : pool_(pool),
+        pause_gate_(pause_gate),
+        connectors_(connectors),
+        conveyor_idx_(conveyor_idx),
+        process_(process) {}
+
+  /* called by conveyors after data is pushed */
+  void Notify() override {
+    if (!scheduled_.exchange(true)) pool_->Submit(this);
+  }
+
+  /* called by a full downstream conveyor this task parked on */
+  void NotifySpace() override { pool_->Submit(this); }
+
+  /* process_batch takes up to batch_size frames, only for modules with one input link. Call it before Notify */
+  void SetBatch(uint32_t batch_size, std::function<bool(std::vector<CNFrameInfoPtr>*)> process_batch) {
+    batch_size_ = batch_size;
+    process_batch_ = process_batch;
+  }
+
+  /* frames in flight of a module with Module::ProcessAsync. Call it before Notify */
+  void SetAsync(AsyncQueue* async_queue) { async_queue_ = async_queue; }
+
+  /* called by TransmitData on the worker thread when a push filled up the conveyor */
+  void AddFullConveyor(Conveyor* conveyor) { full_conveyors_.push_back(conveyor); }
+
+  /* the task running on this thread, nullptr if it is not a worker */
+  static ModuleTask*& Current();
+
+  void Run() override;
+
+ private:
+  static constexpr int kMaxFramesPerRun = 8;
+
+  void RunFrames();
+  /* returns true if the task parked on a full downstream conveyor */
+  bool Park();
+  CNFrameInfoPtr TryPopData(size_t* input_idx);
+  bool HasData() const;
+
+  WorkerPool* pool_ = nullptr;
+  PauseGate* pause_gate_ = nullptr;
+  std::vector<Connector*> connectors_;
+  uint32_t conveyor_idx_ = 0;
+  size_t next_input_ = 0;
+  std::function<bool(size_t, CNFrameInfoPtr)> process_;
+  uint32_t batch_size_ = 1;
+  std::function<bool(std::vector<CNFrameInfoPtr>*)> process_batch_;
+  std::vector<CNFrameInfoPtr> batch_;
+  AsyncQueue* async_queue_ = nullptr;
+  std::atomic<bool> scheduled_{false};
+  std::vector<Conveyor*> full_conveyors_;
+};  // class ModuleTask
+
+}  // namespace cnstream
+
+#endif  // MODULES_CORE_INCLUDE_MODULE_TASK_HPP_
@@ -0,0 +1,61 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#include "pause_gate.hpp"
+
+namespace cnstream {
+
+PauseGate*& PauseGate::Inside() {
+  static thread_local PauseGate* inside = nullptr;
+  return inside;
+}
+
+void PauseGate::Enter() {
+  while (true) {
+    busy_.fetch_add(1);
+    if (!closed_.load()) return;
+    Leave();
+    std::unique_lock<std::mutex> lk(mutex_);
+    cond_.wait(lk, [this] { return !closed_.load(); });
+  }
+}
+
+void PauseGate::Leave() {
+  if (1 == busy_.fetch_sub(1) && closed_.load()) {
+    std::lock_guard<std::mutex> lk(mutex_);
+    cond_.notify_all();
+  }
+}
+
+void PauseGate::Close() {
+  closed_.store(true);
+  std::unique_lock<std::mutex> lk(mutex_);
+  cond_.wait(lk, [this] { return 0 == busy_.load(); });
+}
+
+void PauseGate::Open() {
+  {
+    std::lock_guard<std::mutex> lk(mutex_);
+    closed_.store(false);
+  }
+  cond_.notify_all();
+}
+
+}  // namespace cnstream
@@ -0,0 +1,94 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#ifndef MODULES_CORE_INCLUDE_PAUSE_GATE_HPP_
+#define MODULES_CORE_INCLUDE_PAUSE_GATE_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+namespace cnstream {
+
+/****************************************************************************
+ * @brief Keeps the threads of the modules out while the pipeline is paused.
+ *
+ * Pipeline::Pause. The threads of the modules are inside the gate while they
+ * process data, Close waits for them to leave and keeps the others out until
+ * Open. Data already popped by a thread kept out is processed after Open, so
+ * nothing is dropped or processed twice.
+ *
+ * Same scheme as ConveyorWaiter: a thread counts itself in busy_ before it
+ * looks at closed_, Close sets closed_ before it looks at busy_, so one of
+ * them always sees the other.
+ *
+ * A thread blocked on a full data queue steps out of the gate (Unguard), it
+ * waits for a thread of the next module which may be kept out already. It
+ * steps in again once the data is pushed.
+ ****************************************************************************/
+class PauseGate {
+ public:
+  struct Guard {
+    explicit Guard(PauseGate* gate) : gate(gate), outer(Inside()) {
+      gate->Enter();
+      Inside() = gate;
+    }
+    ~Guard() {
+      Inside() = outer;
+      gate->Leave();
+    }
+    PauseGate* gate;
+    PauseGate* outer;
+  };
+  /* steps out of the gate the thread is inside, if any, for the scope */
+  struct Unguard {
+    Unguard() : gate(Inside()) {
+      if (!gate) return;
+      Inside() = nullptr;
+      gate->Leave();
+    }
+    ~Unguard() {
+      if (!gate) return;
+      gate->Enter();
+      Inside() = gate;
+    }
+    PauseGate* gate;
+  };
+
+  void Enter();
+  void Leave();
+  /* blocks until no thread is inside */
+  void Close();
+  void Open();
+  bool IsClosed() const { return closed_.load(); }
+
+ private:
+  /* the gate the calling thread is inside */
+  static PauseGate*& Inside();
+
+  std::atomic<int> busy_{0};
+  std::atomic<bool> closed_{false};
+  std::mutex mutex_;
+  std::condition_variable cond_;
+};  // class PauseGate
+
+}  // namespace cnstream
+
+#endif  // MODULES_CORE_INCLUDE_PAUSE_GATE_HPP_
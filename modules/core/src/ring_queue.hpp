@@ -0,0 +1,180 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#ifndef MODULES_CORE_INCLUDE_RING_QUEUE_HPP_
+#define MODULES_CORE_INCLUDE_RING_QUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+namespace cnstream {
+
+#ifndef CNS_CACHE_LINE_SIZE
+#define CNS_CACHE_LINE_SIZE 64
+#endif
+
+/****************************************************************************
+ * @brief Bounded lock-free ring buffer.
+ *
+ * All cells are allocated once in the constructor and every cell takes at
+ * least one cache line. Each cell carries a sequence number (D. Vyukov's
+ * bounded MPMC queue), which tells producers and consumers whether the cell
+ * is free or holds data.
+ *
+ * When there is only one producer (or one consumer) the position of that
+ * side is advanced by a plain store instead of a CAS loop. A side declared
+ * single must never be used by more than one thread at the same time.
+ *
+ * TryPush/TryPop never block, blocking is left to the caller.
+ ****************************************************************************/
+template <typename T>
+class RingQueue {
+ public:
+  RingQueue(size_t capacity, bool single_producer = false, bool single_consumer = false);
+  ~RingQueue();
+  RingQueue(const RingQueue& other) = delete;
+  RingQueue& operator=(const RingQueue& other) = delete;
+
+  bool TryPush(T&& value);
+  bool TryPush(const T& value) {
+    T copy(value);
+    return TryPush(std::move(copy));
+  }
+
+  bool TryPop(T& value);
+
+  /* no other thread may use the queue while it is being set */
+  void SetSingleProducer(bool single_producer) { single_producer_ = single_producer; }
+
+  /* approximate when other threads are pushing or popping at the same time */
+  size_t Size() const {
+    size_t dequeue_pos = dequeue_pos_.load(std::memory_order_acquire);
+    size_t enqueue_pos = enqueue_pos_.load(std::memory_order_acquire);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+  }
+  bool Empty() const { return 0 == Size(); }
+  size_t Capacity() const { return mask_ + 1; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+  /* round every cell up to whole cache lines */
+  static constexpr size_t kCellSize =
+      (sizeof(Cell) + CNS_CACHE_LINE_SIZE - 1) / CNS_CACHE_LINE_SIZE * CNS_CACHE_LINE_SIZE;
+
+  Cell* GetCell(size_t pos) const { return reinterpret_cast<Cell*>(cells_ + (pos & mask_) * kCellSize); }
+
+  char pad0_[CNS_CACHE_LINE_SIZE];
+  void* buffer_ = nullptr;
+  char* cells_ = nullptr;
+  size_t mask_ = 0;
+  bool single_producer_ = false;
+  bool single_consumer_ = false;
+  char pad1_[CNS_CACHE_LINE_SIZE];
+  std::atomic<size_t> enqueue_pos_{0};
+  char pad2_[CNS_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> dequeue_pos_{0};
+  char pad3_[CNS_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+};
+
+template <typename T>
+RingQueue<T>::RingQueue(size_t capacity, bool single_producer, bool single_consumer)
+    : single_producer_(single_producer), single_consumer_(single_consumer) {
+  size_t size = 2;
+  while (size < capacity) size <<= 1;
+  mask_ = size - 1;
+  buffer_ = malloc(size * kCellSize + CNS_CACHE_LINE_SIZE);
+  if (nullptr == buffer_) throw std::bad_alloc();
+  uintptr_t addr = reinterpret_cast<uintptr_t>(buffer_);
+  cells_ = reinterpret_cast<char*>((addr + CNS_CACHE_LINE_SIZE - 1) & ~(uintptr_t)(CNS_CACHE_LINE_SIZE - 1));
+  for (size_t i = 0; i < size; ++i) {
+    Cell* cell = new (cells_ + i * kCellSize) Cell();
+    cell->sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <typename T>
+RingQueue<T>::~RingQueue() {
+  for (size_t i = 0; i <= mask_; ++i) {
+    GetCell(i)->~Cell();
+  }
+  free(buffer_);
+}
+
+template <typename T>
+bool RingQueue<T>::TryPush(T&& value) {
+  Cell* cell;
+  size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+  for (;;) {
+    cell = GetCell(pos);
+    size_t seq = cell->sequence.load(std::memory_order_acquire);
+    intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+    if (0 == dif) {
+      if (single_producer_) {
+        enqueue_pos_.store(pos + 1, std::memory_order_relaxed);
+        break;
+      }
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (dif < 0) {
+      return false;  // full
+    } else {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  cell->data = std::move(value);
+  cell->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T>
+bool RingQueue<T>::TryPop(T& value) {
+  Cell* cell;
+  size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+  for (;;) {
+    cell = GetCell(pos);
+    size_t seq = cell->sequence.load(std::memory_order_acquire);
+    intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+    if (0 == dif) {
+      if (single_consumer_) {
+        dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+        break;
+      }
+      if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (dif < 0) {
+      return false;  // empty
+    } else {
+      pos = dequeue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  value = std::move(cell->data);
+  cell->data = T();
+  cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+  return true;
+}
+
+}  // namespace cnstream
+
+#endif  // MODULES_CORE_INCLUDE_RING_QUEUE_HPP_
@@ -0,0 +1,70 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#ifndef MODULES_CORE_INCLUDE_ROUTE_NODE_HPP_
+#define MODULES_CORE_INCLUDE_ROUTE_NODE_HPP_
+
+#include <memory>
+#include <vector>
+
+#include "async_queue.hpp"
+#include "cnstream_module.hpp"
+#include "cnstream_pipeline.hpp"
+#include "cnstream_timer.hpp"
+#include "connector.hpp"
+#include "conveyor.hpp"
+#include "frame_reorder.hpp"
+
+namespace cnstream {
+
+/****************************************************************************
+ * @brief Routing entry of a module, indexed by Module::GetId().
+ *
+ * Pipeline::Start compiles them from the modules and links of the pipeline,
+ * and they are not changed while the pipeline is running, so the per frame
+ * path reads them without locks, hashing or string work.
+ ****************************************************************************/
+struct RouteNode {
+  Module* module = nullptr;
+  uint64_t join_mask = 0;  ///< all the input links, only for modules with more than one
+  std::vector<Connector*> inputs;
+  std::vector<Connector*> outputs;
+  CNTimer* timers = nullptr;  ///< one for each data queue
+  std::vector<ConveyorWaiter*> waiters;
+  std::vector<std::shared_ptr<AsyncQueue>> async_queues;  ///< one for each data queue, see Module::ProcessAsync
+  std::vector<FrameReorder*> reorders;  ///< one for each output link, nullptr if frames go through as they are
+  bool fused = false;      ///< processes frames on the thread of its upstream module, see DisableModuleFusion
+  bool fuse_next = false;  ///< the module of the only output link is fused
+  size_t next_idx = 0;     ///< node of that module
+  std::vector<int> cpus;   ///< threads of the module are pinned to, empty for any
+  int memory_node = -1;    ///< NUMA node CNStreamMallocHost allocates on for threads of the module
+  uint32_t join_timeout_ms = 0;
+  Connector* join_timeout_input = nullptr;  ///< last of inputs, frames forwarded by the join timeout come from it
+  std::vector<const RoutePredicate*> routes;  ///< one for each output link, nullptr if all frames pass
+  std::vector<size_t> output_nodes;           ///< one for each output link
+  std::vector<bool> routes_through;  ///< frames which do not pass are passed on, to complete joins downstream
+};
+
+/* frames handed to Module::ProcessBatch at once, 1 if the module does not process batches */
+uint32_t BatchSize(const RouteNode& node);
+
+}  // namespace cnstream
+
+#endif  // MODULES_CORE_INCLUDE_ROUTE_NODE_HPP_
@@ -0,0 +1,164 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#include "spill_file.hpp"
+
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace cnstream {
+
+namespace {
+/* written before the planes of each frame */
+struct RecordHeader {
+  uint32_t magic;
+  int32_t fmt;
+  int32_t width;
+  int32_t height;
+  int32_t stride[CN_MAX_PLANES];
+  int64_t frame_id;
+  uint64_t plane_bytes;
+};
+constexpr uint32_t kRecordMagic = 0x434e5350;  // "CNSP"
+constexpr size_t kRecordAlign = 64;
+constexpr size_t kMinCapacity = 16 << 20;
+}  // namespace
+
+std::unique_ptr<SpillFile> SpillFile::Create(const std::string& dir) {
+  std::string path = dir;
+  if (path.empty()) {
+    const char* tmp_dir = getenv("TMPDIR");
+    path = tmp_dir && *tmp_dir ? tmp_dir : "/tmp";
+  }
+  path += "/cnstream_spill_XXXXXX";
+  std::vector<char> name(path.begin(), path.end());
+  name.push_back('\0');
+  int fd = mkstemp(name.data());
+  if (fd < 0) {
+    LOG(ERROR) << "Create spill file " << path << " failed: " << strerror(errno);
+    return nullptr;
+  }
+  unlink(name.data());
+  std::unique_ptr<SpillFile> file(new SpillFile);
+  file->fd_ = fd;
+  return file;
+}
+
+SpillFile::~SpillFile() {
+  if (map_) munmap(map_, capacity_);
+  if (fd_ >= 0) close(fd_);
+}
+
+bool SpillFile::Grow(size_t capacity) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  capacity = (capacity + page_size - 1) / page_size * page_size;
+  int ret = posix_fallocate(fd_, 0, capacity);
+  if (0 != ret) {
+    LOG(WARNING) << "Grow spill file to " << capacity << " bytes failed: " << strerror(ret);
+    return false;
+  }
+  void* map = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (MAP_FAILED == map) {
+    LOG(WARNING) << "Map spill file of " << capacity << " bytes failed: " << strerror(errno);
+    return false;
+  }
+  if (map_) munmap(map_, capacity_);
+  map_ = static_cast<uint8_t*>(map);
+  capacity_ = capacity;
+  return true;
+}
+
+bool SpillFile::Reserve(size_t bytes, size_t* offset) {
+  if (records_.empty()) head_ = tail_ = 0;
+  if (capacity_ - tail_ < bytes && head_ >= capacity_ / 2) {
+    /* the restored records take half of the file, move the others to its start */
+    memmove(map_, map_ + head_, tail_ - head_);
+    for (Record& it : records_) it.offset -= head_;
+    tail_ -= head_;
+    head_ = 0;
+  }
+  if (capacity_ - tail_ < bytes && !Grow(std::max({kMinCapacity, 2 * capacity_, tail_ + bytes}))) return false;
+  *offset = tail_;
+  tail_ += bytes;
+  return true;
+}
+
+bool SpillFile::Spill(const CNFrameInfoPtr& data) {
+  CNDataFrame& frame = data->frame;
+  if (!frame.IsSpillable()) return false;
+  const size_t plane_bytes = frame.GetBytes();
+  const size_t bytes = (sizeof(RecordHeader) + plane_bytes + kRecordAlign - 1) / kRecordAlign * kRecordAlign;
+  size_t offset = 0;
+  if (!Reserve(bytes, &offset)) return false;
+  RecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kRecordMagic;
+  header.fmt = frame.fmt;
+  header.width = frame.width;
+  header.height = frame.height;
+  for (int i = 0; i < frame.GetPlanes(); ++i) header.stride[i] = frame.stride[i];
+  header.frame_id = frame.frame_id;
+  header.plane_bytes = plane_bytes;
+  memcpy(map_ + offset, &header, sizeof(header));
+  frame.SpillPlanes(map_ + offset + sizeof(header));
+  records_.push_back(Record{data.get(), offset, bytes, false});
+  return true;
+}
+
+std::deque<SpillFile::Record>::iterator SpillFile::Find(const CNFrameInfoPtr& data) {
+  /* mostly the first one, threads popping several frames at once may come in another order */
+  return std::find_if(records_.begin(), records_.end(), [&](const Record& it) { return it.data == data.get(); });
+}
+
+bool SpillFile::Release(const CNFrameInfoPtr& data) {
+  auto iter = Find(data);
+  if (records_.end() == iter || iter->released || !data->frame.IsSpillable()) return false;
+  data->frame.ReleasePlanes();
+  iter->released = true;
+  return true;
+}
+
+bool SpillFile::Restore(const CNFrameInfoPtr& data) {
+  auto iter = Find(data);
+  if (records_.end() == iter) return false;
+  const Record record = *iter;
+  records_.erase(iter);
+  head_ = records_.empty() ? tail_ : records_.front().offset;
+  if (!record.released) return true;
+  CNDataFrame& frame = data->frame;
+  RecordHeader header;
+  memcpy(&header, map_ + record.offset, sizeof(header));
+  LOG_IF(FATAL, kRecordMagic != header.magic || frame.frame_id != header.frame_id || frame.width != header.width ||
+                    frame.height != header.height || frame.GetBytes() != header.plane_bytes)
+      << "Spill file corrupted at frame " << frame.frame_id << " of stream " << frame.stream_id;
+  frame.RestorePlanes(map_ + record.offset + sizeof(header));
+  return true;
+}
+
+}  // namespace cnstream
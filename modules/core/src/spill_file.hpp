@@ -0,0 +1,91 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#ifndef MODULES_CORE_INCLUDE_SPILL_FILE_HPP_
+#define MODULES_CORE_INCLUDE_SPILL_FILE_HPP_
+
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "cnstream_frame.hpp"
+
+namespace cnstream {
+
+using CNFrameInfoPtr = std::shared_ptr<CNFrameInfo>;
+
+/****************************************************************************
+ * @brief Scratch file a conveyor with QUEUE_IMPL_SPILL spills the planes of
+ * frames to.
+ *
+ * Frames are mostly restored in the order they have been spilled. A record
+ * is a small header, the frame info it is checked against on restore,
+ * followed by the planes back to back. The planes stay in memory until
+ * they are released, the frame itself and its objects stay in memory.
+ *
+ * The file is mapped in memory and unlinked at once, nothing is left behind
+ * whatever way the process ends. Blocks are allocated before they are
+ * written, so a full disk fails a spill instead of faulting. Records are
+ * appended, the space of the restored ones is reused once all are restored,
+ * or once they take half of the file.
+ *
+ * Not thread-safe, guarded by the conveyor.
+ ****************************************************************************/
+class SpillFile {
+ public:
+  /* nullptr if the file can not be created in dir, empty dir for $TMPDIR or /tmp */
+  static std::unique_ptr<SpillFile> Create(const std::string& dir);
+  ~SpillFile();
+  /* copies the planes of data to the file, returns false if they can not be, see CNDataFrame::IsSpillable */
+  bool Spill(const CNFrameInfoPtr& data);
+  /* frees the planes of data spilled, nobody else may hold data. returns false if they stay in memory */
+  bool Release(const CNFrameInfoPtr& data);
+  /* copies the planes of data back if they have been released, and forgets them. false if they are not spilled */
+  bool Restore(const CNFrameInfoPtr& data);
+  /* number of frames spilled and not restored yet */
+  size_t Size() const { return records_.size(); }
+  size_t Capacity() const { return capacity_; }
+
+ private:
+  SpillFile() = default;
+  /* offset to write bytes at, grows or compacts the file if needed. returns false if the file can not grow */
+  bool Reserve(size_t bytes, size_t* offset);
+  bool Grow(size_t capacity);
+
+  struct Record {
+    const CNFrameInfo* data;
+    size_t offset;
+    size_t bytes;   ///< header included
+    bool released;  ///< the planes are freed, see Release
+  };
+  std::deque<Record>::iterator Find(const CNFrameInfoPtr& data);
+
+  int fd_ = -1;
+  uint8_t* map_ = nullptr;
+  size_t capacity_ = 0;
+  size_t head_ = 0;  ///< offset of the first record not restored
+  size_t tail_ = 0;  ///< offset the next record is written at
+  std::deque<Record> records_;
+  DISABLE_COPY_AND_ASSIGN(SpillFile);
+};  // class SpillFile
+
+}  // namespace cnstream
+
+#endif  // MODULES_CORE_INCLUDE_SPILL_FILE_HPP_
@@ -0,0 +1,279 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#include "stream_dispatcher.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace cnstream {
+
+/* virtual nodes of each conveyor on the hash ring */
+static const uint32_t kVirtualNodes = 64;
+/* a conveyor takes at most (1 + kHashLoadSlack) * average streams */
+static const double kHashLoadSlack = 0.25;
+/* a stream moves only if the other conveyor would be lighter by this fraction */
+static const double kRepinMargin = 0.05;
+/* stream loads are averaged over windows of this length */
+static const std::chrono::milliseconds kLoadWindow(200);
+
+static uint32_t HashUint32(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352d;
+  x ^= x >> 15;
+  x *= 0x846ca68b;
+  x ^= x >> 16;
+  return x;
+}
+
+StreamDispatcher::StreamDispatcher(DispatchPolicy policy, size_t conveyor_count)
+    : policy_(policy),
+      conveyor_count_(static_cast<uint32_t>(conveyor_count)),
+      active_count_(static_cast<uint32_t>(conveyor_count)),
+      dispatched_(new std::atomic<uint64_t>[conveyor_count]),
+      busy_us_(new std::atomic<uint64_t>[conveyor_count]),
+      in_flight_(new std::atomic<uint32_t>[conveyor_count]) {
+  for (uint32_t i = 0; i < conveyor_count_; ++i) {
+    dispatched_[i] = 0;
+    busy_us_[i] = 0;
+    in_flight_[i] = 0;
+  }
+  conveyor_load_.resize(conveyor_count_, 0);
+  conveyor_streams_.resize(conveyor_count_, 0);
+  for (uint32_t i = 0; i < conveyor_count_; ++i) {
+    for (uint32_t v = 0; v < kVirtualNodes; ++v) {
+      hash_ring_.emplace_back(HashUint32(i * kVirtualNodes + v + 1), i);
+    }
+  }
+  std::sort(hash_ring_.begin(), hash_ring_.end());
+  window_start_ = std::chrono::steady_clock::now();
+}
+
+void StreamDispatcher::SetPolicy(DispatchPolicy policy) {
+  std::lock_guard<std::mutex> lk(mutex_);
+  policy_ = policy;
+  streams_.clear();
+  std::fill(conveyor_load_.begin(), conveyor_load_.end(), 0);
+  std::fill(conveyor_streams_.begin(), conveyor_streams_.end(), 0);
+}
+
+void StreamDispatcher::SetActiveCount(uint32_t active_count) {
+  std::lock_guard<std::mutex> lk(mutex_);
+  active_count_ = std::max<uint32_t>(1, std::min(active_count, conveyor_count_));
+  epoch_++;
+}
+
+int StreamDispatcher::Dispatch(const CNFrameInfoPtr& data) {
+  const uint32_t chn_idx = data->channel_idx;
+  if (!Pinned() || conveyor_count_ <= 1) {
+    uint32_t conveyor_idx = conveyor_count_ ? chn_idx % conveyor_count_ : 0;
+    dispatched_[conveyor_idx].fetch_add(1, std::memory_order_relaxed);
+    return conveyor_idx;
+  }
+  if (DISPATCH_SPREAD == policy_) {
+    uint32_t conveyor_idx = PickSpread(active_count_.load(std::memory_order_relaxed));
+    in_flight_[conveyor_idx].fetch_add(1, std::memory_order_relaxed);
+    dispatched_[conveyor_idx].fetch_add(1, std::memory_order_relaxed);
+    return conveyor_idx;
+  }
+
+  std::lock_guard<std::mutex> lk(mutex_);
+  auto iter = streams_.find(chn_idx);
+  if (streams_.end() == iter) {
+    StreamState state;
+    state.epoch = epoch_;
+    Pin(&state, Pick(chn_idx, nullptr));
+    iter = streams_.emplace(chn_idx, state).first;
+  } else if (iter->second.moving) {
+    iter->second.parked.push_back(data);
+    return kParked;
+  } else if (0 == iter->second.in_flight || iter->second.epoch != epoch_) {
+    /* at a safe point (nothing of the stream is left on this link), or the active conveyors changed */
+    StreamState& state = iter->second;
+    state.epoch = epoch_;
+    uint32_t target = Pick(chn_idx, &state);
+    if (target != state.conveyor_idx) {
+      Unpin(state);
+      Pin(&state, target);
+      if (state.in_flight > 0) {
+        /* not before the old conveyor is done with the stream, see Done */
+        state.moving = true;
+        state.parked.push_back(data);
+        return kParked;
+      }
+    }
+  }
+  StreamState& state = iter->second;
+  state.in_flight++;
+  dispatched_[state.conveyor_idx].fetch_add(1, std::memory_order_relaxed);
+  return state.conveyor_idx;
+}
+
+void StreamDispatcher::Done(uint32_t conveyor_idx, const CNFrameInfoPtr& data, double cost_ms, Released* released) {
+  if (conveyor_idx >= conveyor_count_) return;
+  busy_us_[conveyor_idx].fetch_add(static_cast<uint64_t>(cost_ms * 1000), std::memory_order_relaxed);
+  if (!Pinned() || conveyor_count_ <= 1) return;
+  if (DISPATCH_SPREAD == policy_) {
+    /* frames left over by a stopped run may be done after Reset */
+    uint32_t in_flight = in_flight_[conveyor_idx].load(std::memory_order_relaxed);
+    while (in_flight > 0 && !in_flight_[conveyor_idx].compare_exchange_weak(in_flight, in_flight - 1,
+                                                                            std::memory_order_relaxed)) {
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> lk(mutex_);
+  auto iter = streams_.find(data->channel_idx);
+  if (streams_.end() != iter) {
+    StreamState& state = iter->second;
+    if (state.in_flight > 0) state.in_flight--;
+    state.window_busy_ms += cost_ms;
+    if (0 == state.in_flight && state.moving) {
+      ReleaseParked(&state, released);
+    } else if ((data->frame.flags & CN_FRAME_FLAG_EOS) && 0 == state.in_flight) {
+      /* the stream is over, a stream reusing the channel is placed from scratch */
+      Unpin(state);
+      streams_.erase(iter);
+    }
+  }
+  if (std::chrono::steady_clock::now() - window_start_ >= kLoadWindow) RollLoadWindow();
+}
+
+void StreamDispatcher::Reset(Released* released) {
+  std::lock_guard<std::mutex> lk(mutex_);
+  for (auto& it : streams_) {
+    it.second.in_flight = 0;
+    if (it.second.moving) ReleaseParked(&it.second, released);
+  }
+  for (uint32_t i = 0; i < conveyor_count_; ++i) in_flight_[i] = 0;
+}
+
+void StreamDispatcher::ReleaseParked(StreamState* state, Released* released) {
+  state->moving = false;
+  state->in_flight = static_cast<uint32_t>(state->parked.size());
+  dispatched_[state->conveyor_idx].fetch_add(state->parked.size(), std::memory_order_relaxed);
+  for (auto& it : state->parked) released->emplace_back(state->conveyor_idx, it);
+  state->parked.clear();
+}
+
+void StreamDispatcher::GetStatus(LinkStatus* status) const {
+  status->dispatched.clear();
+  status->busy_ms.clear();
+  for (uint32_t i = 0; i < conveyor_count_; ++i) {
+    status->dispatched.push_back(dispatched_[i].load(std::memory_order_relaxed));
+    status->busy_ms.push_back(busy_us_[i].load(std::memory_order_relaxed) / 1000.0);
+  }
+  status->active_cnt = active_count_.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lk(mutex_);
+  status->stream_cnt = conveyor_streams_;
+}
+
+uint32_t StreamDispatcher::PickSpread(uint32_t active_count) {
+  /* the counts are read without a lock, a slightly stale one only makes a slightly worse choice */
+  uint32_t start = next_.fetch_add(1, std::memory_order_relaxed) % active_count;
+  uint32_t best = start;
+  uint32_t best_in_flight = in_flight_[start].load(std::memory_order_relaxed);
+  for (uint32_t i = 1; i < active_count && best_in_flight > 0; ++i) {
+    uint32_t conveyor_idx = (start + i) % active_count;
+    uint32_t in_flight = in_flight_[conveyor_idx].load(std::memory_order_relaxed);
+    if (in_flight < best_in_flight) {
+      best = conveyor_idx;
+      best_in_flight = in_flight;
+    }
+  }
+  return best;
+}
+
+uint32_t StreamDispatcher::Pick(uint32_t chn_idx, const StreamState* state) const {
+  if (DISPATCH_MODULO == policy_) return chn_idx % active_count_;
+  if (DISPATCH_CONSISTENT_HASH == policy_) return PickConsistentHash(chn_idx, state);
+  return PickLeastLoaded(state);
+}
+
+uint32_t StreamDispatcher::PickLeastLoaded(const StreamState* state) const {
+  const uint32_t active_count = active_count_;
+  /* lowest load, then fewest streams; the stream's own share does not count */
+  auto cost = [&](uint32_t i) -> std::pair<double, uint32_t> {
+    if (state && state->conveyor_idx == i) {
+      return std::make_pair(conveyor_load_[i] - state->load, conveyor_streams_[i] - 1);
+    }
+    return std::make_pair(conveyor_load_[i], conveyor_streams_[i]);
+  };
+  uint32_t best = 0;
+  for (uint32_t i = 1; i < active_count; ++i) {
+    if (cost(i) < cost(best)) best = i;
+  }
+  if (state && best != state->conveyor_idx && state->conveyor_idx < active_count) {
+    /* stay unless it is clearly better over there */
+    if (conveyor_load_[best] + state->load >= conveyor_load_[state->conveyor_idx] * (1 - kRepinMargin)) {
+      return state->conveyor_idx;
+    }
+  }
+  return best;
+}
+
+uint32_t StreamDispatcher::PickConsistentHash(uint32_t chn_idx, const StreamState* state) const {
+  const uint32_t active_count = active_count_;
+  uint32_t total = static_cast<uint32_t>(streams_.size()) + (state ? 0 : 1);
+  double bound = (1 + kHashLoadSlack) * total / active_count;
+  uint32_t max_streams = std::max<uint32_t>(1, static_cast<uint32_t>(bound + 0.999999));
+  /* a placed stream stays unless its conveyor is over the bound or no longer active */
+  if (state && state->conveyor_idx < active_count && conveyor_streams_[state->conveyor_idx] - 1 < max_streams) {
+    return state->conveyor_idx;
+  }
+  auto pos = std::lower_bound(hash_ring_.begin(), hash_ring_.end(), std::make_pair(HashUint32(chn_idx), 0u));
+  for (size_t i = 0; i < hash_ring_.size(); ++i, ++pos) {
+    if (hash_ring_.end() == pos) pos = hash_ring_.begin();
+    uint32_t conveyor_idx = pos->second;
+    if (conveyor_idx >= active_count) continue;
+    uint32_t streams = conveyor_streams_[conveyor_idx];
+    if (state && state->conveyor_idx == conveyor_idx) streams--;
+    if (streams < max_streams) return conveyor_idx;
+  }
+  return state && state->conveyor_idx < active_count ? state->conveyor_idx : chn_idx % active_count;
+}
+
+void StreamDispatcher::Pin(StreamState* state, uint32_t conveyor_idx) {
+  state->conveyor_idx = conveyor_idx;
+  conveyor_streams_[conveyor_idx]++;
+  conveyor_load_[conveyor_idx] += state->load;
+}
+
+void StreamDispatcher::Unpin(const StreamState& state) {
+  conveyor_streams_[state.conveyor_idx]--;
+  conveyor_load_[state.conveyor_idx] -= state.load;
+}
+
+void StreamDispatcher::RollLoadWindow() {
+  auto now = std::chrono::steady_clock::now();
+  double window_ms = std::chrono::duration<double, std::milli>(now - window_start_).count();
+  window_start_ = now;
+  std::fill(conveyor_load_.begin(), conveyor_load_.end(), 0);
+  for (auto& it : streams_) {
+    StreamState& state = it.second;
+    state.load = 0.5 * state.load + 0.5 * state.window_busy_ms / window_ms;
+    state.window_busy_ms = 0;
+    conveyor_load_[state.conveyor_idx] += state.load;
+  }
+}
+
+}  // namespace cnstream
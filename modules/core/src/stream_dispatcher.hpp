@@ -0,0 +1,140 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#ifndef MODULES_CORE_INCLUDE_STREAM_DISPATCHER_HPP_
+#define MODULES_CORE_INCLUDE_STREAM_DISPATCHER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cnstream_frame.hpp"
+#include "cnstream_pipeline.hpp"
+
+namespace cnstream {
+
+using CNFrameInfoPtr = std::shared_ptr<CNFrameInfo>;
+
+/****************************************************************************
+ * @brief Picks the data queue (conveyor) of a connector for each frame.
+ *
+ * DISPATCH_MODULO keeps the fixed channel_idx % conveyor_count mapping.
+ *
+ * DISPATCH_SPREAD does not keep streams together, each frame goes to the
+ * conveyor with the fewest frames in flight (queued or being processed).
+ *
+ * The other policies pin a stream to a conveyor the first time it is seen.
+ * A pinned stream is only moved while none of its frames is queued or
+ * being processed on this link (which is always true after its EOS), so
+ * the frames of a stream are still processed one after another in order.
+ *
+ * DISPATCH_LEAST_LOADED moves a stream to the conveyor with the lowest
+ * recent busy time, if that is clearly better than staying.
+ * DISPATCH_CONSISTENT_HASH hashes the stream onto a ring of virtual nodes
+ * and skips conveyors which already hold more than their share of
+ * streams (consistent hashing with bounded loads).
+ *
+ * Only the first active_count conveyors are dispatched to. For an elastic
+ * link the count changes at runtime (see Pipeline::SetModuleParallelismRange),
+ * DISPATCH_MODULO pins streams too (to channel_idx % active_count), and every
+ * stream is placed again after a change. A stream which has to move while
+ * frames of it are still in flight is fenced: its new frames are parked here
+ * and released to the new conveyor once the old one is done with the rest.
+ ****************************************************************************/
+class StreamDispatcher {
+ public:
+  StreamDispatcher(DispatchPolicy policy, size_t conveyor_count);
+
+  DispatchPolicy GetPolicy() const { return policy_; }
+  /* no other thread may use the dispatcher while it is being set */
+  void SetPolicy(DispatchPolicy policy);
+
+  /* (conveyor_idx, frame) to be pushed by the caller */
+  using Released = std::vector<std::pair<uint32_t, CNFrameInfoPtr>>;
+  static constexpr int kParked = -1;
+
+  /* call it before Start. DISPATCH_MODULO pins streams on an elastic link */
+  void SetElastic(bool elastic) { elastic_ = elastic; }
+  uint32_t GetActiveCount() const { return active_count_.load(std::memory_order_relaxed); }
+  /* streams are moved to the first active_count conveyors, as they get new frames */
+  void SetActiveCount(uint32_t active_count);
+
+  /*
+    picks the conveyor of data, which is then counted in flight until Done. returns kParked if data is
+    kept until its stream moved, it is released by Done or Reset then.
+   */
+  int Dispatch(const CNFrameInfoPtr& data);
+  /* data dispatched to conveyor_idx is done with, cost_ms was spent processing it */
+  void Done(uint32_t conveyor_idx, const CNFrameInfoPtr& data, double cost_ms, Released* released);
+  /* forget frames in flight, e.g. the ones left in the queues when the pipeline stopped */
+  void Reset(Released* released);
+
+  void GetStatus(LinkStatus* status) const;
+
+ private:
+  struct StreamState {
+    uint32_t conveyor_idx = 0;
+    uint32_t in_flight = 0;
+    double load = 0;            ///< recent busy time per second
+    double window_busy_ms = 0;  ///< busy time in the current load window
+    uint64_t epoch = 0;         ///< placed for this active count
+    bool moving = false;        ///< frames in flight are on the old conveyor, new ones are parked
+    std::vector<CNFrameInfoPtr> parked;
+  };
+
+  bool Pinned() const { return DISPATCH_MODULO != policy_ || elastic_; }
+  uint32_t PickSpread(uint32_t active_count);
+  /* the stream moved, parked frames go to its conveyor */
+  void ReleaseParked(StreamState* state, Released* released);
+  uint32_t Pick(uint32_t chn_idx, const StreamState* state) const;
+  uint32_t PickLeastLoaded(const StreamState* state) const;
+  uint32_t PickConsistentHash(uint32_t chn_idx, const StreamState* state) const;
+  void Pin(StreamState* state, uint32_t conveyor_idx);
+  void Unpin(const StreamState& state);
+  void RollLoadWindow();
+
+  DispatchPolicy policy_;
+  const uint32_t conveyor_count_;
+  bool elastic_ = false;
+  std::atomic<uint32_t> active_count_;
+  std::unique_ptr<std::atomic<uint64_t>[]> dispatched_;
+  std::unique_ptr<std::atomic<uint64_t>[]> busy_us_;
+
+  /* DISPATCH_SPREAD only */
+  std::unique_ptr<std::atomic<uint32_t>[]> in_flight_;
+  std::atomic<uint32_t> next_{0};  ///< where the search for the emptiest conveyor starts, rotates for ties
+
+  /* sticky policies only */
+  mutable std::mutex mutex_;
+  std::unordered_map<uint32_t, StreamState> streams_;
+  std::vector<double> conveyor_load_;
+  std::vector<uint32_t> conveyor_streams_;
+  std::vector<std::pair<uint32_t, uint32_t>> hash_ring_;  ///< (hash, conveyor_idx), sorted by hash
+  std::chrono::steady_clock::time_point window_start_;
+  uint64_t epoch_ = 0;  ///< changes with the active count
+};  // class StreamDispatcher
+
+}  // namespace cnstream
+
+#endif  // MODULES_CORE_INCLUDE_STREAM_DISPATCHER_HPP_
@@ -40,8 +40,16 @@ class ThreadSafeQueue {
 
   bool WaitAndTryPop(T& value, const std::chrono::microseconds rel_time);
 
+  /* blocks until there is data or the queue is stopped, returns false once stopped */
+  bool WaitAndPopUntilStop(T& value);
+
   void Push(T new_value);
 
+  /* wakes up all threads blocked in WaitAndPopUntilStop */
+  void Stop();
+
+  void Restart();
+
   bool Empty() {
     std::lock_guard<std::mutex> lk(data_m_);
     return q_.empty();
@@ -53,6 +61,7 @@ class ThreadSafeQueue {
   std::mutex data_m_;
   std::queue<T> q_;
   std::condition_variable notempty_cond_;
+  bool stopped_ = false;
 };
 
 template <typename T>
@@ -87,6 +96,16 @@ bool ThreadSafeQueue<T>::WaitAndTryPop(T& value, const std::chrono::microseconds
   }
 }
 
+template <typename T>
+bool ThreadSafeQueue<T>::WaitAndPopUntilStop(T& value) {
+  std::unique_lock<std::mutex> lk(data_m_);
+  notempty_cond_.wait(lk, [&] { return stopped_ || !q_.empty(); });
+  if (stopped_) return false;
+  value = q_.front();
+  q_.pop();
+  return true;
+}
+
 template <typename T>
 void ThreadSafeQueue<T>::Push(T new_value) {
   std::lock_guard<std::mutex> lk(data_m_);
@@ -94,6 +113,19 @@ void ThreadSafeQueue<T>::Push(T new_value) {
   notempty_cond_.notify_one();
 }
 
+template <typename T>
+void ThreadSafeQueue<T>::Stop() {
+  std::lock_guard<std::mutex> lk(data_m_);
+  stopped_ = true;
+  notempty_cond_.notify_all();
+}
+
+template <typename T>
+void ThreadSafeQueue<T>::Restart() {
+  std::lock_guard<std::mutex> lk(data_m_);
+  stopped_ = false;
+}
+
 }  // namespace cnstream
 
 #endif  // MODULES_CORE_INCLUDE_THREADSAFE_QUEUE_HPP_
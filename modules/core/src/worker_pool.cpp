@@ -0,0 +1,148 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#include "worker_pool.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace cnstream {
+
+/* the pool and index of the worker running on this thread, if there is one */
+static thread_local WorkerPool* tls_pool = nullptr;
+static thread_local uint32_t tls_worker_idx = 0;
+
+WorkerPool::WorkerPool(uint32_t worker_num) {
+  if (0 == worker_num) worker_num = std::thread::hardware_concurrency();
+  if (0 == worker_num) worker_num = 1;
+  for (uint32_t i = 0; i < worker_num; ++i) {
+    workers_.emplace_back(new Worker);
+  }
+}
+
+WorkerPool::~WorkerPool() { Stop(); }
+
+void WorkerPool::Start(const std::function<void()>& on_start) {
+  if (running_.exchange(true)) return;
+  on_start_ = on_start;
+  starting_num_ = static_cast<uint32_t>(workers_.size());
+  for (uint32_t i = 0; i < workers_.size(); ++i) {
+    workers_[i]->thread = std::thread(&WorkerPool::WorkerLoop, this, i);
+  }
+  std::unique_lock<std::mutex> lk(start_mutex_);
+  start_cond_.wait(lk, [this] { return 0 == starting_num_; });
+}
+
+void WorkerPool::Stop() {
+  if (!running_.exchange(false)) return;
+  WakeupWorker(true);
+  for (auto& worker : workers_) {
+    if (worker->thread.joinable()) worker->thread.join();
+    std::lock_guard<std::mutex> lk(worker->mutex);
+    worker->tasks.clear();
+  }
+}
+
+void WorkerPool::Submit(PoolTask* task, bool yield) {
+  uint32_t worker_idx;
+  if (this == tls_pool) {
+    worker_idx = tls_worker_idx;
+  } else {
+    worker_idx = next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+  }
+  Worker* worker = workers_[worker_idx].get();
+  {
+    std::lock_guard<std::mutex> lk(worker->mutex);
+    if (yield) {
+      worker->tasks.push_front(task);
+    } else {
+      worker->tasks.push_back(task);
+    }
+  }
+  WakeupWorker(false);
+}
+
+PoolTask* WorkerPool::PopTask(uint32_t worker_idx) {
+  PoolTask* task = nullptr;
+  {
+    Worker* worker = workers_[worker_idx].get();
+    std::lock_guard<std::mutex> lk(worker->mutex);
+    if (!worker->tasks.empty()) {
+      task = worker->tasks.back();
+      worker->tasks.pop_back();
+      return task;
+    }
+  }
+  /* steal */
+  const size_t worker_num = workers_.size();
+  for (size_t i = 1; i < worker_num; ++i) {
+    Worker* victim = workers_[(worker_idx + i) % worker_num].get();
+    std::lock_guard<std::mutex> lk(victim->mutex);
+    if (!victim->tasks.empty()) {
+      task = victim->tasks.front();
+      victim->tasks.pop_front();
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+void WorkerPool::WorkerLoop(uint32_t worker_idx) {
+  tls_pool = this;
+  tls_worker_idx = worker_idx;
+  if (on_start_) on_start_();
+  {
+    std::lock_guard<std::mutex> lk(start_mutex_);
+    --starting_num_;
+  }
+  start_cond_.notify_all();
+  while (running_.load()) {
+    PoolTask* task = PopTask(worker_idx);
+    if (nullptr == task) {
+      sleepers_.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      uint64_t key = seq_.load();
+      task = PopTask(worker_idx);
+      if (nullptr == task && running_.load()) {
+        std::unique_lock<std::mutex> lk(sleep_mutex_);
+        sleep_cond_.wait(lk, [&] { return seq_.load(std::memory_order_relaxed) != key; });
+      }
+      sleepers_.fetch_sub(1);
+      if (nullptr == task) continue;
+    }
+    task->Run();
+  }
+  tls_pool = nullptr;
+}
+
+void WorkerPool::WakeupWorker(bool all) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (all || sleepers_.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lk(sleep_mutex_);
+    seq_.fetch_add(1);
+    if (all) {
+      sleep_cond_.notify_all();
+    } else {
+      sleep_cond_.notify_one();
+    }
+  }
+}
+
+}  // namespace cnstream
@@ -0,0 +1,103 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#ifndef MODULES_CORE_INCLUDE_WORKER_POOL_HPP_
+#define MODULES_CORE_INCLUDE_WORKER_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cnstream_common.hpp"
+
+namespace cnstream {
+
+/****************************************************************************
+ * @brief A piece of work run by WorkerPool.
+ *
+ * The pool never runs a task which is not submitted, and a task submitted
+ * once is run once. It is up to the task not to be submitted again while
+ * it is queued or running if it must run on one thread at a time.
+ ****************************************************************************/
+class PoolTask {
+ public:
+  virtual ~PoolTask() = default;
+  virtual void Run() = 0;
+};  // class PoolTask
+
+/****************************************************************************
+ * @brief Fixed number of worker threads with work-stealing deques.
+ *
+ * Every worker owns a deque. Tasks submitted by a worker go to the back of
+ * its own deque and are popped from the back again, so data tends to stay
+ * on the core which produced it. Tasks submitted by other threads are
+ * spread over the workers round-robin. An idle worker steals from the
+ * front of the other deques before it goes to sleep.
+ *
+ * A yielded task goes to the front of the deque, behind everything else,
+ * so a busy task can not starve the others on the same worker.
+ ****************************************************************************/
+class WorkerPool {
+ public:
+  /* worker_num 0: one worker per core */
+  explicit WorkerPool(uint32_t worker_num);
+  ~WorkerPool();
+
+  /* on_start is run first on every worker, returns once all of them ran it */
+  void Start(const std::function<void()>& on_start = nullptr);
+  /* queued tasks which have not started are dropped */
+  void Stop();
+  void Submit(PoolTask* task, bool yield = false);
+  uint32_t GetWorkerNum() const { return static_cast<uint32_t>(workers_.size()); }
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<PoolTask*> tasks;
+    std::thread thread;
+  };
+
+  void WorkerLoop(uint32_t worker_idx);
+  PoolTask* PopTask(uint32_t worker_idx);
+  void WakeupWorker(bool all);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<bool> running_{false};
+  std::atomic<uint32_t> next_worker_{0};
+  /* sleeping workers, same scheme as ConveyorWaiter */
+  std::atomic<uint64_t> seq_{0};
+  std::atomic<int> sleepers_{0};
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cond_;
+  std::function<void()> on_start_;
+  uint32_t starting_num_ = 0;  ///< workers which have not run on_start_ yet
+  std::mutex start_mutex_;
+  std::condition_variable start_cond_;
+  DISABLE_COPY_AND_ASSIGN(WorkerPool);
+};  // class WorkerPool
+
+}  // namespace cnstream
+
+#endif  // MODULES_CORE_INCLUDE_WORKER_POOL_HPP_
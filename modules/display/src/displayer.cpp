@@ -27,7 +27,10 @@
 
 namespace cnstream {
 
-Displayer::Displayer(const std::string &name) : Module(name) { stream_ = new DisplayStream; }
+Displayer::Displayer(const std::string &name) : Module(name) {
+  stream_ = new DisplayStream;
+  SetFrameOrderRequired(true);
+}
 
 Displayer::~Displayer() { delete stream_; }
 
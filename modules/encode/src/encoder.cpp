@@ -23,7 +23,11 @@
 
 namespace cnstream {
 
-Encoder::Encoder(const std::string &name) : Module(name) {}
+Encoder::Encoder(const std::string &name) : Module(name) {
+  /* drain bursts in one call, without waiting for more frames */
+  SetBatchSize(8);
+  SetFrameOrderRequired(true);
+}
 
 EncoderContext *Encoder::GetEncoderContext(CNFrameInfoPtr data) {
   EncoderContext *ctx = nullptr;
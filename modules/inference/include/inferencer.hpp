@@ -101,6 +101,15 @@ class Inferencer : public Module, public ModuleCreator<Inferencer> {
    */
   int Process(CNFrameInfoPtr data) final;
 
+  /**
+   * @brief Called by pipeline on each thread before data flows, creates the context of the thread
+   *
+   * @param None
+   *
+   * @return void
+   */
+  void WarmUp() override;
+
   /**
    * @brief inferencing by batch
    *
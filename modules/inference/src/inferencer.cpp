@@ -159,6 +159,7 @@ class InferencerPrivate {
 Inferencer::Inferencer(const std::string& name) : Module(name) {
   d_ptr_ = nullptr;
   hasTransmit_.store(1);  // transmit data by module itself
+  SetStaleFrameSkippable(true);
 }
 
 Inferencer::~Inferencer() {}
@@ -237,6 +238,11 @@ void Inferencer::Close() {
   }
 }
 
+void Inferencer::WarmUp() {
+  /* CnInfer, MluRCOp and the buffers of the thread, otherwise created on its first frame */
+  d_ptr_->GetInferContext();
+}
+
 int Inferencer::Process(CNFrameInfoPtr data) {
   InferContext* pctx = d_ptr_->GetInferContext();
   if (data->frame.flags & CNFrameFlag::CN_FRAME_FLAG_EOS) {
@@ -245,6 +251,13 @@ int Inferencer::Process(CNFrameInfoPtr data) {
     pctx->vec_data.clear();
     if (container_) container_->ProvideData(this, data);
     return ret;
+  } else if (data->IsStale()) {
+    /* too late to be worth inferring, transmitted after the frames batched before it */
+    int ret = ProcessBatch();
+    pctx->vec_data.clear();
+    AddSkippedFrame();
+    if (container_) container_->ProvideData(this, data);
+    return ret;
   } else {
     /* normal data, do preprocessing and batch it */
     const auto shapes = d_ptr_->model_loader_->input_shapes();
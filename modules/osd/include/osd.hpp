@@ -77,6 +77,16 @@ class Osd : public Module, public ModuleCreator<Osd> {
    */
   int Process(std::shared_ptr<CNFrameInfo> data) override;
 
+  /**
+   * @brief Do for a batch of frames, draws them with the same osd processor
+   *
+   * @param data : Pointers to the frame info
+   *
+   * @return whether process succeed
+   * @retval 0: succeed and do no intercept data
+   */
+  int ProcessBatch(std::vector<std::shared_ptr<CNFrameInfo>>& data) override;
+
  private:
   std::vector<std::string> labels_;
 };  // class osd
@@ -50,7 +50,12 @@ static std::vector<string> LoadLabels(const std::string& label_path) {
 
 namespace cnstream {
 
-Osd::Osd(const std::string& name) : Module(name) {}
+Osd::Osd(const std::string& name) : Module(name) {
+  /* drain bursts in one call, without waiting for more frames */
+  SetBatchSize(8);
+  /* boxes drawn on a frame shown too late are worthless */
+  SetStaleFrameSkippable(true);
+}
 
 bool Osd::Open(cnstream::ModuleParamSet paramSet) {
   if (paramSet.find("label_path") == paramSet.end()) {
@@ -65,9 +70,7 @@ bool Osd::Open(cnstream::ModuleParamSet paramSet) {
 void Osd::Close() { /*empty*/
 }
 
-int Osd::Process(std::shared_ptr<CNFrameInfo> data) {
-  libstream::CnOsd processor(1, 1, labels_);
-
+static void DrawFrame(libstream::CnOsd* processor, const std::shared_ptr<CNFrameInfo>& data) {
   std::vector<CnDetectObject> objs;
   for (const auto& it : data->objs) {
     CnDetectObject cn_obj;
@@ -80,8 +83,18 @@ int Osd::Process(std::shared_ptr<CNFrameInfo> data) {
     cn_obj.track_id = it->track_id.empty() ? -1 : std::stoi(it->track_id);
     objs.push_back(cn_obj);
   }
-  processor.DrawLabel(*data->frame.ImageBGR(), objs);
+  processor->DrawLabel(*data->frame.ImageBGR(), objs);
+}
 
+int Osd::Process(std::shared_ptr<CNFrameInfo> data) {
+  libstream::CnOsd processor(1, 1, labels_);
+  DrawFrame(&processor, data);
+  return 0;
+}
+
+int Osd::ProcessBatch(std::vector<std::shared_ptr<CNFrameInfo>>& data) {
+  libstream::CnOsd processor(1, 1, labels_);
+  for (auto& it : data) DrawFrame(&processor, it);
   return 0;
 }
 
@@ -116,11 +116,15 @@ class DataSource : public Module, public ModuleCreator<DataSource> {
    *   filename[in]: source path, local-file-path/rtsp-url/jpg-sequences, etc.
    *   framerate[in]: source data input frequency
    *   loop[in]: whether to reload source when EOF is reached or not
+   *   priority[in]: priority class of the stream, see CNFrameInfo::priority
+   *   weight[in]: share of the stream within its priority class, see CNFrameInfo::weight
+   *   latency_budget_ms[in]: how long a frame is worth processing, 0 for no limit, see CNFrameInfo::IsStale
    * @return
    *    0: success,
    *   -1: error occurs
    */
-  int AddVideoSource(const std::string &stream_id, const std::string &filename, int framerate, bool loop = false);
+  int AddVideoSource(const std::string &stream_id, const std::string &filename, int framerate, bool loop = false,
+                     int priority = 0, uint32_t weight = 1, uint32_t latency_budget_ms = 0);
   /*
    * @brief Add one stream to DataSource module, should be called after pipeline starts.
    * @param
@@ -140,6 +144,18 @@ class DataSource : public Module, public ModuleCreator<DataSource> {
    *    0: success (always success by now)
    */
   int RemoveSource(const std::string &stream_id);
+  /*
+   * @brief Get how many frames of one stream were lost to the limit set by SetParallelism
+   * @param
+   *   stream_id[in]: unique stream identifier.
+   *   dropped_frames[out]: frames decoded and then dropped as CNFrameInfo::Create failed
+   *   skipped_packets[out]: packets of a live stream skipped before decoding as the stream had no credit left,
+   *                         see HasFrameCredit. Files wait for credit instead.
+   * @return
+   *    0: success,
+   *   -1: the stream does not exist
+   */
+  int GetDropCounters(const std::string &stream_id, uint64_t *dropped_frames, uint64_t *skipped_packets);
 
  public:
   /*
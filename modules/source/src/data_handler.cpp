@@ -90,13 +90,22 @@ bool DataHandler::Open() {
 void DataHandler::Close() {
   if (running_.load()) {
     running_.store(0);
+    WakeupFrameCreditWaiters();
     if (thread_.joinable()) {
       thread_.join();
     }
   }
 }
 
+bool DataHandler::WaitForCredit() {
+  return WaitForFrameCredit(stream_id_, [this] { return !running_.load(); });
+}
+
 void DataHandler::Loop() {
+  /* decoded frames are allocated on the NUMA node of the module which reads them */
+  module_->ApplyPlacement();
+  /* frames decoded by this thread are charged to the module, see GetModuleFrameMemoryUsage */
+  FrameMemoryOwner memory_owner(module_);
   if (!PrepareResources()) {
     return;
   }
@@ -21,6 +21,7 @@
 #ifndef MODULES_SOURCE_DATA_HANDLER_HPP_
 #define MODULES_SOURCE_DATA_HANDLER_HPP_
 
+#include <atomic>
 #include <string>
 #include <thread>
 
@@ -48,7 +49,17 @@ class DataHandler {
   size_t GetStreamIndex();
   static const size_t INVALID_STREAM_ID = -1;
   DevContext GetDevContext() const { return dev_ctx_; }
+  /* stamped on every frame of the stream, call it before Open */
+  void SetPriority(int priority, uint32_t weight) {
+    priority_ = priority;
+    weight_ = weight;
+  }
+  /* stamped on every frame of the stream, 0 for no limit, see CNFrameInfo::latency_budget_ms */
+  void SetLatencyBudget(uint32_t latency_budget_ms) { latency_budget_ms_ = latency_budget_ms; }
   bool SendData(std::shared_ptr<CNFrameInfo> data) {
+    data->priority = priority_;
+    data->weight = weight_;
+    data->latency_budget_ms = latency_budget_ms_;
     if (this->module_) {
       return this->module_->SendData(data);
     }
@@ -63,13 +74,21 @@ class DataHandler {
   void SendFlowEos() {
     auto data = CNFrameInfo::Create(stream_id_, true);
     data->channel_idx = streamIndex_;
+    data->priority = priority_;
+    data->weight = weight_;
     // LOG(INFO) << "[Source]  " << stream_id_ << " receive eos.";
     if (this->module_ && send_flow_eos_.load()) {
       this->module_->SendData(data);
     }
   }
+  DataSource *GetModule() const { return module_; }
   bool GetDemuxEos() const { return demux_eos_.load() ? true : false; }
   bool ReuseCNDecBuf() const { return param_.reuse_cndec_buf; }
+  /* frames decoded and then dropped as CNFrameInfo::Create failed, see SetParallelism */
+  void AddDroppedFrame() { dropped_frames_.fetch_add(1, std::memory_order_relaxed); }
+  uint64_t GetDroppedFrameNum() const { return dropped_frames_.load(); }
+  /* packets skipped before decoding as the stream had no credit left, see HasFrameCredit */
+  uint64_t GetSkippedPacketNum() const { return skipped_packets_.load(); }
 
  protected:
   DataSource *module_ = nullptr;
@@ -80,9 +99,16 @@ class DataHandler {
   DevContext dev_ctx_;
   size_t interval_ = 1;
   std::atomic<int> demux_eos_{0};
+  std::atomic<uint64_t> dropped_frames_{0};
+  std::atomic<uint64_t> skipped_packets_{0};
+  /* blocks until the stream has credit for one more frame, false if the handler is closing */
+  bool WaitForCredit();
 
  private:
   size_t streamIndex_ = INVALID_STREAM_ID;
+  int priority_ = 0;
+  uint32_t weight_ = 1;
+  uint32_t latency_budget_ms_ = 0;
   void ReturnStreamIndex() const;
   static std::mutex index_mutex_;
   static uint64_t index_mask_;
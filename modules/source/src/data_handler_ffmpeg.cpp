@@ -234,6 +234,26 @@ bool DataHandlerFFmpeg::Process() {
       return false;
     }
   }  // if (!ret)
+  /*
+    the stream has no credit left for one more frame (see SetParallelism), the frame would be dropped once
+    decoded. a file waits for the pipeline, a live stream skips packets before decoding, up to the next key
+    frame once it has credit again.
+   */
+  if (live_) {
+    if (!HasFrameCredit(stream_id_)) {
+      skipping_ = true;
+    } else if (packet_.flags & AV_PKT_FLAG_KEY) {
+      skipping_ = false;
+    }
+    if (skipping_) {
+      skipped_packets_.fetch_add(1, std::memory_order_relaxed);
+      av_packet_unref(&packet_);
+      return true;
+    }
+  } else if (!WaitForCredit()) {
+    av_packet_unref(&packet_);
+    return false;
+  }
   if (!decoder_->Process(&packet_, false)) {
     av_packet_unref(&packet_);
     return false;
@@ -43,7 +43,10 @@ class DataHandlerFFmpeg : public DataHandler {
  public:
   explicit DataHandlerFFmpeg(DataSource* module, const std::string& stream_id, const std::string& filename,
                              int framerate, bool loop)
-      : DataHandler(module, stream_id, framerate, loop), filename_(filename) {}
+      : DataHandler(module, stream_id, framerate, loop), filename_(filename) {
+    /* urls of network streams, they can not wait for the pipeline */
+    live_ = filename_.find("://") != std::string::npos && 0 != filename_.compare(0, 7, "file://");
+  }
   ~DataHandlerFFmpeg() { Close(); }
 
  public:
@@ -61,6 +64,8 @@ class DataHandlerFFmpeg : public DataHandler {
   uint64_t last_receive_frame_time_ = 0;
   uint8_t max_receive_time_out_ = 3;
   bool find_pts_ = true;  // set it to true by default!
+  bool live_ = false;
+  bool skipping_ = false;  // no credit was left, packets are skipped up to the next key frame
 
  private:
   bool PrepareResources() override;
@@ -158,6 +158,10 @@ bool DataHandlerRaw::Process() {
       return false;
     }
   }  // if (!ret)
+  /* raw sources are files, they wait for the pipeline rather than decode frames dropped by CNFrameInfo::Create */
+  if (!WaitForCredit()) {
+    return false;
+  }
   if (!decoder_->Process(&packet_, false)) {
     return false;
   }
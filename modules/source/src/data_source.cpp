@@ -164,7 +164,8 @@ bool DataSource::SendData(std::shared_ptr<CNFrameInfo> data) {
   return false;
 }
 
-int DataSource::AddVideoSource(const std::string &stream_id, const std::string &filename, int framerate, bool loop) {
+int DataSource::AddVideoSource(const std::string &stream_id, const std::string &filename, int framerate, bool loop,
+                               int priority, uint32_t weight, uint32_t latency_budget_ms) {
   std::unique_lock<std::mutex> lock(mutex_);
   if (source_map_.find(stream_id) != source_map_.end()) {
     LOG(ERROR) << "Duplicate stream_id\n";
@@ -180,6 +181,8 @@ int DataSource::AddVideoSource(const std::string &stream_id, const std::string &
     LOG(ERROR) << "source, not supported yet";
   }
   if (source.get() != nullptr) {
+    source->SetPriority(priority, weight);
+    source->SetLatencyBudget(latency_budget_ms);
     if (source->Open() != true) {
       LOG(ERROR) << "source Open failed";
       return -1;
@@ -227,6 +230,17 @@ int DataSource::RemoveSource(const std::string &stream_id) {
   return 0;
 }
 
+int DataSource::GetDropCounters(const std::string &stream_id, uint64_t *dropped_frames, uint64_t *skipped_packets) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto iter = source_map_.find(stream_id);
+  if (iter == source_map_.end()) {
+    return -1;
+  }
+  if (dropped_frames) *dropped_frames = iter->second->GetDroppedFrameNum();
+  if (skipped_packets) *skipped_packets = iter->second->GetSkippedPacketNum();
+  return 0;
+}
+
 int DataSource::RemoveSources() {
   std::unique_lock<std::mutex> lock(mutex_);
   std::map<std::string, std::shared_ptr<DataHandler>>::iterator iter;
@@ -124,8 +124,10 @@ void FFmpegMluDecoder::Destroy() {
     if (!handler_.GetDemuxEos()) {
       this->Process(nullptr, true);
     }
-    while (!eos_got_.load()) {
-      usleep(1000 * 10);
+    {
+      /* EOSCallback is called by the decoder thread once the eos went through */
+      std::unique_lock<std::mutex> lk(eos_mtx_);
+      eos_cond_.wait(lk, [this] { return eos_got_.load() != 0; });
     }
     eos_got_.store(2);  // avoid double-wait eos
   }
@@ -159,6 +161,7 @@ int FFmpegMluDecoder::ProcessFrame(const libstream::CnFrame &frame, bool &reused
   if (data == nullptr) {
     // LOG(WARNING) << "CNFrameInfo::Create Failed,DISCARD image";
     ++discard_frame_num_;
+    handler_.AddDroppedFrame();
     if (discard_frame_num_ % 20 == 0) {
       LOG(WARNING) << "CNFrameInfo::Create Failed,DISCARD image: " << discard_frame_num_;
     }
@@ -188,6 +191,8 @@ int FFmpegMluDecoder::ProcessFrame(const libstream::CnFrame &frame, bool &reused
 }
 
 void FFmpegMluDecoder::FrameCallback(const libstream::CnFrame &frame) {
+  /* called by the decoder thread, frames are charged to the source module */
+  FrameMemoryOwner memory_owner(handler_.GetModule());
   bool reused = false;
   if (frame_count_++ % interval_ == 0) {
     ProcessFrame(frame, reused);
@@ -199,7 +204,11 @@ void FFmpegMluDecoder::FrameCallback(const libstream::CnFrame &frame) {
 
 void FFmpegMluDecoder::EOSCallback() {
   handler_.SendFlowEos();
-  eos_got_.store(1);
+  {
+    std::lock_guard<std::mutex> lk(eos_mtx_);
+    eos_got_.store(1);
+  }
+  eos_cond_.notify_all();
 }
 
 //----------------------------------------------------------------------------
@@ -245,8 +254,10 @@ void FFmpegCpuDecoder::Destroy() {
       while (this->Process(nullptr, true))
         ;
     }
-    while (!eos_got_.load()) {
-      usleep(1000 * 10);
+    {
+      /* set by Process once the eos went through, possibly on the thread of the data handler */
+      std::unique_lock<std::mutex> lk(eos_mtx_);
+      eos_cond_.wait(lk, [this] { return eos_got_.load() != 0; });
     }
     eos_got_.store(0);
     avcodec_free_context(&instance_);
@@ -274,7 +285,11 @@ bool FFmpegCpuDecoder::Process(AVPacket *pkt, bool eos) {
     } while (got_frame);
 
     handler_.SendFlowEos();
-    eos_got_.store(1);
+    {
+      std::lock_guard<std::mutex> lk(eos_mtx_);
+      eos_got_.store(1);
+    }
+    eos_cond_.notify_all();
     return false;
   }
   int got_frame = 0;
@@ -296,6 +311,7 @@ bool FFmpegCpuDecoder::ProcessFrame(AVFrame *frame) {
   auto data = CNFrameInfo::Create(stream_id_);
   if (data == nullptr) {
     ++discard_frame_num_;
+    handler_.AddDroppedFrame();
     // LOG(WARNING) << "CNFrameInfo::Create Failed,DISCARD image";
     if (discard_frame_num_ % 20 == 0) {
       LOG(WARNING) << "CNFrameInfo::Create Failed,DISCARD image: " << discard_frame_num_;
@@ -34,6 +34,8 @@ extern "C" {
 #endif
 
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 #include <thread>
 #include "cndecode/cndecode.h"
@@ -89,6 +91,8 @@ class FFmpegMluDecoder : public FFmpegDecoder {
   std::shared_ptr<libstream::CnDecode> instance_ = nullptr;
   libstream::CnPacket cn_packet_;
   std::atomic<int> eos_got_{0};
+  std::mutex eos_mtx_;
+  std::condition_variable eos_cond_;
   void FrameCallback(const libstream::CnFrame &frame);
   void EOSCallback();
   int ProcessFrame(const libstream::CnFrame &frame, bool &reused);
@@ -143,6 +147,8 @@ class FFmpegCpuDecoder : public FFmpegDecoder {
   AVCodecContext *instance_ = nullptr;
   AVFrame *av_frame_ = nullptr;
   std::atomic<int> eos_got_{0};
+  std::mutex eos_mtx_;
+  std::condition_variable eos_cond_;
   uint8_t *nv21_data_ = nullptr;
   int y_size_ = 0;
 };
@@ -116,8 +116,10 @@ void RawMluDecoder::Destroy() {
     if (!handler_.GetDemuxEos()) {
       this->Process(nullptr, true);
     }
-    while (!eos_got_.load()) {
-      usleep(1000 * 10);
+    {
+      /* EOSCallback is called by the decoder thread once the eos went through */
+      std::unique_lock<std::mutex> lk(eos_mtx_);
+      eos_cond_.wait(lk, [this] { return eos_got_.load() != 0; });
     }
     eos_got_.store(2);  // avoid double-wait eos
   }
@@ -151,6 +153,7 @@ int RawMluDecoder::ProcessFrame(const libstream::CnFrame &frame, bool &reused) {
   if (data == nullptr) {
     // LOG(WARNING) << "CNFrameInfo::Create Failed,DISCARD image";
     ++discard_frame_num_;
+    handler_.AddDroppedFrame();
     if (discard_frame_num_ % 20 == 0) {
       LOG(WARNING) << "CNFrameInfo::Create Failed,DISCARD image: " << discard_frame_num_;
     }
@@ -180,6 +183,8 @@ int RawMluDecoder::ProcessFrame(const libstream::CnFrame &frame, bool &reused) {
 }
 
 void RawMluDecoder::FrameCallback(const libstream::CnFrame &frame) {
+  /* called by the decoder thread, frames are charged to the source module */
+  FrameMemoryOwner memory_owner(handler_.GetModule());
   bool reused = false;
   if (frame_count_++ % interval_ == 0) {
     ProcessFrame(frame, reused);
@@ -191,7 +196,11 @@ void RawMluDecoder::FrameCallback(const libstream::CnFrame &frame) {
 
 void RawMluDecoder::EOSCallback() {
   handler_.SendFlowEos();
-  eos_got_.store(1);
+  {
+    std::lock_guard<std::mutex> lk(eos_mtx_);
+    eos_got_.store(1);
+  }
+  eos_cond_.notify_all();
 }
 
 }  // namespace cnstream
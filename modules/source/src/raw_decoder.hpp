@@ -22,6 +22,8 @@
 #define MODULES_SOURCE_RAW_DECODER_HPP_
 
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <string>
 #include <thread>
 #include "cndecode/cndecode.h"
@@ -93,6 +95,8 @@ class RawMluDecoder : public RawDecoder {
   std::shared_ptr<libstream::CnDecode> instance_ = nullptr;
   libstream::CnPacket cn_packet_;
   std::atomic<int> eos_got_{0};
+  std::mutex eos_mtx_;
+  std::condition_variable eos_cond_;
   void FrameCallback(const libstream::CnFrame &frame);
   void EOSCallback();
   int ProcessFrame(const libstream::CnFrame &frame, bool &reused);
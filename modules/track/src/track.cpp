@@ -22,7 +22,10 @@
 
 namespace cnstream {
 
-Tracker::Tracker(const std::string &name) : Module(name) {}
+Tracker::Tracker(const std::string &name) : Module(name) {
+  /* tracks are carried from one frame to the next */
+  SetFrameOrderRequired(true);
+}
 
 Tracker::~Tracker() { Close(); }
 
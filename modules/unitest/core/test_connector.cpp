@@ -20,7 +20,9 @@
 
 #include <gtest/gtest.h>
 #include <ctime>
+#include <algorithm>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "cnstream_frame.hpp"
@@ -66,4 +68,132 @@ TEST(CoreConnector, StartStop) {
   EXPECT_TRUE(connector.IsStopped());
 }
 
+static CNFrameInfoPtr CreateData(uint32_t chn_idx, bool eos = false) {
+  CNFrameInfoPtr data = CNFrameInfo::Create(std::to_string(chn_idx), eos);
+  data->channel_idx = chn_idx;
+  return data;
+}
+
+TEST(CoreConnector, DispatchModulo) {
+  size_t conveyor_count = 4;
+  Connector connector(conveyor_count);
+  EXPECT_EQ(DISPATCH_MODULO, connector.GetDispatchPolicy());
+  for (uint32_t chn_idx = 0; chn_idx < 16; ++chn_idx) {
+    EXPECT_EQ(static_cast<int>(chn_idx % conveyor_count), connector.DispatchConveyor(CreateData(chn_idx)));
+  }
+  LinkStatus status;
+  connector.GetDispatchStatus(&status);
+  ASSERT_EQ(conveyor_count, status.dispatched.size());
+  for (auto it : status.dispatched) EXPECT_EQ(4u, it);
+}
+
+TEST(CoreConnector, DispatchConsistentHash) {
+  size_t conveyor_count = 4;
+  uint32_t chn_cnt = 32;
+  LinkConfig config;
+  config.dispatch_policy = DISPATCH_CONSISTENT_HASH;
+  Connector connector(conveyor_count, config);
+  std::vector<int> placement;
+  for (uint32_t chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+    int conveyor_idx = connector.DispatchConveyor(CreateData(chn_idx));
+    connector.FrameDone(conveyor_idx, CreateData(chn_idx), 1);
+    placement.push_back(conveyor_idx);
+  }
+  /* bounded loads */
+  LinkStatus status;
+  connector.GetDispatchStatus(&status);
+  ASSERT_EQ(conveyor_count, status.stream_cnt.size());
+  for (auto it : status.stream_cnt) EXPECT_LE(it, 10u);
+  /* a stream stays where it is */
+  for (uint32_t chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+    int conveyor_idx = connector.DispatchConveyor(CreateData(chn_idx));
+    EXPECT_EQ(placement[chn_idx], conveyor_idx);
+    connector.FrameDone(conveyor_idx, CreateData(chn_idx), 1);
+  }
+}
+
+TEST(CoreConnector, DispatchLeastLoaded) {
+  size_t conveyor_count = 2;
+  LinkConfig config;
+  config.dispatch_policy = DISPATCH_LEAST_LOADED;
+  Connector connector(conveyor_count, config);
+  /* new streams go to the conveyor with fewer streams */
+  int conveyor_0 = connector.DispatchConveyor(CreateData(0));
+  int conveyor_1 = connector.DispatchConveyor(CreateData(1));
+  EXPECT_NE(conveyor_0, conveyor_1);
+  /* frames in flight pin the stream */
+  EXPECT_EQ(conveyor_0, connector.DispatchConveyor(CreateData(0)));
+  LinkStatus status;
+  connector.GetDispatchStatus(&status);
+  EXPECT_EQ(1u, status.stream_cnt[conveyor_0]);
+  EXPECT_EQ(1u, status.stream_cnt[conveyor_1]);
+  EXPECT_EQ(2u, status.dispatched[conveyor_0]);
+
+  connector.FrameDone(conveyor_0, CreateData(0), 3);
+  connector.FrameDone(conveyor_0, CreateData(0), 3);
+  connector.GetDispatchStatus(&status);
+  EXPECT_DOUBLE_EQ(6, status.busy_ms[conveyor_0]);
+
+  /* the stream is forgotten once its EOS is done */
+  connector.FrameDone(conveyor_1, CreateData(1), 1);
+  EXPECT_EQ(conveyor_1, connector.DispatchConveyor(CreateData(1, true)));
+  connector.FrameDone(conveyor_1, CreateData(1, true), 0);
+  connector.GetDispatchStatus(&status);
+  EXPECT_EQ(0u, status.stream_cnt[conveyor_1]);
+  /* the channel is then placed from scratch */
+  EXPECT_EQ(conveyor_1, connector.DispatchConveyor(CreateData(2)));
+}
+
+TEST(CoreConnector, DispatchSpread) {
+  size_t conveyor_count = 3;
+  LinkConfig config;
+  config.dispatch_policy = DISPATCH_SPREAD;
+  Connector connector(conveyor_count, config);
+  /* frames of one stream go to all the conveyors */
+  std::vector<int> conveyors;
+  for (size_t i = 0; i < conveyor_count; ++i) conveyors.push_back(connector.DispatchConveyor(CreateData(0)));
+  std::sort(conveyors.begin(), conveyors.end());
+  for (size_t i = 0; i < conveyor_count; ++i) EXPECT_EQ(static_cast<int>(i), conveyors[i]);
+  /* then to the one with the fewest frames in flight */
+  connector.FrameDone(1, CreateData(0), 1);
+  EXPECT_EQ(1, connector.DispatchConveyor(CreateData(0)));
+  connector.FrameDone(2, CreateData(0), 1);
+  EXPECT_EQ(2, connector.DispatchConveyor(CreateData(0)));
+  LinkStatus status;
+  connector.GetDispatchStatus(&status);
+  EXPECT_EQ(1u, status.dispatched[0]);
+  EXPECT_EQ(2u, status.dispatched[1]);
+  EXPECT_EQ(2u, status.dispatched[2]);
+  for (auto it : status.stream_cnt) EXPECT_EQ(0u, it);
+}
+
+TEST(CoreConnector, DispatchElastic) {
+  size_t conveyor_count = 2;
+  Connector connector(conveyor_count);
+  connector.SetElastic(true);
+  connector.Start();
+  EXPECT_EQ(2u, connector.GetActiveCount());
+  /* a frame of stream 1 is in flight on conveyor 1 */
+  EXPECT_EQ(1, connector.DispatchConveyor(CreateData(1)));
+  connector.SetActiveCount(0);
+  EXPECT_EQ(1u, connector.GetActiveCount());
+  /* the next one waits until the stream can move */
+  CNFrameInfoPtr parked = CreateData(1);
+  EXPECT_EQ(-1, connector.DispatchConveyor(parked));
+  EXPECT_EQ(-1, connector.DispatchConveyor(CreateData(1)));
+  EXPECT_EQ(0u, connector.GetConveyor(0)->GetBufferSize());
+  /* streams without frames in flight move at once */
+  EXPECT_EQ(0, connector.DispatchConveyor(CreateData(3)));
+  connector.FrameDone(1, CreateData(1), 1);
+  ASSERT_EQ(2u, connector.GetConveyor(0)->GetBufferSize());
+  EXPECT_EQ(parked.get(), connector.PopDataBufferFromConveyor(0).get());
+  EXPECT_EQ(0, connector.DispatchConveyor(CreateData(1)));
+  LinkStatus status;
+  connector.GetDispatchStatus(&status);
+  EXPECT_EQ(1u, status.active_cnt);
+  EXPECT_EQ(1u, status.dispatched[1]);
+  EXPECT_EQ(4u, status.dispatched[0]);
+  connector.Stop();
+}
+
 }  // namespace cnstream
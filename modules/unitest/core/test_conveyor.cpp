@@ -18,8 +18,10 @@
  * THE SOFTWARE.
  *************************************************************************/
 
+#include <algorithm>
 #include <chrono>
 #include <ctime>
+#include <iostream>
 #include <memory>
 #include <thread>
 #include <vector>
@@ -138,4 +140,414 @@ TEST(CoreConveyor, PushPopDataBuffer) {
   delete connect;
 }
 
+TEST(CoreConveyor, StopWakeupBlockedThreads) {
+  Connector connector(1, 1);
+  connector.Start();
+  Conveyor* conveyor = connector.GetConveyor(0);
+  conveyor->PushDataBuffer(cnstream::CNFrameInfo::Create(std::to_string(0)));
+
+  // one thread blocks on a full conveyor, the other on an empty one.
+  Connector empty_connector(1, 1);
+  empty_connector.Start();
+  std::thread push_thread([&]() { conveyor->PushDataBuffer(cnstream::CNFrameInfo::Create(std::to_string(0))); });
+  std::thread pop_thread([&]() { EXPECT_EQ(nullptr, empty_connector.GetConveyor(0)->PopDataBuffer().get()); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  auto stop_time = std::chrono::steady_clock::now();
+  connector.Stop();
+  empty_connector.Stop();
+  push_thread.join();
+  pop_thread.join();
+  std::chrono::duration<double, std::milli> wakeup_time = std::chrono::steady_clock::now() - stop_time;
+  EXPECT_LT(wakeup_time.count(), 10);
+  EXPECT_EQ(1u, conveyor->GetBufferSize());
+}
+
+/*
+  Per-hop latency under backpressure. The conveyor holds one frame only, so nearly every push has
+  to wait for the consumer. Latency is measured from the start of PushDataBuffer to the return of
+  PopDataBuffer in the consumer thread.
+ */
+TEST(CoreConveyor, PerHopLatency) {
+  const int frame_num = 500;
+  Connector connector(1, 1);
+  connector.Start();
+  Conveyor* conveyor = connector.GetConveyor(0);
+
+  std::vector<std::chrono::steady_clock::time_point> push_time(frame_num);
+  std::vector<std::chrono::steady_clock::time_point> pop_time(frame_num);
+  std::vector<CNFrameInfoPtr> frames;
+  for (int i = 0; i < frame_num; ++i) {
+    frames.push_back(cnstream::CNFrameInfo::Create(std::to_string(0)));
+    frames.back()->frame.frame_id = i;
+  }
+
+  std::thread consumer([&]() {
+    for (int i = 0; i < frame_num; ++i) {
+      CNFrameInfoPtr data = conveyor->PopDataBuffer();
+      ASSERT_NE(nullptr, data.get());
+      pop_time[data->frame.frame_id] = std::chrono::steady_clock::now();
+    }
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < frame_num; ++i) {
+    push_time[i] = std::chrono::steady_clock::now();
+    conveyor->PushDataBuffer(frames[i]);
+  }
+  consumer.join();
+  std::chrono::duration<double, std::milli> total = std::chrono::steady_clock::now() - start;
+
+  double latency_sum = 0, latency_max = 0;
+  for (int i = 0; i < frame_num; ++i) {
+    std::chrono::duration<double, std::milli> latency = pop_time[i] - push_time[i];
+    latency_sum += latency.count();
+    latency_max = std::max(latency_max, latency.count());
+  }
+  std::cout << "[Conveyor per-hop latency] avg: " << latency_sum / frame_num << "ms max: " << latency_max
+            << "ms total: " << total.count() << "ms for " << frame_num << " frames" << std::endl;
+  EXPECT_LT(latency_sum / frame_num, 5);
+  connector.Stop();
+}
+
+TEST(CoreConveyor, RingQueuePushPopDataBuffer) {
+  LinkConfig config;
+  config.queue_capacity = 3;
+  config.queue_impl = QUEUE_IMPL_RING;
+  Connector connector(1, config);
+  connector.SetSingleProducer(true);
+  connector.Start();
+  Conveyor* conveyor = connector.GetConveyor(0);
+
+  std::vector<CNFrameInfoPtr> frames;
+  for (int i = 0; i < 3; ++i) {
+    frames.push_back(cnstream::CNFrameInfo::Create(std::to_string(0)));
+    conveyor->PushDataBuffer(frames.back());
+  }
+  EXPECT_EQ(3u, conveyor->GetBufferSize()) << "capacity of the link should hold, not the ring size";
+
+  // the fourth push blocks until the consumer pops one
+  std::thread push_thread([&]() { conveyor->PushDataBuffer(cnstream::CNFrameInfo::Create(std::to_string(0))); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(3u, conveyor->GetBufferSize());
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(frames[i].get(), conveyor->PopDataBuffer().get());
+  }
+  push_thread.join();
+  EXPECT_NE(nullptr, conveyor->PopDataBuffer().get());
+
+  std::thread pop_thread([&]() { EXPECT_EQ(nullptr, conveyor->PopDataBuffer().get()); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  connector.Stop();
+  pop_thread.join();
+}
+
+/*
+  Throughput of one conveyor with several producers and one consumer, mutex queue vs ring queue.
+ */
+static double ConveyorThroughput(QueueImpl queue_impl, int producer_num, int frame_num) {
+  LinkConfig config;
+  config.queue_capacity = 32;
+  config.queue_impl = queue_impl;
+  Connector connector(1, config);
+  connector.SetSingleProducer(1 == producer_num);
+  connector.Start();
+  Conveyor* conveyor = connector.GetConveyor(0);
+  CNFrameInfoPtr data = cnstream::CNFrameInfo::Create(std::to_string(0));
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> producers;
+  for (int p = 0; p < producer_num; ++p) {
+    producers.push_back(std::thread([&]() {
+      for (int i = 0; i < frame_num / producer_num; ++i) conveyor->PushDataBuffer(data);
+    }));
+  }
+  for (int i = 0; i < frame_num / producer_num * producer_num; ++i) {
+    EXPECT_NE(nullptr, conveyor->PopDataBuffer().get());
+  }
+  for (auto& it : producers) it.join();
+  std::chrono::duration<double, std::milli> total = std::chrono::steady_clock::now() - start;
+  connector.Stop();
+  return frame_num / total.count() * 1e3;
+}
+
+TEST(CoreConveyor, PopDataBufferBatch) {
+  for (auto queue_impl : {QUEUE_IMPL_MUTEX, QUEUE_IMPL_RING, QUEUE_IMPL_FAIR}) {
+    LinkConfig config;
+    config.queue_capacity = 8;
+    config.queue_impl = queue_impl;
+    Connector connector(1, config);
+    connector.Start();
+    Conveyor* conveyor = connector.GetConveyor(0);
+
+    std::vector<CNFrameInfoPtr> frames;
+    for (int i = 0; i < 5; ++i) {
+      frames.push_back(cnstream::CNFrameInfo::Create(std::to_string(0)));
+      /* a fair queue keeps the order per channel */
+      frames.back()->channel_idx = 0;
+      conveyor->PushDataBuffer(frames.back());
+    }
+    /* takes the queued ones only, in order */
+    std::vector<CNFrameInfoPtr> batch = conveyor->PopDataBufferBatch(4, 0);
+    ASSERT_EQ(4u, batch.size());
+    for (int i = 0; i < 4; ++i) EXPECT_EQ(frames[i].get(), batch[i].get());
+    batch = conveyor->PopDataBufferBatch(4, 0);
+    ASSERT_EQ(1u, batch.size());
+    EXPECT_EQ(frames[4].get(), batch[0].get());
+
+    /* waits for more frames after the first one */
+    std::thread push_thread([&]() {
+      for (int i = 0; i < 3; ++i) {
+        conveyor->PushDataBuffer(cnstream::CNFrameInfo::Create(std::to_string(0)));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    });
+    batch = conveyor->PopDataBufferBatch(3, 1000000);
+    EXPECT_EQ(3u, batch.size());
+    push_thread.join();
+
+    /* gives up at timeout */
+    conveyor->PushDataBuffer(cnstream::CNFrameInfo::Create(std::to_string(0)));
+    auto start = std::chrono::steady_clock::now();
+    batch = conveyor->PopDataBufferBatch(3, 20000);
+    EXPECT_EQ(1u, batch.size());
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+
+    /* empty once stopped */
+    std::thread stop_thread([&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      connector.Stop();
+    });
+    EXPECT_TRUE(conveyor->PopDataBufferBatch(3, 0).empty());
+    stop_thread.join();
+  }
+}
+
+TEST(CoreConveyor, RingQueueThroughput) {
+  const int frame_num = 200000;
+  for (int producer_num : {1, 4}) {
+    double mutex_fps = ConveyorThroughput(QUEUE_IMPL_MUTEX, producer_num, frame_num);
+    double ring_fps = ConveyorThroughput(QUEUE_IMPL_RING, producer_num, frame_num);
+    std::cout << "[Conveyor throughput] producers: " << producer_num << " mutex: " << mutex_fps
+              << " frames/s ring: " << ring_fps << " frames/s" << std::endl;
+  }
+}
+
+static CNFrameInfoPtr CreateFairData(uint32_t chn_idx, int64_t frame_id, int priority, uint32_t weight) {
+  CNFrameInfoPtr data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx));
+  data->channel_idx = chn_idx;
+  data->frame.frame_id = frame_id;
+  data->priority = priority;
+  data->weight = weight;
+  return data;
+}
+
+TEST(CoreConveyor, FairQueueServesByPriorityAndWeight) {
+  LinkConfig config;
+  config.queue_impl = QUEUE_IMPL_FAIR;
+  Connector connector(1, config);
+  connector.Start();
+  Conveyor* conveyor = connector.GetConveyor(0);
+  for (int i = 0; i < 4; ++i) conveyor->PushDataBuffer(CreateFairData(0, i, 0, 1));
+  for (int i = 0; i < 4; ++i) conveyor->PushDataBuffer(CreateFairData(1, i, 0, 2));
+  conveyor->PushDataBuffer(CreateFairData(2, 0, 1, 1));
+  EXPECT_EQ(9u, conveyor->GetBufferSize());
+  /* the higher class first, then one frame of stream 0 for two of stream 1 */
+  std::vector<uint32_t> expected = {2, 0, 1, 1, 0, 1, 1, 0, 0};
+  std::vector<int64_t> next_frame_id(3, 0);
+  for (uint32_t chn_idx : expected) {
+    CNFrameInfoPtr data = conveyor->TryPopDataBuffer();
+    ASSERT_NE(nullptr, data.get());
+    EXPECT_EQ(chn_idx, data->channel_idx);
+    /* each stream stays in order */
+    EXPECT_EQ(next_frame_id[chn_idx]++, data->frame.frame_id);
+  }
+  EXPECT_EQ(nullptr, conveyor->TryPopDataBuffer().get());
+  connector.Stop();
+}
+
+TEST(CoreConveyor, FairQueueDropsFromLongestStream) {
+  Connector connector(1, 3);
+  connector.Start();
+  Conveyor conveyor(&connector, 3, true, QUEUE_IMPL_FAIR);
+  conveyor.PushDataBuffer(CreateFairData(0, 0, 0, 1));
+  conveyor.PushDataBuffer(CreateFairData(0, 1, 0, 1));
+  conveyor.PushDataBuffer(CreateFairData(1, 0, 0, 1));
+  conveyor.PushDataBuffer(CreateFairData(1, 1, 0, 1));
+  ASSERT_EQ(3u, conveyor.GetBufferSize());
+  /* the oldest frame of stream 0 was dropped */
+  std::vector<CNFrameInfoPtr> frames = conveyor.PopAllDataBuffer();
+  ASSERT_EQ(3u, frames.size());
+  EXPECT_EQ(0u, frames[0]->channel_idx);
+  EXPECT_EQ(1, frames[0]->frame.frame_id);
+  connector.Stop();
+}
+
+static std::vector<int64_t> PopFrameIds(Conveyor* conveyor) {
+  std::vector<int64_t> frame_ids;
+  for (auto& it : conveyor->PopAllDataBuffer()) frame_ids.push_back(it->frame.frame_id);
+  return frame_ids;
+}
+
+TEST(CoreConveyor, DropPolicies) {
+  auto run = [](DropPolicy policy, size_t low_watermark, int frame_cnt) {
+    LinkConfig config;
+    config.queue_capacity = 3;
+    config.drop_policy = policy;
+    config.drop_low_watermark = low_watermark;
+    Connector connector(1, config);
+    connector.Start();
+    Conveyor* conveyor = connector.GetConveyor(0);
+    /* a dropping queue never reports full */
+    for (int i = 0; i < frame_cnt; ++i) EXPECT_TRUE(conveyor->PushDataBufferNoWait(CreateFairData(0, i, 0, 1)));
+    std::vector<int64_t> frame_ids = PopFrameIds(conveyor);
+    LinkStatus status;
+    connector.GetDropStatus(&status);
+    EXPECT_EQ(static_cast<uint64_t>(frame_cnt - frame_ids.size()), status.dropped[0]);
+    connector.Stop();
+    return frame_ids;
+  };
+  EXPECT_EQ(std::vector<int64_t>({2, 3, 4}), run(DROP_OLDEST, 0, 5));
+  EXPECT_EQ(std::vector<int64_t>({0, 1, 2}), run(DROP_NEWEST, 0, 5));
+  /* down to the low watermark at once */
+  EXPECT_EQ(std::vector<int64_t>({2, 3}), run(DROP_OLDEST, 1, 4));
+}
+
+TEST(CoreConveyor, DropNewestHysteresis) {
+  LinkConfig config;
+  config.queue_capacity = 3;
+  config.drop_policy = DROP_NEWEST;
+  config.drop_low_watermark = 1;
+  Connector connector(1, config);
+  connector.Start();
+  Conveyor* conveyor = connector.GetConveyor(0);
+  for (int i = 0; i < 4; ++i) conveyor->PushDataBuffer(CreateFairData(0, i, 0, 1));
+  EXPECT_EQ(0, conveyor->PopDataBuffer()->frame.frame_id);
+  /* still above the low watermark */
+  conveyor->PushDataBuffer(CreateFairData(0, 4, 0, 1));
+  EXPECT_EQ(1, conveyor->PopDataBuffer()->frame.frame_id);
+  conveyor->PushDataBuffer(CreateFairData(0, 5, 0, 1));
+  EXPECT_EQ(std::vector<int64_t>({2, 5}), PopFrameIds(conveyor));
+  connector.Stop();
+}
+
+TEST(CoreConveyor, DropFromLargestStream) {
+  for (QueueImpl queue_impl : {QUEUE_IMPL_MUTEX, QUEUE_IMPL_FAIR}) {
+    LinkConfig config;
+    config.queue_capacity = 3;
+    config.queue_impl = queue_impl;
+    config.drop_policy = DROP_LARGEST_STREAM;
+    Connector connector(1, config);
+    connector.Start();
+    Conveyor* conveyor = connector.GetConveyor(0);
+    conveyor->PushDataBuffer(CreateFairData(1, 0, 0, 1));
+    conveyor->PushDataBuffer(CreateFairData(0, 0, 0, 1));
+    conveyor->PushDataBuffer(CreateFairData(0, 1, 0, 1));
+    conveyor->PushDataBuffer(CreateFairData(1, 1, 0, 1));
+    LinkStatus status;
+    connector.GetDropStatus(&status);
+    EXPECT_EQ(1u, status.dropped.size());
+    EXPECT_EQ(1u, status.dropped[0]);
+    std::vector<CNFrameInfoPtr> frames = conveyor->PopAllDataBuffer();
+    ASSERT_EQ(3u, frames.size());
+    for (auto& it : frames) {
+      if (0 == it->channel_idx) {
+        EXPECT_EQ(1, it->frame.frame_id);
+      }
+    }
+    connector.Stop();
+  }
+}
+
+TEST(CoreConveyor, DropKeepsEos) {
+  for (QueueImpl queue_impl : {QUEUE_IMPL_MUTEX, QUEUE_IMPL_FAIR}) {
+    for (DropPolicy policy : {DROP_OLDEST, DROP_NEWEST, DROP_LARGEST_STREAM}) {
+      LinkConfig config;
+      config.queue_capacity = 2;
+      config.queue_impl = queue_impl;
+      config.drop_policy = policy;
+      Connector connector(1, config);
+      connector.Start();
+      Conveyor* conveyor = connector.GetConveyor(0);
+      CNFrameInfoPtr eos = CNFrameInfo::Create("0", true);
+      eos->channel_idx = 0;
+      conveyor->PushDataBuffer(eos);
+      for (int i = 0; i < 3; ++i) conveyor->PushDataBuffer(CreateFairData(1, i, 0, 1));
+      CNFrameInfoPtr eos_1 = CNFrameInfo::Create("1", true);
+      eos_1->channel_idx = 1;
+      conveyor->PushDataBuffer(eos_1);
+      int eos_cnt = 0;
+      for (auto& it : conveyor->PopAllDataBuffer()) eos_cnt += (it->frame.flags & CN_FRAME_FLAG_EOS) ? 1 : 0;
+      EXPECT_EQ(2, eos_cnt) << "policy " << policy << " queue " << queue_impl;
+      connector.Stop();
+    }
+  }
+}
+
+TEST(CoreConveyor, SpillToFile) {
+  LinkConfig config;
+  config.queue_capacity = 2;
+  config.queue_impl = QUEUE_IMPL_SPILL;
+  Connector connector(1, config);
+  connector.Start();
+  Conveyor* conveyor = connector.GetConveyor(0);
+  std::vector<uint8_t> pixels(64 * 64 * 3 / 2);
+  auto create = [&](int64_t frame_id) {
+    CNFrameInfoPtr data = CNFrameInfo::Create("spill");
+    data->channel_idx = 0;
+    data->frame.frame_id = frame_id;
+    data->frame.ctx.dev_type = DevContext::CPU;
+    data->frame.fmt = CN_PIXEL_FORMAT_YUV420_NV12;
+    data->frame.width = data->frame.height = data->frame.stride[0] = data->frame.stride[1] = 64;
+    std::fill(pixels.begin(), pixels.end(), static_cast<uint8_t>(frame_id));
+    data->frame.ptr[0] = pixels.data();
+    data->frame.ptr[1] = pixels.data() + 64 * 64;
+    data->frame.CopyToSyncMem();
+    return data;
+  };
+  const uint64_t frame_bytes = 64 * 1024;
+  /* never blocks, frames beyond the capacity leave memory at the next push, the pushing side held them */
+  for (int i = 0; i < 6; ++i) conveyor->PushDataBuffer(create(i));
+  EXPECT_TRUE(conveyor->PushDataBufferNoWait(create(6)));
+  EXPECT_EQ(7u, conveyor->GetBufferSize());
+  EXPECT_EQ(5u, conveyor->GetSpilledSize());
+  EXPECT_EQ(3 * frame_bytes, GetStreamFrameMemoryUsage("spill").host_bytes);
+
+  /* a frame held by somebody else, e.g. the other branch of the pipeline, is spilled and kept in memory */
+  CNFrameInfoPtr held = create(7);
+  EXPECT_TRUE(conveyor->PushDataBufferNoWait(held));
+  EXPECT_TRUE(conveyor->PushDataBufferNoWait(create(8)));
+  EXPECT_EQ(7u, conveyor->GetSpilledSize());
+  EXPECT_EQ(4 * frame_bytes, GetStreamFrameMemoryUsage("spill").host_bytes);
+  EXPECT_NE(nullptr, held->frame.data[0].get());
+  held.reset();
+
+  /* frames which can not be spilled are kept in memory and the queue reports full */
+  CNFrameInfoPtr eos = CNFrameInfo::Create("spill", true);
+  eos->channel_idx = 0;
+  EXPECT_FALSE(conveyor->PushDataBufferNoWait(eos));
+  EXPECT_EQ(7u, conveyor->GetSpilledSize());
+  EXPECT_EQ(2 * frame_bytes, GetStreamFrameMemoryUsage("spill").host_bytes);
+  CNFrameInfoPtr eos_1 = CNFrameInfo::Create("spill", true);
+  eos_1->channel_idx = 0;
+  EXPECT_FALSE(conveyor->PushDataBufferNoWait(eos_1));
+  EXPECT_EQ(7u, conveyor->GetSpilledSize());
+
+  /* read back in order */
+  for (int i = 0; i < 9; ++i) {
+    CNFrameInfoPtr data = conveyor->PopDataBuffer();
+    ASSERT_NE(nullptr, data.get());
+    EXPECT_EQ(i, data->frame.frame_id);
+    const uint8_t* y = static_cast<const uint8_t*>(data->frame.data[0]->GetCpuData());
+    const uint8_t* uv = static_cast<const uint8_t*>(data->frame.data[1]->GetCpuData());
+    EXPECT_EQ(i, y[0]);
+    EXPECT_EQ(i, y[64 * 64 - 1]);
+    EXPECT_EQ(i, uv[64 * 32 - 1]);
+  }
+  EXPECT_EQ(0u, conveyor->GetSpilledSize());
+  EXPECT_TRUE(conveyor->PopDataBuffer()->frame.flags & CN_FRAME_FLAG_EOS);
+  EXPECT_TRUE(conveyor->PopDataBuffer()->frame.flags & CN_FRAME_FLAG_EOS);
+  connector.Stop();
+}
+
 }  // namespace cnstream
@@ -23,6 +23,7 @@
 
 #include <chrono>
 #include <ctime>
+#include <future>
 #include <string>
 #include <vector>
 
@@ -78,15 +79,18 @@ TEST(CoreEventBus, PollEvent) {
   event.message = "test poll";
   event.module = &pipe;
   EXPECT_EQ(bus->PollEvent().type, EVENT_STOP);
-  bus->ClearAllWatchers();
-  pipe.Start();
-  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  /* start the bus alone, the event loop of a started pipeline would take the event */
+  bus->Start();
   ASSERT_TRUE(bus->PostEvent(event));
   Event poll_e = bus->PollEvent();
   EXPECT_EQ(poll_e.type, event.type);
   EXPECT_EQ(poll_e.message, event.message);
   EXPECT_EQ(poll_e.module, event.module);
-  pipe.Stop();
+  /* a blocked poll is woken up by Stop */
+  auto stopped = std::async(std::launch::async, [&] { return bus->PollEvent().type; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  bus->Stop();
+  EXPECT_EQ(stopped.get(), EVENT_STOP);
 }
 
 TEST(CoreEventBus, ClearAllBusWatchers) {
@@ -23,6 +23,7 @@
 
 #include <cstdlib>
 #include <ctime>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -80,18 +81,62 @@ TEST(CoreModule, ModuleMask) {
 
   ModuleParamSet params;
   ASSERT_TRUE(module.Open(params));
-  EXPECT_EQ(module.GetId(), (uint32_t)0);
+  EXPECT_EQ(module.GetId(), static_cast<size_t>(-1)) << "id is set by pipeline";
+  module.SetId(3);
+  EXPECT_EQ(module.GetId(), 3u);
   for (uint32_t i = 0; i < mask_len; ++i) {
     module.SetParentId(rand_r(&seed) % mask_len);
   }
   std::vector<size_t> p_ids = module.GetParentIds();
-  for (auto &id : p_ids) {
-    mask |= (uint64_t)1 << id;
+  for (size_t i = 0; i < p_ids.size(); ++i) {
+    mask |= (uint64_t)1 << i;
   }
   EXPECT_EQ(module.GetModulesMask(), mask);
   module.Close();
 }
 
+TEST(CoreModule, FrameModuleMask) {
+  const size_t module_num = 40;
+  std::vector<std::shared_ptr<TestModuleBase>> modules;
+  for (size_t i = 0; i < module_num; ++i) {
+    modules.push_back(std::make_shared<TestModuleBase>());
+    modules.back()->SetId(i);
+  }
+  auto data = CNFrameInfo::Create("0");
+  data->frame.InitModuleMask(module_num);
+  TestModuleBase* join = modules[module_num - 1].get();
+  EXPECT_EQ(0u, data->frame.GetModulesMask(join));
+  EXPECT_EQ(0x1u, data->frame.SetModuleMask(join, 0));
+  EXPECT_EQ(0x5u, data->frame.SetModuleMask(join, 2));
+  EXPECT_EQ(0x5u, data->frame.GetModulesMask(join));
+  EXPECT_EQ(0u, data->frame.GetModulesMask(modules[0].get()));
+  data->frame.ClearModuleMask(join);
+  EXPECT_EQ(0u, data->frame.GetModulesMask(join));
+  /* allocated once */
+  data->frame.SetModuleMask(join, 1);
+  data->frame.InitModuleMask(module_num);
+  EXPECT_EQ(0x2u, data->frame.GetModulesMask(join));
+  /* all 64 bits are input links */
+  EXPECT_EQ(0x8000000000000002u, data->frame.SetModuleMask(join, 63));
+  EXPECT_FALSE(data->frame.IsModuleMaskJoined(join));
+  EXPECT_TRUE(data->frame.CloseModuleMask(join, ~(uint64_t)0));
+  EXPECT_TRUE(data->frame.IsModuleMaskJoined(join));
+  EXPECT_FALSE(data->frame.CompleteModuleMask(join));
+  data->frame.ClearModuleMask(join);
+  EXPECT_FALSE(data->frame.IsModuleMaskJoined(join));
+
+  for (size_t i = 0; i < module_num; ++i) {
+    EXPECT_EQ(i + 1, data->frame.AddEOSMask(modules[i].get()));
+  }
+
+  /* a frame never provided to a pipeline has no masks */
+  auto other = CNFrameInfo::Create("0");
+  EXPECT_EQ(0u, other->frame.SetModuleMask(join, 0));
+  EXPECT_EQ(0u, other->frame.GetModulesMask(join));
+  EXPECT_FALSE(other->frame.CloseModuleMask(join, 0x3));
+  other->frame.ClearModuleMask(join);
+}
+
 TEST(CoreModule, TransmitAttr) {
   TestModuleBase module;
   EXPECT_FALSE(module.hasTranmit());
@@ -18,18 +18,30 @@
  * THE SOFTWARE.
  *************************************************************************/
 
+#include <dirent.h>
 #include <gtest/gtest.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <ctime>
+#include <fstream>
 #include <future>
+#include <iostream>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <random>
+#include <set>
+#include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 #include "cnstream_frame.hpp"
 #include "cnstream_pipeline.hpp"
+#include "cnstream_syncmem.hpp"
+#include "cpu_placement.hpp"
 
 /*
   1. check frame count after processing
@@ -129,7 +141,10 @@ static const std::vector<std::vector<std::list<int>>> g_neighbor_lists = {
 
 class TestProcessor : public cnstream::Module {
  public:
-  explicit TestProcessor(const std::string& name, int chns) : Module(name) { cnts_.resize(chns); }
+  explicit TestProcessor(const std::string& name, int chns) : Module(name) {
+    cnts_.resize(chns);
+    last_frame_ids_.resize(chns, -1);
+  }
   bool Open(cnstream::ModuleParamSet param_set) override {
     opened_ = true;
     return true;
@@ -140,6 +155,9 @@ class TestProcessor : public cnstream::Module {
     EXPECT_NE(1, cnstream::CNFrameFlag::CN_FRAME_FLAG_EOS & data->frame.flags);
     uint32_t chn_idx = data->channel_idx;
     cnts_[chn_idx]++;
+    /* frames of a stream are processed in order */
+    EXPECT_GT(data->frame.frame_id, last_frame_ids_[chn_idx]) << GetName() << " chn " << chn_idx;
+    last_frame_ids_[chn_idx] = data->frame.frame_id;
     return 0;
   }
   std::vector<uint64_t> GetCnts() const { return cnts_; }
@@ -147,6 +165,7 @@ class TestProcessor : public cnstream::Module {
  private:
   bool opened_ = false;
   std::vector<uint64_t> cnts_;
+  std::vector<int64_t> last_frame_ids_;
   static std::atomic<int> id_;
 };  // class TestProcessor
 
@@ -241,11 +260,14 @@ struct FailureDesc {
 };
 
 std::pair<std::vector<std::shared_ptr<cnstream::Module>>, std::shared_ptr<cnstream::Pipeline>>
-CreatePipelineByNeighborList(const std::vector<std::list<int>>& neighbor_list, FailureDesc fdesc = {-1, -1}) {
+CreatePipelineByNeighborList(const std::vector<std::list<int>>& neighbor_list, FailureDesc fdesc = {-1, -1},
+                             const cnstream::LinkConfig& link_config = cnstream::LinkConfig(),
+                             const cnstream::PipelineConfig& pipeline_config = cnstream::PipelineConfig()) {
   std::default_random_engine e(time(NULL));
   std::uniform_int_distribution<> chns_randomer(__MIN_CHN_CNT__, __MAX_CHN_CNT__);
   auto chns = chns_randomer(e);
   auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  pipeline->SetPipelineConfig(pipeline_config);
   std::vector<std::shared_ptr<cnstream::Module>> modules;
   int processors_cnt = static_cast<int>(neighbor_list.size());
   modules.push_back(std::make_shared<TestProvider>(chns, pipeline.get()));
@@ -283,7 +305,7 @@ CreatePipelineByNeighborList(const std::vector<std::list<int>>& neighbor_list, F
   LOG(INFO) << "Graph:";
   for (size_t i = 0; i < modules.size(); ++i) {
     for (auto it : neighbor_list[i]) {
-      EXPECT_TRUE("" != pipeline->LinkModules(modules[i], modules[it]));
+      EXPECT_TRUE("" != pipeline->LinkModules(modules[i], modules[it], link_config));
       LOG(INFO) << i << " ---> " << it;
     }
   }
@@ -291,8 +313,10 @@ CreatePipelineByNeighborList(const std::vector<std::list<int>>& neighbor_list, F
   return {modules, pipeline};
 }
 
-void TestProcess(const std::vector<std::list<int>>& neighbor_list) {
-  auto pipeline_and_modules = CreatePipelineByNeighborList(neighbor_list);
+void TestProcess(const std::vector<std::list<int>>& neighbor_list,
+                 const cnstream::LinkConfig& link_config = cnstream::LinkConfig(),
+                 const cnstream::PipelineConfig& pipeline_config = cnstream::PipelineConfig()) {
+  auto pipeline_and_modules = CreatePipelineByNeighborList(neighbor_list, {-1, -1}, link_config, pipeline_config);
   auto pipeline = pipeline_and_modules.second;
   auto modules = pipeline_and_modules.first;
   auto provider = dynamic_cast<TestProvider*>(modules[0].get());
@@ -316,11 +340,13 @@ void TestProcess(const std::vector<std::list<int>>& neighbor_list) {
   }
 }
 
-void TestProcessFailure(const std::vector<std::list<int>>& neighbor_list, int process_ret) {
+void TestProcessFailure(const std::vector<std::list<int>>& neighbor_list, int process_ret,
+                        const cnstream::PipelineConfig& pipeline_config = cnstream::PipelineConfig()) {
   std::default_random_engine e(time(NULL));
   std::uniform_int_distribution<> randomer(1, neighbor_list.size() - 1);
   int failure_module_idx = randomer(e);
-  auto pipeline_and_modules = CreatePipelineByNeighborList(neighbor_list, {failure_module_idx, process_ret});
+  auto pipeline_and_modules = CreatePipelineByNeighborList(neighbor_list, {failure_module_idx, process_ret},
+                                                           cnstream::LinkConfig(), pipeline_config);
   auto pipeline = pipeline_and_modules.second;
   auto modules = pipeline_and_modules.first;
   auto provider = dynamic_cast<TestProvider*>(modules[0].get());
@@ -343,3 +369,2145 @@ TEST(CorePipeline, Pipeline) {
   }
   TestProcess(g_neighbor_lists[0]);
 }
+
+TEST(CorePipeline, PipelineWithRingQueue) {
+  cnstream::LinkConfig link_config;
+  link_config.queue_impl = cnstream::QUEUE_IMPL_RING;
+  for (auto& it : g_neighbor_lists) {
+    TestProcess(it, link_config);
+  }
+}
+
+TEST(CorePipeline, PipelineWithWorkerPool) {
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = cnstream::SCHEDULER_WORKER_POOL;
+  pipeline_config.workerNum = 4;
+  cnstream::LinkConfig ring_link;
+  ring_link.queue_impl = cnstream::QUEUE_IMPL_RING;
+  for (auto& it : g_neighbor_lists) {
+    TestProcess(it, cnstream::LinkConfig(), pipeline_config);
+    TestProcess(it, ring_link, pipeline_config);
+    TestProcessFailure(it, -1, pipeline_config);
+  }
+}
+
+TEST(CorePipeline, ParsePipelineConfig) {
+  cnstream::PipelineConfig config;
+  config.ParseByJSONStr("{}");
+  EXPECT_EQ(cnstream::SCHEDULER_THREAD, config.scheduler);
+  EXPECT_EQ(0u, config.workerNum);
+  config.ParseByJSONStr("{\"scheduler\": \"worker_pool\", \"worker_num\": 8}");
+  EXPECT_EQ(cnstream::SCHEDULER_WORKER_POOL, config.scheduler);
+  EXPECT_EQ(8u, config.workerNum);
+  EXPECT_THROW(config.ParseByJSONStr("{\"scheduler\": \"fiber\"}"), std::string);
+  EXPECT_THROW(config.ParseByJSONStr("{\"worker_num\": -1}"), std::string);
+  /* modules are opened one after another unless set */
+  EXPECT_EQ(1u, config.openThreadNum);
+  config.ParseByJSONStr("{\"open_thread_num\": 4}");
+  EXPECT_EQ(4u, config.openThreadNum);
+  EXPECT_THROW(config.ParseByJSONStr("{\"open_thread_num\": \"4\"}"), std::string);
+}
+
+TEST(CorePipeline, ParseQueueImpl) {
+  cnstream::CNModuleConfig config;
+  config.ParseByJSONStr("{\"class_name\": \"test\"}");
+  EXPECT_EQ(cnstream::QUEUE_IMPL_MUTEX, config.queueImpl);
+  config.ParseByJSONStr("{\"class_name\": \"test\", \"queue_impl\": \"ring\"}");
+  EXPECT_EQ(cnstream::QUEUE_IMPL_RING, config.queueImpl);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"queue_impl\": \"list\"}"), std::string);
+}
+
+class TestDelayProcessor : public TestProcessor {
+ public:
+  TestDelayProcessor(const std::string& name, int delay_ms) : TestProcessor(name, 1), delay_ms_(delay_ms) {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    if (delay_ms_ > 0) std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms_));
+    processed_++;
+    return 0;
+  }
+  int GetProcessed() const { return processed_.load(); }
+
+ private:
+  int delay_ms_ = 0;
+  std::atomic<int> processed_{0};
+};  // class TestDelayProcessor
+
+/* records how far the watched module got when this module has processed all frames */
+class TestWatchProcessor : public TestDelayProcessor {
+ public:
+  TestWatchProcessor(const std::string& name, const TestDelayProcessor* watched, int frame_cnt)
+      : TestDelayProcessor(name, 0), watched_(watched), frame_cnt_(frame_cnt) {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    TestDelayProcessor::Process(data);
+    if (GetProcessed() == frame_cnt_) watched_processed_ = watched_->GetProcessed();
+    return 0;
+  }
+  int GetWatchedProcessed() const { return watched_processed_.load(); }
+
+ private:
+  const TestDelayProcessor* watched_ = nullptr;
+  int frame_cnt_ = 0;
+  std::atomic<int> watched_processed_{-1};
+};  // class TestWatchProcessor
+
+/*
+  source ---> slow ---> join
+    |                    ^
+      ---> fast ---------|
+             |
+               ---> tail
+  join waits on both input links at once, so it keeps draining the fast branch while the slow
+  one is busy. tail must get all frames long before slow is done.
+ */
+TEST(CorePipeline, FastBranchNotBlockedBySlowBranch) {
+  const int frame_cnt = 20;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto slow = std::make_shared<TestDelayProcessor>("slow", 20);
+  auto fast = std::make_shared<TestDelayProcessor>("fast", 0);
+  auto join = std::make_shared<TestDelayProcessor>("join", 0);
+  auto tail = std::make_shared<TestWatchProcessor>("tail", slow.get(), frame_cnt);
+  for (auto module : std::vector<std::shared_ptr<cnstream::Module>>{source, slow, fast, join, tail}) {
+    pipeline->AddModule(module);
+    EXPECT_TRUE(pipeline->SetModuleParallelism(module, module == source ? 0 : 1));
+  }
+  cnstream::LinkConfig small_link;
+  small_link.queue_capacity = 2;
+  cnstream::LinkConfig large_link;
+  large_link.queue_capacity = frame_cnt + 1;
+  EXPECT_NE("", pipeline->LinkModules(source, slow, large_link));
+  EXPECT_NE("", pipeline->LinkModules(source, fast, small_link));
+  EXPECT_NE("", pipeline->LinkModules(slow, join, small_link));
+  EXPECT_NE("", pipeline->LinkModules(fast, join, small_link));
+  EXPECT_NE("", pipeline->LinkModules(fast, tail, small_link));
+
+  MsgObserver msg_observer(1, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i < frame_cnt; ++i) {
+    auto data = cnstream::CNFrameInfo::Create("0");
+    data->channel_idx = 0;
+    data->frame.frame_id = i;
+    EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+  }
+  auto data = cnstream::CNFrameInfo::Create("0", true);
+  data->channel_idx = 0;
+  EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+
+  EXPECT_EQ(frame_cnt, slow->GetProcessed());
+  EXPECT_EQ(frame_cnt, join->GetProcessed());
+  EXPECT_EQ(frame_cnt, tail->GetProcessed());
+  EXPECT_GE(tail->GetWatchedProcessed(), 0);
+  EXPECT_LT(tail->GetWatchedProcessed(), frame_cnt / 2);
+}
+
+static int GetThreadNum() {
+  int thread_num = 0;
+  DIR* dir = opendir("/proc/self/task");
+  if (!dir) return 0;
+  while (dirent* entry = readdir(dir)) {
+    if ('.' != entry->d_name[0]) ++thread_num;
+  }
+  closedir(dir);
+  return thread_num;
+}
+
+/*
+  10 modules in a chain, 8 threads each, compares thread per data queue with the worker pool. threads is the
+  number of threads the pipeline runs.
+ */
+static void RunSchedulerBenchmark(cnstream::SchedulerMode scheduler, double* fps, long* context_switches,
+                                  int* threads) {
+  const int module_cnt = 10;
+  const int chn_cnt = 16;
+  const int frame_cnt = 100;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline->SetPipelineConfig(pipeline_config);
+  std::vector<std::shared_ptr<TestProcessor>> modules;
+  modules.push_back(std::make_shared<TestProcessor>("source", chn_cnt));
+  for (int i = 1; i < module_cnt; ++i) {
+    modules.push_back(std::make_shared<TestProcessor>("TestProcessor" + std::to_string(i), chn_cnt));
+  }
+  for (int i = 0; i < module_cnt; ++i) {
+    pipeline->AddModule(modules[i]);
+    EXPECT_TRUE(pipeline->SetModuleParallelism(modules[i], 0 == i ? 0 : 8));
+    /* each module on its own threads or tasks, see ChainFusionBenchmark for fused chains */
+    EXPECT_TRUE(pipeline->DisableModuleFusion(modules[i], true));
+    if (i > 0) {
+      EXPECT_NE("", pipeline->LinkModules(modules[i - 1], modules[i]));
+    }
+  }
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  struct rusage usage_start, usage_end;
+  getrusage(RUSAGE_SELF, &usage_start);
+  auto start = std::chrono::steady_clock::now();
+  const int thread_num = GetThreadNum();
+  ASSERT_TRUE(pipeline->Start());
+  *threads = GetThreadNum() - thread_num;
+  std::vector<std::thread> feeders;
+  for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+    feeders.push_back(std::thread([&, chn_idx]() {
+      for (int i = 0; i <= frame_cnt; ++i) {
+        auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), frame_cnt == i);
+        data->channel_idx = chn_idx;
+        data->frame.frame_id = i;
+        pipeline->ProvideData(modules[0].get(), data);
+      }
+    }));
+  }
+  for (auto& it : feeders) it.join();
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  getrusage(RUSAGE_SELF, &usage_end);
+
+  for (int i = 1; i < module_cnt; ++i) {
+    for (auto cnt : modules[i]->GetCnts()) EXPECT_EQ(static_cast<uint64_t>(frame_cnt), cnt);
+  }
+  *fps = chn_cnt * frame_cnt / elapsed.count();
+  *context_switches = (usage_end.ru_nvcsw - usage_start.ru_nvcsw) + (usage_end.ru_nivcsw - usage_start.ru_nivcsw);
+}
+
+TEST(CorePipeline, SchedulerBenchmark) {
+  double thread_fps = 0, pool_fps = 0;
+  long thread_switches = 0, pool_switches = 0;
+  int thread_threads = 0, pool_threads = 0;
+  RunSchedulerBenchmark(cnstream::SCHEDULER_THREAD, &thread_fps, &thread_switches, &thread_threads);
+  RunSchedulerBenchmark(cnstream::SCHEDULER_WORKER_POOL, &pool_fps, &pool_switches, &pool_threads);
+  const std::string result = "thread: " + std::to_string(thread_fps) + " frames/s, " +
+                             std::to_string(thread_switches) + " context switches, " +
+                             std::to_string(thread_threads) + " threads. worker_pool: " + std::to_string(pool_fps) +
+                             " frames/s, " + std::to_string(pool_switches) + " context switches, " +
+                             std::to_string(pool_threads) + " threads";
+  /* one worker for each core instead of one thread for each of the 9 modules and its 8 data queues */
+  const int worker_num = static_cast<int>(std::thread::hardware_concurrency());
+  EXPECT_GE(thread_threads - pool_threads, 9 * 8 - worker_num) << result;
+  /* the workers run tasks back to back, they do not go to sleep after each of the 16 * 100 * 9 hops */
+  EXPECT_LT(pool_switches, 16 * 100 * 9) << result;
+}
+
+TEST(CorePipeline, ParseDispatchPolicy) {
+  cnstream::CNModuleConfig config;
+  config.ParseByJSONStr("{\"class_name\": \"test\"}");
+  EXPECT_EQ(cnstream::DISPATCH_MODULO, config.dispatchPolicy);
+  config.ParseByJSONStr("{\"class_name\": \"test\", \"dispatch\": \"least_loaded\"}");
+  EXPECT_EQ(cnstream::DISPATCH_LEAST_LOADED, config.dispatchPolicy);
+  config.ParseByJSONStr("{\"class_name\": \"test\", \"dispatch\": \"consistent_hash\"}");
+  EXPECT_EQ(cnstream::DISPATCH_CONSISTENT_HASH, config.dispatchPolicy);
+  config.ParseByJSONStr("{\"class_name\": \"test\", \"dispatch\": \"spread\"}");
+  EXPECT_EQ(cnstream::DISPATCH_SPREAD, config.dispatchPolicy);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"dispatch\": \"random\"}"), std::string);
+}
+
+/* channel 0 and 2 are heavy, channel 1 and 3 are light */
+class TestUnevenProcessor : public TestProcessor {
+ public:
+  explicit TestUnevenProcessor(const std::string& name) : TestProcessor(name, 4) {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    int delay_ms = data->channel_idx % 2 ? 1 : 4;
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+    return 0;
+  }
+};  // class TestUnevenProcessor
+
+/*
+  4 streams on 2 threads. modulo puts both heavy streams on the same thread,
+  returns the largest busy time among the data queues of the link.
+ */
+static double RunUnevenStreams(cnstream::DispatchPolicy policy) {
+  const int chn_cnt = 4;
+  const int frame_cnt = 100;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  auto source = std::make_shared<TestProcessor>("source", chn_cnt);
+  auto worker = std::make_shared<TestUnevenProcessor>("worker");
+  pipeline->AddModule(source);
+  pipeline->AddModule(worker);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(worker, 2));
+  cnstream::LinkConfig link_config;
+  link_config.dispatch_policy = policy;
+  std::string link_id = pipeline->LinkModules(source, worker, link_config);
+  EXPECT_NE("", link_id);
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  EXPECT_TRUE(pipeline->Start());
+  for (int i = 0; i <= frame_cnt; ++i) {
+    for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+      auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), frame_cnt == i);
+      data->channel_idx = chn_idx;
+      data->frame.frame_id = i;
+      EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+
+  cnstream::LinkStatus status;
+  EXPECT_TRUE(pipeline->QueryLinkStatus(&status, link_id));
+  EXPECT_EQ(2u, status.busy_ms.size());
+  EXPECT_EQ(2u, status.dispatched.size());
+  uint64_t dispatched = 0;
+  for (auto it : status.dispatched) dispatched += it;
+  EXPECT_EQ(static_cast<uint64_t>(chn_cnt * (frame_cnt + 1)), dispatched);
+  return *std::max_element(status.busy_ms.begin(), status.busy_ms.end());
+}
+
+TEST(CorePipeline, LeastLoadedDispatchBalancesUnevenStreams) {
+  double modulo_ms = RunUnevenStreams(cnstream::DISPATCH_MODULO);
+  double least_loaded_ms = RunUnevenStreams(cnstream::DISPATCH_LEAST_LOADED);
+  std::cout << "[Uneven streams] busiest thread, modulo: " << modulo_ms << " ms, least_loaded: " << least_loaded_ms
+            << " ms." << std::endl;
+  EXPECT_LT(least_loaded_ms, 0.9 * modulo_ms);
+}
+
+/*
+  transmits data by itself like Inferencer: each thread holds the frames in a batch, which is transmitted once full.
+  channel 0 and 2 are heavy, channel 1 and 3 are light.
+ */
+class TestBatchTransmitter : public cnstream::ModuleEx {
+ public:
+  explicit TestBatchTransmitter(const std::string& name) : ModuleEx(name) {}
+  bool Open(cnstream::ModuleParamSet param_set) override { return true; }
+  void Close() override {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    std::vector<std::shared_ptr<cnstream::CNFrameInfo>> ready;
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      auto& batch = batches_[std::this_thread::get_id()];
+      batch.push_back(data);
+      if (batch.size() < kBatchSize && !(data->frame.flags & cnstream::CN_FRAME_FLAG_EOS)) return 1;
+      ready.swap(batch);
+    }
+    /* a batch with a frame of the heavy stream takes long */
+    bool heavy = false;
+    for (auto& it : ready) heavy = heavy || kHeavyChannel == it->channel_idx;
+    std::this_thread::sleep_for(std::chrono::milliseconds(heavy ? 5 : 1));
+    for (auto& it : ready) container_->ProvideData(this, it);
+    return 1;
+  }
+
+ private:
+  static constexpr size_t kBatchSize = 4;
+  static constexpr uint32_t kHeavyChannel = 2;
+  std::mutex mutex_;
+  std::map<std::thread::id, std::vector<std::shared_ptr<cnstream::CNFrameInfo>>> batches_;
+};  // class TestBatchTransmitter
+
+constexpr size_t TestBatchTransmitter::kBatchSize;
+constexpr uint32_t TestBatchTransmitter::kHeavyChannel;
+
+/*
+  source ---> batcher(2 threads, least_loaded) ---> checker
+  stream 0 shares a thread with the heavy stream 2 and is moved to the thread of stream 1, it is moved only once
+  its frames held in a batch have been transmitted, the checker gets the frames of each stream in order.
+ */
+static void RunLeastLoadedBatchPipeline() {
+  const int chn_cnt = 3;
+  const int frame_cnt = 100;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  auto source = std::make_shared<TestProcessor>("source", chn_cnt);
+  auto batcher = std::make_shared<TestBatchTransmitter>("batcher");
+  auto checker = std::make_shared<TestProcessor>("checker", chn_cnt);
+  pipeline->AddModule(source);
+  pipeline->AddModule(batcher);
+  pipeline->AddModule(checker);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(batcher, 2));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(checker, 1));
+  cnstream::LinkConfig link_config;
+  link_config.dispatch_policy = cnstream::DISPATCH_LEAST_LOADED;
+  std::string link_id = pipeline->LinkModules(source, batcher, link_config);
+  EXPECT_NE("", link_id);
+  EXPECT_NE("", pipeline->LinkModules(batcher, checker));
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  EXPECT_TRUE(pipeline->Start());
+  cnstream::LinkStatus status;
+  bool moved = false;
+  for (int i = 0; i <= frame_cnt; ++i) {
+    for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+      auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), frame_cnt == i);
+      data->channel_idx = chn_idx;
+      data->frame.frame_id = i;
+      EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    }
+    if (i < frame_cnt) {
+      EXPECT_TRUE(pipeline->QueryLinkStatus(&status, link_id));
+      moved = moved || (2u == status.stream_cnt.size() && 2u == status.stream_cnt[1]);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  EXPECT_TRUE(moved);
+  for (auto cnt : checker->GetCnts()) EXPECT_EQ(static_cast<uint64_t>(frame_cnt), cnt);
+}
+
+TEST(CorePipeline, LeastLoadedDispatchWaitsForHeldFrames) {
+  /* where the batches stand when the stream is moved varies from run to run */
+  for (int i = 0; i < 2; ++i) RunLeastLoadedBatchPipeline();
+}
+
+/*
+  module ids are allocated per pipeline, more than 64 modules may live in one process.
+ */
+TEST(CorePipeline, ManyModulesInSeveralPipelines) {
+  const int pipeline_cnt = 3;
+  const int module_cnt = 40;
+  const int frame_cnt = 10;
+  std::vector<std::shared_ptr<cnstream::Pipeline>> pipelines;
+  std::vector<std::vector<std::shared_ptr<TestProcessor>>> modules(pipeline_cnt);
+  for (int p = 0; p < pipeline_cnt; ++p) {
+    auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline" + std::to_string(p));
+    /*
+      source ---> m1 ---> m2 ... ---> m39
+        |                              ^
+          -----------------------------|
+     */
+    for (int i = 0; i < module_cnt; ++i) {
+      modules[p].push_back(std::make_shared<TestProcessor>("TestProcessor" + std::to_string(i), 1));
+      EXPECT_TRUE(pipeline->AddModule(modules[p][i]));
+      EXPECT_EQ(static_cast<size_t>(i), modules[p][i]->GetId());
+      EXPECT_TRUE(pipeline->SetModuleParallelism(modules[p][i], 0 == i ? 0 : 1));
+      if (i > 0) {
+        EXPECT_NE("", pipeline->LinkModules(modules[p][i - 1], modules[p][i]));
+      }
+    }
+    EXPECT_NE("", pipeline->LinkModules(modules[p][0], modules[p][module_cnt - 1]));
+    pipelines.push_back(pipeline);
+  }
+  /* a module belongs to one pipeline */
+  EXPECT_FALSE(pipelines[1]->AddModule(modules[0][1]));
+
+  std::vector<std::unique_ptr<MsgObserver>> observers;
+  for (int p = 0; p < pipeline_cnt; ++p) {
+    observers.emplace_back(new MsgObserver(1, pipelines[p]));
+    pipelines[p]->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(observers[p].get()));
+    ASSERT_TRUE(pipelines[p]->Start());
+  }
+  for (int i = 0; i <= frame_cnt; ++i) {
+    for (int p = 0; p < pipeline_cnt; ++p) {
+      auto data = cnstream::CNFrameInfo::Create("0", frame_cnt == i);
+      data->channel_idx = 0;
+      data->frame.frame_id = i;
+      EXPECT_TRUE(pipelines[p]->ProvideData(modules[p][0].get(), data));
+    }
+  }
+  for (int p = 0; p < pipeline_cnt; ++p) {
+    EXPECT_EQ(MsgObserver::STOP_BY_EOS, observers[p]->WaitForStop());
+    for (int i = 1; i < module_cnt; ++i) {
+      EXPECT_EQ(static_cast<uint64_t>(frame_cnt), modules[p][i]->GetCnts()[0]);
+    }
+  }
+}
+
+/*
+  per hop cost of the framework: a chain of modules which do nothing.
+ */
+static double RunPerHopBenchmark(cnstream::SchedulerMode scheduler, bool fusion = false, int module_cnt = 16) {
+  const int chn_cnt = 4;
+  const int frame_cnt = 2000;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline->SetPipelineConfig(pipeline_config);
+  std::vector<std::shared_ptr<TestDelayProcessor>> modules;
+  for (int i = 0; i < module_cnt; ++i) {
+    modules.push_back(std::make_shared<TestDelayProcessor>("TestNoopProcessor" + std::to_string(i), 0));
+    pipeline->AddModule(modules[i]);
+    EXPECT_TRUE(pipeline->SetModuleParallelism(modules[i], 0 == i ? 0 : 1));
+    EXPECT_TRUE(pipeline->DisableModuleFusion(modules[i], !fusion));
+    if (i > 0) {
+      cnstream::LinkConfig link_config;
+      link_config.queue_capacity = 64;
+      EXPECT_NE("", pipeline->LinkModules(modules[i - 1], modules[i], link_config));
+    }
+  }
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  EXPECT_TRUE(pipeline->Start());
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i <= frame_cnt; ++i) {
+    for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+      auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), frame_cnt == i);
+      data->channel_idx = chn_idx;
+      data->frame.frame_id = i;
+      pipeline->ProvideData(modules[0].get(), data);
+    }
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(chn_cnt * frame_cnt, modules[module_cnt - 1]->GetProcessed());
+  return elapsed.count() / (chn_cnt * frame_cnt * (module_cnt - 1));
+}
+
+TEST(CorePipeline, PerHopBenchmark) {
+  /*
+    a hop is a push, a pop and the routing of the frame, around 1 us on a desktop core. The baseline leaves
+    room for slow machines and debug builds, a hop waiting on a timer or a lock held elsewhere goes far over it.
+   */
+  const double baseline_ns = 20000;
+  EXPECT_LT(RunPerHopBenchmark(cnstream::SCHEDULER_THREAD), baseline_ns);
+  EXPECT_LT(RunPerHopBenchmark(cnstream::SCHEDULER_WORKER_POOL), baseline_ns);
+}
+
+/*
+  the frames are handed from the test thread to the first module either way, the difference between a long chain
+  and a short one is the cost of the hops alone. a chain of two modules has nothing to fuse, it is the same short
+  chain for both. the runs with and without fusion take turns and the best of each is kept, the others are slowed
+  down by whatever else the machine does.
+ */
+static void RunChainHopBenchmark(cnstream::SchedulerMode scheduler, double* fused_ns, double* unfused_ns) {
+  const int long_cnt = 16;
+  const int short_cnt = 2;
+  const int run_cnt = 5;
+  double long_ns[2] = {0, 0}, short_ns = 0;
+  for (int i = 0; i < run_cnt; ++i) {
+    for (int fusion = 0; fusion < 2; ++fusion) {
+      double ns = RunPerHopBenchmark(scheduler, fusion, long_cnt) * (long_cnt - 1);
+      if (0 == i || ns < long_ns[fusion]) long_ns[fusion] = ns;
+      ns = RunPerHopBenchmark(scheduler, fusion, short_cnt) * (short_cnt - 1);
+      if ((0 == i && 0 == fusion) || ns < short_ns) short_ns = ns;
+    }
+  }
+  *fused_ns = (long_ns[1] - short_ns) / (long_cnt - short_cnt);
+  *unfused_ns = (long_ns[0] - short_ns) / (long_cnt - short_cnt);
+}
+
+TEST(CorePipeline, ChainFusionBenchmark) {
+  /* a fused hop is a function call, no push and pop */
+  for (auto scheduler : {cnstream::SCHEDULER_THREAD, cnstream::SCHEDULER_WORKER_POOL}) {
+    double fused_ns = 0, unfused_ns = 0;
+    RunChainHopBenchmark(scheduler, &fused_ns, &unfused_ns);
+    EXPECT_LT(fused_ns, unfused_ns) << "scheduler " << scheduler;
+  }
+}
+
+/* records the thread it processes frames on */
+class TestThreadProcessor : public TestProcessor {
+ public:
+  TestThreadProcessor(const std::string& name, int chns) : TestProcessor(name, chns) {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    std::lock_guard<std::mutex> lk(mutex_);
+    threads_.insert(std::this_thread::get_id());
+    return TestProcessor::Process(data);
+  }
+  std::set<std::thread::id> GetThreads() const {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return threads_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::set<std::thread::id> threads_;
+};  // class TestThreadProcessor
+
+/*
+  source ---> first ---> second ---> third ---> fourth
+  second and third run on the threads of first, fourth does not take part in fusion.
+ */
+TEST(CorePipeline, ChainFusion) {
+  const int chn_cnt = 4;
+  const int frame_cnt = 50;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  auto source = std::make_shared<TestProcessor>("source", chn_cnt);
+  std::vector<std::shared_ptr<TestThreadProcessor>> chain;
+  for (auto name : {"first", "second", "third", "fourth"}) {
+    chain.push_back(std::make_shared<TestThreadProcessor>(name, chn_cnt));
+  }
+  pipeline->AddModule(source);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  std::vector<std::string> link_ids;
+  std::shared_ptr<cnstream::Module> up_node = source;
+  for (auto& it : chain) {
+    pipeline->AddModule(it);
+    EXPECT_TRUE(pipeline->SetModuleParallelism(it, 2));
+    link_ids.push_back(pipeline->LinkModules(up_node, it));
+    EXPECT_NE("", link_ids.back());
+    up_node = it;
+  }
+  EXPECT_TRUE(pipeline->DisableModuleFusion(chain[3]));
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i <= frame_cnt; ++i) {
+    for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+      auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), frame_cnt == i);
+      data->channel_idx = chn_idx;
+      data->frame.frame_id = i;
+      EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    }
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+
+  for (auto& it : chain) {
+    for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+      EXPECT_EQ(static_cast<uint64_t>(frame_cnt), it->GetCnts()[chn_idx]) << it->GetName();
+    }
+  }
+  EXPECT_EQ(2u, chain[0]->GetThreads().size());
+  EXPECT_EQ(chain[0]->GetThreads(), chain[1]->GetThreads());
+  EXPECT_EQ(chain[0]->GetThreads(), chain[2]->GetThreads());
+  for (auto& thread_id : chain[3]->GetThreads()) EXPECT_EQ(0u, chain[0]->GetThreads().count(thread_id));
+  /* fused links still count the frames they pass */
+  cnstream::LinkStatus status;
+  EXPECT_TRUE(pipeline->QueryLinkStatus(&status, link_ids[1]));
+  EXPECT_EQ(static_cast<uint64_t>(chn_cnt * (frame_cnt + 1)), status.dispatched[0] + status.dispatched[1]);
+}
+
+/*
+  source -(least_loaded)-> first ---> second
+  a stream may reach first on either thread, so second is not fused and keeps its own threads.
+ */
+TEST(CorePipeline, ChainFusionNeedsModuloUpstream) {
+  const int chn_cnt = 4;
+  const int frame_cnt = 50;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  auto source = std::make_shared<TestProcessor>("source", chn_cnt);
+  auto first = std::make_shared<TestThreadProcessor>("first", chn_cnt);
+  auto second = std::make_shared<TestThreadProcessor>("second", chn_cnt);
+  pipeline->AddModule(source);
+  pipeline->AddModule(first);
+  pipeline->AddModule(second);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(first, 2));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(second, 2));
+  cnstream::LinkConfig link_config;
+  link_config.dispatch_policy = cnstream::DISPATCH_LEAST_LOADED;
+  EXPECT_NE("", pipeline->LinkModules(source, first, link_config));
+  EXPECT_NE("", pipeline->LinkModules(first, second));
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i <= frame_cnt; ++i) {
+    for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+      auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), frame_cnt == i);
+      data->channel_idx = chn_idx;
+      data->frame.frame_id = i;
+      EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    }
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+
+  for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+    EXPECT_EQ(static_cast<uint64_t>(frame_cnt), second->GetCnts()[chn_idx]);
+  }
+  for (auto& thread_id : second->GetThreads()) EXPECT_EQ(0u, first->GetThreads().count(thread_id));
+}
+
+TEST(CorePipeline, ParseDisableFusion) {
+  cnstream::CNModuleConfig config;
+  config.ParseByJSONStr("{\"class_name\": \"test\"}");
+  EXPECT_FALSE(config.disableFusion);
+  config.ParseByJSONStr("{\"class_name\": \"test\", \"disable_fusion\": true}");
+  EXPECT_TRUE(config.disableFusion);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"disable_fusion\": 1}"), std::string);
+}
+
+/* records the batch sizes it gets, fails on frame fail_frame_id of channel 0 if it is not negative */
+class TestBatchProcessor : public TestProcessor {
+ public:
+  TestBatchProcessor(const std::string& name, int chns, uint32_t batch_size, int fail_frame_id = -1)
+      : TestProcessor(name, chns), fail_frame_id_(fail_frame_id) {
+    SetBatchSize(batch_size);
+  }
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    if (0 == data->channel_idx && fail_frame_id_ == data->frame.frame_id) return -1;
+    return TestProcessor::Process(data);
+  }
+  int ProcessBatch(std::vector<std::shared_ptr<cnstream::CNFrameInfo>>& data) override {
+    EXPECT_LE(data.size(), GetBatchSize());
+    /* let the burst queue up */
+    if (0 == batches_) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    max_batch_ = std::max(max_batch_, data.size());
+    batches_++;
+    return Module::ProcessBatch(data);
+  }
+  size_t GetMaxBatch() const { return max_batch_; }
+  int GetBatches() const { return batches_; }
+
+ private:
+  int fail_frame_id_ = -1;
+  size_t max_batch_ = 0;
+  int batches_ = 0;
+};  // class TestBatchProcessor
+
+/*
+  source ---> batch ---> fused ---> tail
+  frames are provided in bursts, the batch module should get them in few calls, in order.
+  fused runs on the thread of batch and gets its batches, cut to its own batch size.
+ */
+static void RunBatchPipeline(cnstream::SchedulerMode scheduler) {
+  const int chn_cnt = 2;
+  const int frame_cnt = 64;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline->SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", chn_cnt);
+  auto batch = std::make_shared<TestBatchProcessor>("batch", chn_cnt, 8);
+  auto fused = std::make_shared<TestBatchProcessor>("fused", chn_cnt, 4);
+  auto tail = std::make_shared<TestProcessor>("tail", chn_cnt);
+  for (auto module : std::vector<std::shared_ptr<cnstream::Module>>{source, batch, fused, tail}) {
+    pipeline->AddModule(module);
+    EXPECT_TRUE(pipeline->SetModuleParallelism(module, module == source ? 0 : 1));
+  }
+  cnstream::LinkConfig link_config;
+  link_config.queue_capacity = 2 * frame_cnt + 2;
+  EXPECT_NE("", pipeline->LinkModules(source, batch, link_config));
+  EXPECT_NE("", pipeline->LinkModules(batch, fused, link_config));
+  EXPECT_NE("", pipeline->LinkModules(fused, tail, link_config));
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i <= frame_cnt; ++i) {
+    for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+      auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), frame_cnt == i);
+      data->channel_idx = chn_idx;
+      data->frame.frame_id = i;
+      EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    }
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+    EXPECT_EQ(static_cast<uint64_t>(frame_cnt), batch->GetCnts()[chn_idx]);
+    EXPECT_EQ(static_cast<uint64_t>(frame_cnt), fused->GetCnts()[chn_idx]);
+    EXPECT_EQ(static_cast<uint64_t>(frame_cnt), tail->GetCnts()[chn_idx]);
+  }
+  EXPECT_EQ(8u, batch->GetMaxBatch());
+  EXPECT_EQ(4u, fused->GetMaxBatch());
+  EXPECT_LT(batch->GetBatches(), chn_cnt * frame_cnt / 2);
+}
+
+TEST(CorePipeline, ProcessBatch) {
+  RunBatchPipeline(cnstream::SCHEDULER_THREAD);
+  RunBatchPipeline(cnstream::SCHEDULER_WORKER_POOL);
+}
+
+TEST(CorePipeline, ProcessBatchFailure) {
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto batch = std::make_shared<TestBatchProcessor>("batch", 1, 8, 5);
+  auto tail = std::make_shared<TestProcessor>("tail", 1);
+  for (auto module : std::vector<std::shared_ptr<cnstream::Module>>{source, batch, tail}) {
+    pipeline->AddModule(module);
+    EXPECT_TRUE(pipeline->SetModuleParallelism(module, module == source ? 0 : 1));
+  }
+  EXPECT_NE("", pipeline->LinkModules(source, batch));
+  EXPECT_NE("", pipeline->LinkModules(batch, tail));
+
+  MsgObserver msg_observer(1, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i < 10; ++i) {
+    auto data = cnstream::CNFrameInfo::Create("0");
+    data->channel_idx = 0;
+    data->frame.frame_id = i;
+    EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_ERROR, msg_observer.WaitForStop());
+  /* the frames before the failed one are still transmitted */
+  EXPECT_EQ(5u, tail->GetCnts()[0]);
+}
+
+/* finishes frames on its own thread, in reverse order of arrival, done(-1) for frame fail_frame_id of channel 0 */
+class TestAsyncProcessor : public TestProcessor {
+ public:
+  TestAsyncProcessor(const std::string& name, int chns, uint32_t depth, int fail_frame_id = -1)
+      : TestProcessor(name, chns), depth_(depth), fail_frame_id_(fail_frame_id) {
+    SetAsyncDepth(depth);
+  }
+  bool Open(cnstream::ModuleParamSet param_set) override {
+    running_ = true;
+    thread_ = std::thread(&TestAsyncProcessor::Complete, this);
+    return TestProcessor::Open(param_set);
+  }
+  void Close() override {
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      running_ = false;
+    }
+    cond_.notify_all();
+    if (thread_.joinable()) thread_.join();
+    pending_.clear();
+    TestProcessor::Close();
+  }
+  void ProcessAsync(std::shared_ptr<cnstream::CNFrameInfo> data, ProcessDone done) override {
+    EXPECT_LE(++in_flight_, static_cast<int>(depth_));
+    std::lock_guard<std::mutex> lk(mutex_);
+    pending_.emplace_back(data, done);
+    cond_.notify_all();
+  }
+  int GetMaxInFlight() const { return max_in_flight_; }
+  int GetProcessed() const { return processed_.load(); }
+
+ private:
+  void Complete() {
+    std::unique_lock<std::mutex> lk(mutex_);
+    while (running_) {
+      cond_.wait_for(lk, std::chrono::milliseconds(2), [this] { return !running_ || pending_.size() >= depth_; });
+      if (pending_.empty()) continue;
+      max_in_flight_ = std::max(max_in_flight_, static_cast<int>(pending_.size()));
+      auto pending = std::move(pending_);
+      pending_.clear();
+      lk.unlock();
+      for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+        int ret = 0;
+        if (0 == it->first->channel_idx && fail_frame_id_ == it->first->frame.frame_id) ret = -1;
+        if (0 == ret) processed_++;
+        --in_flight_;
+        it->second(ret);
+      }
+      lk.lock();
+    }
+  }
+
+  uint32_t depth_ = 0;
+  int fail_frame_id_ = -1;
+  std::atomic<int> in_flight_{0};
+  std::atomic<int> processed_{0};
+  int max_in_flight_ = 0;
+  bool running_ = false;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::pair<std::shared_ptr<cnstream::CNFrameInfo>, ProcessDone>> pending_;
+  std::thread thread_;
+};  // class TestAsyncProcessor
+
+/*
+  source ---> async ---> tail
+  async finishes frames out of order, tail checks they still come in order.
+ */
+static void RunAsyncPipeline(cnstream::SchedulerMode scheduler) {
+  const int chn_cnt = 3;
+  const int frame_cnt = 100;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline->SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", chn_cnt);
+  auto async = std::make_shared<TestAsyncProcessor>("async", chn_cnt, 4);
+  auto tail = std::make_shared<TestProcessor>("tail", chn_cnt);
+  for (auto module : std::vector<std::shared_ptr<cnstream::Module>>{source, async, tail}) {
+    pipeline->AddModule(module);
+    EXPECT_TRUE(pipeline->SetModuleParallelism(module, module == source ? 0 : 1));
+  }
+  EXPECT_NE("", pipeline->LinkModules(source, async));
+  EXPECT_NE("", pipeline->LinkModules(async, tail));
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i <= frame_cnt; ++i) {
+    for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+      auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), frame_cnt == i);
+      data->channel_idx = chn_idx;
+      data->frame.frame_id = i;
+      EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    }
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+    EXPECT_EQ(static_cast<uint64_t>(frame_cnt), tail->GetCnts()[chn_idx]);
+  }
+  EXPECT_EQ(chn_cnt * frame_cnt, async->GetProcessed());
+  EXPECT_GT(async->GetMaxInFlight(), 1);
+}
+
+TEST(CorePipeline, ProcessAsync) {
+  RunAsyncPipeline(cnstream::SCHEDULER_THREAD);
+  RunAsyncPipeline(cnstream::SCHEDULER_WORKER_POOL);
+}
+
+TEST(CorePipeline, ProcessAsyncFailure) {
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto async = std::make_shared<TestAsyncProcessor>("async", 1, 4, 10);
+  auto tail = std::make_shared<TestProcessor>("tail", 1);
+  for (auto module : std::vector<std::shared_ptr<cnstream::Module>>{source, async, tail}) {
+    pipeline->AddModule(module);
+    EXPECT_TRUE(pipeline->SetModuleParallelism(module, module == source ? 0 : 1));
+  }
+  EXPECT_NE("", pipeline->LinkModules(source, async));
+  EXPECT_NE("", pipeline->LinkModules(async, tail));
+
+  MsgObserver msg_observer(1, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i < 20; ++i) {
+    auto data = cnstream::CNFrameInfo::Create("0");
+    data->channel_idx = 0;
+    data->frame.frame_id = i;
+    EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_ERROR, msg_observer.WaitForStop());
+  /* the frames before the failed one are still transmitted, in order */
+  EXPECT_EQ(10u, tail->GetCnts()[0]);
+}
+
+/* stateless, takes 0 to 3 ms for a frame, so frames overtake each other */
+class TestSpreadProcessor : public TestProcessor {
+ public:
+  explicit TestSpreadProcessor(const std::string& name) : TestProcessor(name, 1) {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    int concurrency = ++concurrency_;
+    int max_concurrency = max_concurrency_.load();
+    while (concurrency > max_concurrency && !max_concurrency_.compare_exchange_weak(max_concurrency, concurrency)) {
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds((data->frame.frame_id * 7919) % 4 * 1000));
+    --concurrency_;
+    processed_++;
+    return 0;
+  }
+  int GetMaxConcurrency() const { return max_concurrency_.load(); }
+  int GetProcessed() const { return processed_.load(); }
+
+ private:
+  std::atomic<int> concurrency_{0};
+  std::atomic<int> max_concurrency_{0};
+  std::atomic<int> processed_{0};
+};  // class TestSpreadProcessor
+
+class TestOrderedProcessor : public TestProcessor {
+ public:
+  TestOrderedProcessor(const std::string& name, int chns) : TestProcessor(name, chns) {
+    SetFrameOrderRequired(true);
+  }
+};  // class TestOrderedProcessor
+
+/*
+  source ---> spread(4 threads) ---> stateless ---> ordered
+  one stream uses all the threads of spread, ordered still gets its frames in order.
+ */
+static void RunSpreadPipeline(cnstream::SchedulerMode scheduler) {
+  const int frame_cnt = 200;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline_config.workerNum = 4;
+  pipeline->SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto spread = std::make_shared<TestSpreadProcessor>("spread");
+  auto stateless = std::make_shared<TestSpreadProcessor>("stateless");
+  auto ordered = std::make_shared<TestOrderedProcessor>("ordered", 1);
+  pipeline->AddModule(source);
+  pipeline->AddModule(spread);
+  pipeline->AddModule(stateless);
+  pipeline->AddModule(ordered);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(spread, 4));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(stateless, 1));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(ordered, 1));
+  cnstream::LinkConfig link_config;
+  link_config.dispatch_policy = cnstream::DISPATCH_SPREAD;
+  std::string link_id = pipeline->LinkModules(source, spread, link_config);
+  EXPECT_NE("", link_id);
+  EXPECT_NE("", pipeline->LinkModules(spread, stateless));
+  EXPECT_NE("", pipeline->LinkModules(stateless, ordered));
+
+  MsgObserver msg_observer(1, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i <= frame_cnt; ++i) {
+    auto data = cnstream::CNFrameInfo::Create("0", frame_cnt == i);
+    data->channel_idx = 0;
+    /* EOS is numbered by pipeline */
+    data->frame.frame_id = frame_cnt == i ? -1 : i;
+    EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+
+  EXPECT_EQ(frame_cnt, spread->GetProcessed());
+  EXPECT_EQ(frame_cnt, stateless->GetProcessed());
+  EXPECT_EQ(static_cast<uint64_t>(frame_cnt), ordered->GetCnts()[0]);
+  EXPECT_GT(spread->GetMaxConcurrency(), 1);
+  cnstream::LinkStatus status;
+  EXPECT_TRUE(pipeline->QueryLinkStatus(&status, link_id));
+  for (auto it : status.dispatched) EXPECT_GT(it, 0u);
+}
+
+TEST(CorePipeline, SpreadDispatch) {
+  RunSpreadPipeline(cnstream::SCHEDULER_THREAD);
+  RunSpreadPipeline(cnstream::SCHEDULER_WORKER_POOL);
+}
+
+class TestElasticProcessor : public TestProcessor {
+ public:
+  TestElasticProcessor(const std::string& name, int chns) : TestProcessor(name, chns) {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    return TestProcessor::Process(data);
+  }
+};  // class TestElasticProcessor
+
+/*
+  source ---> elastic(1 to 4 threads)
+  elastic scales up while its queues are full and back down once idle, streams keep their frame order.
+ */
+static void RunElasticPipeline(cnstream::SchedulerMode scheduler) {
+  const int chn_cnt = 4;
+  const int frame_cnt = 200;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline_config.workerNum = 4;
+  pipeline->SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", chn_cnt);
+  auto elastic = std::make_shared<TestElasticProcessor>("elastic", chn_cnt);
+  pipeline->AddModule(source);
+  pipeline->AddModule(elastic);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(elastic, 1));
+  EXPECT_FALSE(pipeline->SetModuleParallelismRange(elastic, 4, 1));
+  EXPECT_TRUE(pipeline->SetModuleParallelismRange(elastic, 1, 4));
+  cnstream::LinkConfig link_config;
+  link_config.queue_capacity = 8;
+  std::string link_id = pipeline->LinkModules(source, elastic, link_config);
+  EXPECT_NE("", link_id);
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  cnstream::LinkStatus status;
+  uint32_t max_active_cnt = 0;
+  for (int i = 0; i < frame_cnt; ++i) {
+    for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+      auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx));
+      data->channel_idx = chn_idx;
+      data->frame.frame_id = i;
+      EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    }
+    EXPECT_TRUE(pipeline->QueryLinkStatus(&status, link_id));
+    max_active_cnt = std::max(max_active_cnt, status.active_cnt);
+  }
+  EXPECT_GT(max_active_cnt, 1u);
+  /* idle */
+  for (int i = 0; i < 100 && status.active_cnt > 1; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_TRUE(pipeline->QueryLinkStatus(&status, link_id));
+  }
+  EXPECT_EQ(1u, status.active_cnt);
+  for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+    auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), true);
+    data->channel_idx = chn_idx;
+    EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  for (auto it : elastic->GetCnts()) EXPECT_EQ(static_cast<uint64_t>(frame_cnt), it);
+}
+
+TEST(CorePipeline, ElasticParallelism) {
+  RunElasticPipeline(cnstream::SCHEDULER_THREAD);
+  RunElasticPipeline(cnstream::SCHEDULER_WORKER_POOL);
+}
+
+TEST(CorePipeline, ParseParallelismRange) {
+  cnstream::CNModuleConfig config;
+  config.ParseByJSONStr("{\"class_name\": \"test\"}");
+  EXPECT_EQ(1, config.minParallelism);
+  EXPECT_EQ(0, config.maxParallelism);
+  config.ParseByJSONStr("{\"class_name\": \"test\", \"min_parallelism\": 2, \"max_parallelism\": 8}");
+  EXPECT_EQ(2, config.minParallelism);
+  EXPECT_EQ(8, config.maxParallelism);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"min_parallelism\": 2, \"max_parallelism\": 1}"),
+               std::string);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"max_parallelism\": -1}"), std::string);
+}
+
+/* records the cpus its thread may run on and the NUMA node frames are allocated on */
+class TestPlacementProcessor : public TestProcessor {
+ public:
+  explicit TestPlacementProcessor(const std::string& name) : TestProcessor(name, 1) {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    EXPECT_EQ(0, pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set));
+    std::lock_guard<std::mutex> lk(mutex_);
+    cpus_.clear();
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &cpu_set)) cpus_.push_back(cpu);
+    }
+    memory_node_ = cnstream::CNStreamGetHostMemoryNode();
+    return TestProcessor::Process(data);
+  }
+  std::vector<int> GetCpus() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return cpus_;
+  }
+  int GetMemoryNode() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return memory_node_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<int> cpus_;
+  int memory_node_ = -2;
+};  // class TestPlacementProcessor
+
+/*
+  source ---> upstream ---> downstream(cpu 0, NUMA node 0)
+  downstream runs on cpu 0, frames of upstream are allocated on the node of downstream.
+ */
+TEST(CorePipeline, ModulePlacement) {
+  const bool has_node = !cnstream::GetNumaNodeCpus(0).empty();
+  const int numa_node = has_node ? 0 : -1;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto upstream = std::make_shared<TestPlacementProcessor>("upstream");
+  auto downstream = std::make_shared<TestPlacementProcessor>("downstream");
+  pipeline->AddModule(source);
+  pipeline->AddModule(upstream);
+  pipeline->AddModule(downstream);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  cnstream::ModulePlacement placement;
+  placement.cpus = {0};
+  placement.numa_node = numa_node;
+  EXPECT_TRUE(pipeline->SetModulePlacement(downstream, placement));
+  EXPECT_NE("", pipeline->LinkModules(source, upstream));
+  EXPECT_NE("", pipeline->LinkModules(upstream, downstream));
+
+  MsgObserver msg_observer(1, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  cnstream::ModulePlacement effective;
+  EXPECT_FALSE(pipeline->QueryModulePlacement(downstream, &effective));
+  ASSERT_TRUE(pipeline->Start());
+  EXPECT_TRUE(pipeline->QueryModulePlacement(downstream, &effective));
+  EXPECT_EQ(std::vector<int>{0}, effective.cpus);
+  EXPECT_EQ(numa_node, effective.numa_node);
+  EXPECT_TRUE(pipeline->QueryModulePlacement(upstream, &effective));
+  EXPECT_TRUE(effective.cpus.empty());
+  EXPECT_EQ(numa_node, effective.numa_node);
+  for (int i = 0; i <= 10; ++i) {
+    auto data = cnstream::CNFrameInfo::Create("0", 10 == i);
+    data->channel_idx = 0;
+    data->frame.frame_id = i;
+    EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  EXPECT_EQ(std::vector<int>{0}, downstream->GetCpus());
+  EXPECT_EQ(numa_node, downstream->GetMemoryNode());
+  EXPECT_EQ(numa_node, upstream->GetMemoryNode());
+}
+
+TEST(CorePipeline, ParsePlacement) {
+  cnstream::CNModuleConfig config;
+  config.ParseByJSONStr("{\"class_name\": \"test\"}");
+  EXPECT_TRUE(config.placement.cpus.empty());
+  EXPECT_EQ(-1, config.placement.numa_node);
+  config.ParseByJSONStr("{\"class_name\": \"test\", \"cpu_affinity\": \"4,0-2\", \"numa_node\": 1}");
+  EXPECT_EQ((std::vector<int>{0, 1, 2, 4}), config.placement.cpus);
+  EXPECT_EQ(1, config.placement.numa_node);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"cpu_affinity\": \"3-1\"}"), std::string);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"cpu_affinity\": \"0,,1\"}"), std::string);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"numa_node\": -1}"), std::string);
+  EXPECT_EQ("0-2,4,6-7", cnstream::FormatCpuList({0, 1, 2, 4, 6, 7}));
+}
+
+/* takes 1 ms for a frame, records the longest time a frame of channel 1 waited, from CNDataFrame::timestamp */
+class TestLatencyProcessor : public TestProcessor {
+ public:
+  explicit TestLatencyProcessor(const std::string& name) : TestProcessor(name, 2) {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    if (1 == data->channel_idx) {
+      int64_t latency_us = NowUs() - data->frame.timestamp;
+      max_latency_us_ = std::max(max_latency_us_.load(), latency_us);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return TestProcessor::Process(data);
+  }
+  double GetMaxLatencyMs() const { return max_latency_us_.load() / 1000.0; }
+  static int64_t NowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+ private:
+  std::atomic<int64_t> max_latency_us_{0};
+};  // class TestLatencyProcessor
+
+/*
+  source ---> worker(1 thread)
+  channel 0 floods the queue of worker with frame_cnt frames at once, channel 1 sends a frame every 5 ms.
+  returns the longest wait of a channel 1 frame.
+ */
+static double RunFloodedQueue(cnstream::QueueImpl queue_impl) {
+  const int flood_cnt = 300;
+  const int light_cnt = 10;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  auto source = std::make_shared<TestProcessor>("source", 2);
+  auto worker = std::make_shared<TestLatencyProcessor>("worker");
+  pipeline->AddModule(source);
+  pipeline->AddModule(worker);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(worker, 1));
+  cnstream::LinkConfig link_config;
+  link_config.queue_capacity = flood_cnt + light_cnt + 2;
+  link_config.queue_impl = queue_impl;
+  EXPECT_NE("", pipeline->LinkModules(source, worker, link_config));
+
+  MsgObserver msg_observer(2, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  EXPECT_TRUE(pipeline->Start());
+  auto provide = [&](uint32_t chn_idx, int64_t frame_id, bool eos) {
+    auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), eos);
+    data->channel_idx = chn_idx;
+    data->frame.frame_id = frame_id;
+    data->frame.timestamp = TestLatencyProcessor::NowUs();
+    EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+  };
+  for (int i = 0; i < flood_cnt; ++i) provide(0, i, false);
+  for (int i = 0; i < light_cnt; ++i) {
+    provide(1, i, false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  provide(0, flood_cnt, true);
+  provide(1, light_cnt, true);
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  EXPECT_EQ(static_cast<uint64_t>(flood_cnt), worker->GetCnts()[0]);
+  EXPECT_EQ(static_cast<uint64_t>(light_cnt), worker->GetCnts()[1]);
+  return worker->GetMaxLatencyMs();
+}
+
+TEST(CorePipeline, FairQueueBoundsLatency) {
+  double fifo_ms = RunFloodedQueue(cnstream::QUEUE_IMPL_MUTEX);
+  double fair_ms = RunFloodedQueue(cnstream::QUEUE_IMPL_FAIR);
+  std::cout << "[Flooded queue] longest wait of the light stream, fifo: " << fifo_ms << " ms, fair: " << fair_ms
+            << " ms" << std::endl;
+  /* a flood frame takes 1 ms, the light stream waits for one of them at most, not for the whole flood */
+  EXPECT_LT(fair_ms, 50);
+  EXPECT_GT(fifo_ms, fair_ms);
+}
+
+TEST(CorePipeline, ParseFairQueue) {
+  cnstream::CNModuleConfig config;
+  config.ParseByJSONStr("{\"class_name\": \"test\", \"queue_impl\": \"fair\"}");
+  EXPECT_EQ(cnstream::QUEUE_IMPL_FAIR, config.queueImpl);
+}
+
+TEST(CorePipeline, ParseSpillQueue) {
+  cnstream::CNModuleConfig config;
+  config.ParseByJSONStr("{\"class_name\": \"test\", \"queue_impl\": \"spill\", \"spill_dir\": \"/data\"}");
+  EXPECT_EQ(cnstream::QUEUE_IMPL_SPILL, config.queueImpl);
+  EXPECT_EQ("/data", config.spillDir);
+  config.ParseByJSONStr("{\"class_name\": \"test\"}");
+  EXPECT_TRUE(config.spillDir.empty());
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"spill_dir\": 1}"), std::string);
+}
+
+/* checks the planes of each frame hold its frame id, after delay_ms */
+class TestPlaneProcessor : public TestProcessor {
+ public:
+  TestPlaneProcessor(const std::string& name, int delay_ms) : TestProcessor(name, 1), delay_ms_(delay_ms) {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms_));
+    EXPECT_NE(nullptr, data->frame.data[0].get()) << GetName() << " frame " << data->frame.frame_id;
+    if (data->frame.data[0]) {
+      const uint8_t* y = static_cast<const uint8_t*>(data->frame.data[0]->GetCpuData());
+      EXPECT_EQ(static_cast<uint8_t>(data->frame.frame_id), y[0]) << GetName();
+    }
+    return TestProcessor::Process(data);
+  }
+
+ private:
+  int delay_ms_ = 0;
+};  // class TestPlaneProcessor
+
+/*
+  source ---> slow(spill queue)
+    |
+     -------> fast
+  the frames spilled on the link to slow leave memory only once fast is done with them, fast never finds the
+  planes moved out of memory.
+ */
+TEST(CorePipeline, SpillNextToAnotherBranch) {
+  const int frame_cnt = 40;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto slow = std::make_shared<TestPlaneProcessor>("slow", 5);
+  auto fast = std::make_shared<TestPlaneProcessor>("fast", 2);
+  pipeline->AddModule(source);
+  pipeline->AddModule(slow);
+  pipeline->AddModule(fast);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(slow, 1));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(fast, 1));
+  cnstream::LinkConfig link_config;
+  link_config.queue_capacity = 1;
+  link_config.queue_impl = cnstream::QUEUE_IMPL_SPILL;
+  std::string link_id = pipeline->LinkModules(source, slow, link_config);
+  EXPECT_NE("", link_id);
+  EXPECT_NE("", pipeline->LinkModules(source, fast));
+
+  MsgObserver msg_observer(1, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  std::vector<uint8_t> pixels(64 * 64 * 3 / 2);
+  cnstream::LinkStatus status;
+  uint32_t max_spilled = 0;
+  for (int i = 0; i <= frame_cnt; ++i) {
+    auto data = cnstream::CNFrameInfo::Create("0", frame_cnt == i);
+    data->channel_idx = 0;
+    data->frame.frame_id = i;
+    if (i < frame_cnt) {
+      data->frame.ctx.dev_type = cnstream::DevContext::CPU;
+      data->frame.fmt = cnstream::CN_PIXEL_FORMAT_YUV420_NV12;
+      data->frame.width = data->frame.height = data->frame.stride[0] = data->frame.stride[1] = 64;
+      std::fill(pixels.begin(), pixels.end(), static_cast<uint8_t>(i));
+      data->frame.ptr[0] = pixels.data();
+      data->frame.ptr[1] = pixels.data() + 64 * 64;
+      data->frame.CopyToSyncMem();
+    }
+    EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    EXPECT_TRUE(pipeline->QueryLinkStatus(&status, link_id));
+    max_spilled = std::max(max_spilled, status.spilled[0]);
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  EXPECT_GT(max_spilled, 0u);
+  EXPECT_EQ(static_cast<uint64_t>(frame_cnt), slow->GetCnts()[0]);
+  EXPECT_EQ(static_cast<uint64_t>(frame_cnt), fast->GetCnts()[0]);
+}
+
+/*
+  source ---> spread(4 threads) ---> ordered
+  the input queues of spread are short and drop, frames of both streams are dropped before they are
+  reordered. ordered still gets the others in order and the EOS of both streams.
+ */
+static void RunDropPipeline(cnstream::SchedulerMode scheduler, cnstream::DropPolicy policy) {
+  const int frame_cnt = 200;
+  const uint32_t chn_cnt = 2;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline_config.workerNum = 4;
+  pipeline->SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", chn_cnt);
+  auto spread = std::make_shared<TestSpreadProcessor>("spread");
+  auto ordered = std::make_shared<TestOrderedProcessor>("ordered", chn_cnt);
+  pipeline->AddModule(source);
+  pipeline->AddModule(spread);
+  pipeline->AddModule(ordered);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(spread, 4));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(ordered, 1));
+  cnstream::LinkConfig link_config;
+  link_config.queue_capacity = 2;
+  link_config.dispatch_policy = cnstream::DISPATCH_SPREAD;
+  link_config.drop_policy = policy;
+  std::string link_id = pipeline->LinkModules(source, spread, link_config);
+  EXPECT_NE("", link_id);
+  EXPECT_NE("", pipeline->LinkModules(spread, ordered));
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i <= frame_cnt; ++i) {
+    for (uint32_t chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+      auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), frame_cnt == i);
+      data->channel_idx = chn_idx;
+      data->frame.frame_id = frame_cnt == i ? -1 : i;
+      EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    }
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+
+  cnstream::LinkStatus status;
+  EXPECT_TRUE(pipeline->QueryLinkStatus(&status, link_id));
+  uint64_t dropped = 0;
+  for (uint32_t chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+    EXPECT_GT(status.dropped[chn_idx], 0u);
+    EXPECT_EQ(static_cast<uint64_t>(frame_cnt), ordered->GetCnts()[chn_idx] + status.dropped[chn_idx]);
+    dropped += status.dropped[chn_idx];
+  }
+  EXPECT_EQ(static_cast<uint64_t>(frame_cnt * chn_cnt), spread->GetProcessed() + dropped);
+}
+
+TEST(CorePipeline, DropPolicy) {
+  RunDropPipeline(cnstream::SCHEDULER_THREAD, cnstream::DROP_OLDEST);
+  RunDropPipeline(cnstream::SCHEDULER_THREAD, cnstream::DROP_NEWEST);
+  RunDropPipeline(cnstream::SCHEDULER_WORKER_POOL, cnstream::DROP_LARGEST_STREAM);
+}
+
+TEST(CorePipeline, ParseDropPolicy) {
+  cnstream::CNModuleConfig config;
+  config.ParseByJSONStr("{\"class_name\": \"test\"}");
+  EXPECT_EQ(cnstream::DROP_NONE, config.dropPolicy);
+  EXPECT_EQ(0, config.dropLowWatermark);
+  config.ParseByJSONStr(
+      "{\"class_name\": \"test\", \"drop_policy\": \"largest_stream\", \"drop_low_watermark\": 10}");
+  EXPECT_EQ(cnstream::DROP_LARGEST_STREAM, config.dropPolicy);
+  EXPECT_EQ(10, config.dropLowWatermark);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"drop_policy\": \"random\"}"), std::string);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"drop_low_watermark\": 20}"), std::string);
+}
+
+class TestStaleProcessor : public TestProcessor {
+ public:
+  TestStaleProcessor(const std::string& name, uint32_t batch_size) : TestProcessor(name, 1) {
+    SetBatchSize(batch_size);
+    SetStaleFrameSkippable(true);
+  }
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    /* stale frames never get here, the ones of a batch may go stale while it is processed */
+    if (1 == GetBatchSize()) {
+      EXPECT_FALSE(data->IsStale());
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    return TestProcessor::Process(data);
+  }
+  int ProcessBatch(std::vector<std::shared_ptr<cnstream::CNFrameInfo>>& data) override {
+    for (auto& it : data) EXPECT_FALSE(it->IsStale());
+    return Module::ProcessBatch(data);
+  }
+};  // class TestStaleProcessor
+
+/*
+  source ---> slow ---> join
+     \-------------------^
+  slow takes 5 ms a frame and skips stale ones, the frames queue up behind it and run out of their budget.
+  join still gets all of them, in order.
+ */
+static void RunStalePipeline(cnstream::SchedulerMode scheduler, uint32_t batch_size) {
+  const int frame_cnt = 100;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline->SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto slow = std::make_shared<TestStaleProcessor>("slow", batch_size);
+  auto join = std::make_shared<TestProcessor>("join", 1);
+  pipeline->AddModule(source);
+  pipeline->AddModule(slow);
+  pipeline->AddModule(join);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(slow, 1));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(join, 1));
+  EXPECT_NE("", pipeline->LinkModules(source, slow));
+  EXPECT_NE("", pipeline->LinkModules(slow, join));
+  EXPECT_NE("", pipeline->LinkModules(source, join));
+
+  MsgObserver msg_observer(1, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i <= frame_cnt; ++i) {
+    auto data = cnstream::CNFrameInfo::Create("0", frame_cnt == i);
+    data->channel_idx = 0;
+    data->frame.frame_id = i;
+    data->latency_budget_ms = 30;
+    EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+
+  uint64_t skipped = slow->GetSkippedFrameNum();
+  std::cout << "[Stale frames] skipped " << skipped << " of " << frame_cnt << std::endl;
+  EXPECT_GT(skipped, 0u);
+  EXPECT_EQ(static_cast<uint64_t>(frame_cnt), slow->GetCnts()[0] + skipped);
+  EXPECT_EQ(static_cast<uint64_t>(frame_cnt), join->GetCnts()[0]);
+  EXPECT_EQ(0u, join->GetSkippedFrameNum());
+}
+
+TEST(CorePipeline, SkipStaleFrames) {
+  RunStalePipeline(cnstream::SCHEDULER_THREAD, 1);
+  RunStalePipeline(cnstream::SCHEDULER_THREAD, 4);
+  RunStalePipeline(cnstream::SCHEDULER_WORKER_POOL, 1);
+}
+
+class TestSlowProcessor : public TestProcessor {
+ public:
+  explicit TestSlowProcessor(const std::string& name) : TestProcessor(name, 1) {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return TestProcessor::Process(data);
+  }
+};  // class TestSlowProcessor
+
+class TestJoinProcessor : public TestProcessor {
+ public:
+  explicit TestJoinProcessor(const std::string& name) : TestProcessor(name, 1) {}
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    if (data->frame.flags & cnstream::CN_FRAME_FLAG_PARTIAL) {
+      /* got from the source, went on without slow */
+      uint64_t mask = data->frame.GetModulesMask(this);
+      EXPECT_TRUE(mask & 1);
+      EXPECT_TRUE(data->frame.IsModuleMaskJoined(this));
+      ++partial_cnt_;
+    }
+    return TestProcessor::Process(data);
+  }
+  uint64_t GetPartialCnt() const { return partial_cnt_; }
+
+ private:
+  std::atomic<uint64_t> partial_cnt_{0};
+};  // class TestJoinProcessor
+
+/*
+  source ---> slow ---> join
+     \-------------------^
+  slow takes 10 ms a frame, join waits 2 ms for it and goes on with the frames got from source. the frames
+  got from slow later are released, and the EOS waits for both links.
+ */
+static void RunJoinTimeoutPipeline(cnstream::SchedulerMode scheduler) {
+  const int frame_cnt = 50;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  /* slow does not hold up join */
+  pipeline_config.workerNum = 4;
+  pipeline->SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto slow = std::make_shared<TestSlowProcessor>("slow");
+  auto join = std::make_shared<TestJoinProcessor>("join");
+  pipeline->AddModule(source);
+  pipeline->AddModule(slow);
+  pipeline->AddModule(join);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(slow, 1));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(join, 1));
+  EXPECT_TRUE(pipeline->SetModuleJoinTimeout(join, 2));
+  EXPECT_NE("", pipeline->LinkModules(source, join));
+  EXPECT_NE("", pipeline->LinkModules(source, slow));
+  EXPECT_NE("", pipeline->LinkModules(slow, join));
+
+  MsgObserver msg_observer(1, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i <= frame_cnt; ++i) {
+    auto data = cnstream::CNFrameInfo::Create("0", frame_cnt == i);
+    data->channel_idx = 0;
+    data->frame.frame_id = i;
+    EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+
+  uint64_t partial = join->GetPartialFrameNum();
+  std::cout << "[Join timeout] partial " << partial << " of " << frame_cnt << std::endl;
+  EXPECT_GT(partial, 0u);
+  EXPECT_EQ(partial, join->GetPartialCnt());
+  EXPECT_EQ(partial, join->GetLateFrameNum());
+  EXPECT_EQ(static_cast<uint64_t>(frame_cnt), slow->GetCnts()[0]);
+  EXPECT_EQ(static_cast<uint64_t>(frame_cnt), join->GetCnts()[0]);
+}
+
+TEST(CorePipeline, JoinTimeout) {
+  RunJoinTimeoutPipeline(cnstream::SCHEDULER_THREAD);
+  RunJoinTimeoutPipeline(cnstream::SCHEDULER_WORKER_POOL);
+}
+
+TEST(CorePipeline, ParseJoinTimeout) {
+  cnstream::CNModuleConfig config;
+  config.ParseByJSONStr("{\"class_name\": \"test\"}");
+  EXPECT_EQ(0, config.joinTimeoutMs);
+  config.ParseByJSONStr("{\"class_name\": \"test\", \"join_timeout_ms\": 40}");
+  EXPECT_EQ(40, config.joinTimeoutMs);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"join_timeout_ms\": -1}"), std::string);
+}
+
+/*
+  source ---> a ---> a2 ---> join ---> sink
+     |                        ^
+     |------> b --------------|
+     |
+     |------> leaf
+  a gets frames with an object labeled "1", b every second frame and leaf the frames of stream "1". join
+  processes the frames which went through a or b, and the frames which went through neither skip sink too.
+ */
+static void RunRoutePipeline(cnstream::SchedulerMode scheduler) {
+  const int frame_cnt = 30;
+  const int chn_cnt = 2;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline->SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", chn_cnt);
+  auto a = std::make_shared<TestProcessor>("a", chn_cnt);
+  auto a2 = std::make_shared<TestProcessor>("a2", chn_cnt);
+  auto b = std::make_shared<TestProcessor>("b", chn_cnt);
+  auto join = std::make_shared<TestProcessor>("join", chn_cnt);
+  auto sink = std::make_shared<TestProcessor>("sink", chn_cnt);
+  auto leaf = std::make_shared<TestProcessor>("leaf", chn_cnt);
+  for (auto& module : std::vector<std::shared_ptr<cnstream::Module>>{source, a, a2, b, join, sink, leaf}) {
+    pipeline->AddModule(module);
+    EXPECT_TRUE(pipeline->SetModuleParallelism(module, source == module ? 0 : 2));
+  }
+  cnstream::LinkConfig a_config, b_config, leaf_config;
+  a_config.route.labels = {"1"};
+  b_config.route.every_n = 2;
+  leaf_config.route.streams = {"1"};
+  std::string a_link = pipeline->LinkModules(source, a, a_config);
+  EXPECT_NE("", a_link);
+  EXPECT_NE("", pipeline->LinkModules(a, a2));
+  EXPECT_NE("", pipeline->LinkModules(a2, join));
+  EXPECT_NE("", pipeline->LinkModules(source, b, b_config));
+  EXPECT_NE("", pipeline->LinkModules(b, join));
+  EXPECT_NE("", pipeline->LinkModules(join, sink));
+  EXPECT_NE("", pipeline->LinkModules(source, leaf, leaf_config));
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  for (int i = 0; i <= frame_cnt; ++i) {
+    for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+      auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), frame_cnt == i);
+      data->channel_idx = chn_idx;
+      data->frame.stream_id = std::to_string(chn_idx);
+      data->frame.frame_id = i;
+      if (0 == i % 3) {
+        auto obj = std::make_shared<cnstream::CNInferObject>();
+        obj->id = "1";
+        data->objs.push_back(obj);
+      }
+      EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    }
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+
+  uint64_t a_cnt = 0, b_cnt = 0, join_cnt = 0;
+  for (int i = 0; i < frame_cnt; ++i) {
+    if (0 == i % 3) a_cnt++;
+    if (0 == i % 2) b_cnt++;
+    if (0 == i % 3 || 0 == i % 2) join_cnt++;
+  }
+  for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+    EXPECT_EQ(a_cnt, a->GetCnts()[chn_idx]);
+    EXPECT_EQ(a_cnt, a2->GetCnts()[chn_idx]);
+    EXPECT_EQ(b_cnt, b->GetCnts()[chn_idx]);
+    EXPECT_EQ(join_cnt, join->GetCnts()[chn_idx]);
+    EXPECT_EQ(join_cnt, sink->GetCnts()[chn_idx]);
+  }
+  EXPECT_EQ(0u, leaf->GetCnts()[0]);
+  EXPECT_EQ(static_cast<uint64_t>(frame_cnt), leaf->GetCnts()[1]);
+  cnstream::LinkStatus status;
+  EXPECT_TRUE(pipeline->QueryLinkStatus(&status, a_link));
+  EXPECT_EQ(chn_cnt * (frame_cnt - a_cnt), status.routed_past);
+}
+
+TEST(CorePipeline, RouteFrames) {
+  RunRoutePipeline(cnstream::SCHEDULER_THREAD);
+  RunRoutePipeline(cnstream::SCHEDULER_WORKER_POOL);
+}
+
+TEST(CorePipeline, ParseRoute) {
+  cnstream::CNModuleConfig config;
+  config.ParseByJSONStr("{\"class_name\": \"test\"}");
+  EXPECT_TRUE(config.route.PassAll());
+  config.ParseByJSONStr(
+      "{\"class_name\": \"test\", \"route\": {\"labels\": [\"0\", \"2\"], \"every_n\": 2, \"streams\": [\"s0\"]}}");
+  EXPECT_FALSE(config.route.PassAll());
+  EXPECT_EQ(std::vector<std::string>({"0", "2"}), config.route.labels);
+  EXPECT_EQ(2u, config.route.every_n);
+  EXPECT_EQ(std::vector<std::string>({"s0"}), config.route.streams);
+
+  auto data = cnstream::CNFrameInfo::Create("s0");
+  data->frame.stream_id = "s0";
+  data->frame.frame_id = 4;
+  EXPECT_FALSE(config.route.Pass(*data));
+  auto obj = std::make_shared<cnstream::CNInferObject>();
+  obj->id = "2";
+  data->objs.push_back(obj);
+  EXPECT_TRUE(config.route.Pass(*data));
+  data->frame.frame_id = 5;
+  EXPECT_FALSE(config.route.Pass(*data));
+  config.route.every_n = 1;
+  config.route.filter = [](const cnstream::CNFrameInfo& frame) { return frame.frame.frame_id > 10; };
+  EXPECT_FALSE(config.route.Pass(*data));
+  data->frame.flags |= cnstream::CN_FRAME_FLAG_EOS;
+  EXPECT_TRUE(config.route.Pass(*data));
+
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"route\": [\"0\"]}"), std::string);
+  EXPECT_THROW(config.ParseByJSONStr("{\"class_name\": \"test\", \"route\": {\"labels\": [0]}}"), std::string);
+}
+
+TEST(CorePipeline, FrameLatencyBudget) {
+  auto data = cnstream::CNFrameInfo::Create("0");
+  EXPECT_FALSE(data->IsStale());
+  data->latency_budget_ms = 10;
+  EXPECT_FALSE(data->IsStale());
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_TRUE(data->IsStale());
+  data->frame.flags |= cnstream::CN_FRAME_FLAG_EOS;
+  EXPECT_FALSE(data->IsStale());
+}
+
+TEST(CorePipeline, FrameCredit) {
+  EXPECT_TRUE(cnstream::HasFrameCredit("credit"));
+  cnstream::SetParallelism(2);
+  auto create = [] {
+    auto data = cnstream::CNFrameInfo::Create("credit");
+    if (data) data->frame.ctx.dev_type = cnstream::DevContext::CPU;
+    return data;
+  };
+  auto frame0 = create();
+  auto frame1 = create();
+  ASSERT_TRUE(frame0 && frame1);
+  EXPECT_FALSE(cnstream::HasFrameCredit("credit"));
+  EXPECT_TRUE(cnstream::HasFrameCredit("other"));
+  EXPECT_EQ(nullptr, create());
+
+  /* a frame released by the pipeline gives the credit back */
+  auto released = std::async(std::launch::async, [&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    frame0.reset();
+  });
+  EXPECT_TRUE(cnstream::WaitForFrameCredit("credit", [] { return false; }));
+  released.get();
+  auto frame2 = create();
+  ASSERT_TRUE(frame2 != nullptr);
+
+  /* a source closing stops waiting */
+  std::atomic<bool> stop{false};
+  auto waited = std::async(std::launch::async,
+                           [&] { return cnstream::WaitForFrameCredit("credit", [&] { return stop.load(); }); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  stop.store(true);
+  cnstream::WakeupFrameCreditWaiters();
+  EXPECT_FALSE(waited.get());
+  frame1.reset();
+  frame2.reset();
+  cnstream::SetParallelism(0);
+}
+
+TEST(CorePipeline, FrameMemoryBudget) {
+  TestProcessor module("memory_owner", 1);
+  std::vector<uint8_t> pixels(64 * 64 * 3);
+  auto create = [&](const std::string& stream_id) {
+    auto data = cnstream::CNFrameInfo::Create(stream_id);
+    data->frame.ctx.dev_type = cnstream::DevContext::CPU;
+    data->frame.fmt = cnstream::CN_PIXEL_FORMAT_BGR24;
+    data->frame.width = data->frame.height = data->frame.stride[0] = 64;
+    data->frame.ptr[0] = pixels.data();
+    cnstream::FrameMemoryOwner owner(&module);
+    data->frame.CopyToSyncMem();
+    return data;
+  };
+  /* host memory of frames is allocated in 64KB blocks */
+  const uint64_t frame_bytes = 64 * 1024;
+
+  auto frame0 = create("memory0");
+  EXPECT_EQ(frame_bytes, cnstream::GetStreamFrameMemoryUsage("memory0").host_bytes);
+  EXPECT_EQ(0u, cnstream::GetStreamFrameMemoryUsage("memory0").device_bytes);
+  EXPECT_EQ(frame_bytes, cnstream::GetModuleFrameMemoryUsage("memory_owner").host_bytes);
+  EXPECT_EQ(frame_bytes, cnstream::GetFrameMemoryUsage().host_bytes);
+  /* no budget, no limit */
+  EXPECT_TRUE(cnstream::HasFrameCredit("memory0"));
+
+  cnstream::SetStreamFrameMemoryBudget("memory0", 2 * frame_bytes, 0);
+  auto frame1 = create("memory0");
+  EXPECT_FALSE(cnstream::HasFrameCredit("memory0"));
+  /* other streams have their own budgets */
+  auto frame2 = create("memory1");
+  EXPECT_TRUE(cnstream::HasFrameCredit("memory1"));
+  EXPECT_EQ(3 * frame_bytes, cnstream::GetModuleFrameMemoryUsage("memory_owner").host_bytes);
+
+  /* a frame released gives its memory back */
+  auto released = std::async(std::launch::async, [&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    frame0.reset();
+  });
+  EXPECT_TRUE(cnstream::WaitForFrameCredit("memory0", [] { return false; }));
+  released.get();
+  EXPECT_EQ(frame_bytes, cnstream::GetStreamFrameMemoryUsage("memory0").host_bytes);
+
+  /* the global budget counts all streams, streams holding nothing go on */
+  cnstream::SetFrameMemoryBudget(2 * frame_bytes, 0);
+  EXPECT_FALSE(cnstream::HasFrameCredit("memory0"));
+  EXPECT_FALSE(cnstream::HasFrameCredit("memory1"));
+  EXPECT_TRUE(cnstream::HasFrameCredit("memory2"));
+  cnstream::SetFrameMemoryBudget(0, 0);
+  EXPECT_TRUE(cnstream::HasFrameCredit("memory1"));
+
+  frame1.reset();
+  frame2.reset();
+  cnstream::SetStreamFrameMemoryBudget("memory0", 0, 0);
+  EXPECT_EQ(0u, cnstream::GetFrameMemoryUsage().host_bytes);
+  EXPECT_EQ(0u, cnstream::GetModuleFrameMemoryUsage("memory_owner").host_bytes);
+}
+
+/* context switches of all threads of the process, each one is a wakeup of a thread which went to sleep */
+static uint64_t GetContextSwitches() {
+  uint64_t switches = 0;
+  DIR* dir = opendir("/proc/self/task");
+  if (!dir) return 0;
+  while (dirent* entry = readdir(dir)) {
+    if ('.' == entry->d_name[0]) continue;
+    std::ifstream status(std::string("/proc/self/task/") + entry->d_name + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+      if (line.find("ctxt_switches:") != std::string::npos) {
+        switches += std::stoull(line.substr(line.find(':') + 1));
+      }
+    }
+  }
+  closedir(dir);
+  return switches;
+}
+
+/*
+  source ---> a ---> b
+  no thread of a started pipeline without data wakes up periodically.
+ */
+static void TestIdleWakeups(cnstream::SchedulerMode scheduler) {
+  cnstream::Pipeline pipeline("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline.SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto a = std::make_shared<TestProcessor>("a", 1);
+  auto b = std::make_shared<TestProcessor>("b", 1);
+  pipeline.AddModule(source);
+  pipeline.AddModule(a);
+  pipeline.AddModule(b);
+  EXPECT_TRUE(pipeline.SetModuleParallelism(source, 0));
+  EXPECT_NE("", pipeline.LinkModules(source, a));
+  EXPECT_NE("", pipeline.LinkModules(a, b));
+  ASSERT_TRUE(pipeline.Start());
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  const uint64_t before = GetContextSwitches();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  const uint64_t wakeups = GetContextSwitches() - before;
+  pipeline.Stop();
+  /* a few for the sleeping test thread and the reads of /proc, a polling thread would add hundreds */
+  EXPECT_LT(wakeups, 20u) << "idle wakeups in 1s";
+}
+
+/*
+  source ---> a(spill queue)
+  a paused pipeline, the source is blocked on frames which can not be spilled. It sleeps until a pops.
+ */
+static void TestBlockedPushWakeups(cnstream::SchedulerMode scheduler) {
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline->SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto a = std::make_shared<TestProcessor>("a", 1);
+  pipeline->AddModule(source);
+  pipeline->AddModule(a);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  cnstream::LinkConfig link_config;
+  link_config.queue_capacity = 1;
+  link_config.queue_impl = cnstream::QUEUE_IMPL_SPILL;
+  EXPECT_NE("", pipeline->LinkModules(source, a, link_config));
+  MsgObserver msg_observer(1, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  EXPECT_TRUE(pipeline->Pause());
+  std::thread feeder([&]() {
+    for (int i = 0; i <= 3; ++i) {
+      auto data = cnstream::CNFrameInfo::Create("0", 3 == i);
+      data->channel_idx = 0;
+      data->frame.frame_id = i;
+      EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  const uint64_t before = GetContextSwitches();
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  const uint64_t wakeups = GetContextSwitches() - before;
+  EXPECT_TRUE(pipeline->Resume());
+  feeder.join();
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  EXPECT_EQ(3u, a->GetCnts()[0]);
+  EXPECT_LT(wakeups, 20u) << "wakeups of a blocked push in 1s";
+}
+
+TEST(CorePipeline, IdleWakeups) {
+  TestIdleWakeups(cnstream::SCHEDULER_THREAD);
+  TestIdleWakeups(cnstream::SCHEDULER_WORKER_POOL);
+  TestBlockedPushWakeups(cnstream::SCHEDULER_THREAD);
+  TestBlockedPushWakeups(cnstream::SCHEDULER_WORKER_POOL);
+}
+
+/* takes open_ms to open, like a module loading a model */
+class TestSlowOpenProcessor : public TestProcessor {
+ public:
+  TestSlowOpenProcessor(const std::string& name, int open_ms, bool open_ret = true)
+      : TestProcessor(name, 1), open_ms_(open_ms), open_ret_(open_ret) {}
+  bool Open(cnstream::ModuleParamSet param_set) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(open_ms_));
+    if (!open_ret_) return false;
+    ++open_cnt_;
+    return TestProcessor::Open(param_set);
+  }
+  void Close() override {
+    ++close_cnt_;
+    TestProcessor::Close();
+  }
+  int GetOpenCnt() const { return open_cnt_; }
+  int GetCloseCnt() const { return close_cnt_; }
+
+ private:
+  int open_ms_;
+  bool open_ret_;
+  std::atomic<int> open_cnt_{0};
+  std::atomic<int> close_cnt_{0};
+};  // class TestSlowOpenProcessor
+
+/*
+  source ---> slow0 ---> slow1 ---> slow2 ---> slow3
+  returns the time Start takes, each slow module takes 100 ms to open.
+ */
+static double TimeSlowOpenStart(uint32_t open_thread_num) {
+  cnstream::Pipeline pipeline("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.openThreadNum = open_thread_num;
+  pipeline.SetPipelineConfig(pipeline_config);
+  std::shared_ptr<cnstream::Module> prev = std::make_shared<TestProcessor>("source", 1);
+  pipeline.AddModule(prev);
+  EXPECT_TRUE(pipeline.SetModuleParallelism(prev, 0));
+  for (int i = 0; i < 4; ++i) {
+    auto slow = std::make_shared<TestSlowOpenProcessor>("slow" + std::to_string(i), 100);
+    pipeline.AddModule(slow);
+    EXPECT_NE("", pipeline.LinkModules(prev, slow));
+    prev = slow;
+  }
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(pipeline.Start());
+  std::chrono::duration<double, std::milli> start_ms = std::chrono::steady_clock::now() - start;
+  pipeline.Stop();
+  return start_ms.count();
+}
+
+TEST(CorePipeline, ParallelOpen) {
+  const double sequential_ms = TimeSlowOpenStart(1);
+  const double parallel_ms = TimeSlowOpenStart(5);
+  std::cout << "Start: opened one after another in " << sequential_ms << " ms, at once in " << parallel_ms << " ms"
+            << std::endl;
+  EXPECT_GE(sequential_ms, 400);
+  EXPECT_LT(parallel_ms, sequential_ms / 2);
+}
+
+/*
+  ok0, fail1, ok2 and fail3 open at once, ok4 is left once the failures are seen.
+  Start fails and every module opened is closed again.
+ */
+TEST(CorePipeline, ParallelOpenFailure) {
+  cnstream::Pipeline pipeline("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.openThreadNum = 4;
+  pipeline.SetPipelineConfig(pipeline_config);
+  std::vector<std::shared_ptr<TestSlowOpenProcessor>> modules = {
+      std::make_shared<TestSlowOpenProcessor>("ok0", 50), std::make_shared<TestSlowOpenProcessor>("fail1", 10, false),
+      std::make_shared<TestSlowOpenProcessor>("ok2", 50), std::make_shared<TestSlowOpenProcessor>("fail3", 10, false),
+      std::make_shared<TestSlowOpenProcessor>("ok4", 50)};
+  for (auto& it : modules) pipeline.AddModule(it);
+  EXPECT_FALSE(pipeline.Start());
+  EXPECT_FALSE(pipeline.IsRunning());
+  /* the module of the first id is always taken, which others are depends on how fast the threads start */
+  EXPECT_EQ(1, modules[0]->GetOpenCnt());
+  for (auto& it : modules) {
+    EXPECT_EQ(it->GetOpenCnt(), it->GetCloseCnt()) << it->GetName();
+  }
+  /* one after another the opens stop at the first failure */
+  std::vector<int> open_cnts;
+  for (auto& it : modules) open_cnts.push_back(it->GetOpenCnt());
+  pipeline_config.openThreadNum = 1;
+  pipeline.SetPipelineConfig(pipeline_config);
+  EXPECT_FALSE(pipeline.Start());
+  EXPECT_EQ(2, modules[0]->GetOpenCnt());
+  EXPECT_EQ(2, modules[0]->GetCloseCnt());
+  for (size_t i = 1; i < modules.size(); ++i) {
+    EXPECT_EQ(open_cnts[i], modules[i]->GetOpenCnt()) << modules[i]->GetName();
+  }
+}
+
+/* creates a context for each thread in WarmUp, like Inferencer, and counts the frames processed without one */
+class TestWarmUpProcessor : public TestProcessor {
+ public:
+  explicit TestWarmUpProcessor(const std::string& name) : TestProcessor(name, 1) {}
+  void WarmUp() override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::lock_guard<std::mutex> lk(mutex_);
+    contexts_[std::this_thread::get_id()] = std::chrono::steady_clock::now();
+  }
+  int Process(std::shared_ptr<cnstream::CNFrameInfo> data) override {
+    {
+      std::lock_guard<std::mutex> lk(mutex_);
+      if (!contexts_.count(std::this_thread::get_id())) ++cold_frames_;
+    }
+    return TestProcessor::Process(data);
+  }
+  std::vector<std::chrono::steady_clock::time_point> GetContextTimes() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    std::vector<std::chrono::steady_clock::time_point> times;
+    for (auto& it : contexts_) times.push_back(it.second);
+    return times;
+  }
+  int GetColdFrames() {
+    std::lock_guard<std::mutex> lk(mutex_);
+    return cold_frames_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::map<std::thread::id, std::chrono::steady_clock::time_point> contexts_;
+  int cold_frames_ = 0;
+};  // class TestWarmUpProcessor
+
+/*
+  source ---> a(2 threads) ---> b(fused with a)
+  the contexts of all the threads of a and b are created before Start returns, no frame waits for one.
+ */
+static void TestWarmUp(cnstream::SchedulerMode scheduler) {
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline_config.workerNum = 3;
+  pipeline->SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto a = std::make_shared<TestWarmUpProcessor>("a");
+  auto b = std::make_shared<TestWarmUpProcessor>("b");
+  pipeline->AddModule(source);
+  pipeline->AddModule(a);
+  pipeline->AddModule(b);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(a, 2));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(b, 2));
+  EXPECT_NE("", pipeline->LinkModules(source, a));
+  EXPECT_NE("", pipeline->LinkModules(a, b));
+
+  MsgObserver msg_observer(1, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  auto started = std::chrono::steady_clock::now();
+  const size_t thread_num = cnstream::SCHEDULER_WORKER_POOL == scheduler ? 3 : 2;
+  for (auto module : {a, b}) {
+    auto times = module->GetContextTimes();
+    EXPECT_EQ(thread_num, times.size()) << module->GetName();
+    for (auto& time : times) EXPECT_LE(time, started) << module->GetName();
+  }
+  for (int i = 0; i <= 20; ++i) {
+    auto data = cnstream::CNFrameInfo::Create("0", 20 == i);
+    data->channel_idx = 0;
+    data->frame.frame_id = i;
+    EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+  }
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  EXPECT_EQ(20u, b->GetCnts()[0]);
+  EXPECT_EQ(0, a->GetColdFrames());
+  EXPECT_EQ(0, b->GetColdFrames());
+}
+
+TEST(CorePipeline, WarmUp) {
+  TestWarmUp(cnstream::SCHEDULER_THREAD);
+  TestWarmUp(cnstream::SCHEDULER_WORKER_POOL);
+}
+
+/*
+  source ---> a ---> b(2 threads)
+  nothing is processed while paused, the frames provided meanwhile are processed after Resume, each one once,
+  and the modules are not opened again.
+ */
+static void TestPauseResume(cnstream::SchedulerMode scheduler) {
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  cnstream::PipelineConfig pipeline_config;
+  pipeline_config.scheduler = scheduler;
+  pipeline->SetPipelineConfig(pipeline_config);
+  auto source = std::make_shared<TestProcessor>("source", 1);
+  auto a = std::make_shared<TestSlowOpenProcessor>("a", 0);
+  auto b = std::make_shared<TestSlowOpenProcessor>("b", 0);
+  pipeline->AddModule(source);
+  pipeline->AddModule(a);
+  pipeline->AddModule(b);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(b, 2));
+  EXPECT_NE("", pipeline->LinkModules(source, a));
+  EXPECT_NE("", pipeline->LinkModules(a, b));
+
+  MsgObserver msg_observer(1, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  EXPECT_FALSE(pipeline->Pause());
+  ASSERT_TRUE(pipeline->Start());
+  int64_t frame_id = 0;
+  auto provide = [&](int frame_num, bool eos) {
+    for (int i = 0; i < frame_num; ++i) {
+      auto data = cnstream::CNFrameInfo::Create("0", eos && frame_num - 1 == i);
+      data->channel_idx = 0;
+      data->frame.frame_id = frame_id++;
+      EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+    }
+  };
+  provide(10, false);
+  EXPECT_TRUE(pipeline->Pause());
+  EXPECT_TRUE(pipeline->IsPaused());
+  EXPECT_FALSE(pipeline->Pause());
+  const uint64_t a_cnt = a->GetCnts()[0];
+  const uint64_t b_cnt = b->GetCnts()[0];
+  provide(10, false);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(a_cnt, a->GetCnts()[0]);
+  EXPECT_EQ(b_cnt, b->GetCnts()[0]);
+  EXPECT_TRUE(pipeline->Resume());
+  EXPECT_FALSE(pipeline->IsPaused());
+  EXPECT_FALSE(pipeline->Resume());
+  provide(11, true);
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  /* TestProcessor checks frames come in order, so none is processed twice */
+  EXPECT_EQ(30u, a->GetCnts()[0]);
+  EXPECT_EQ(30u, b->GetCnts()[0]);
+  for (auto module : {a, b}) {
+    EXPECT_EQ(1, module->GetOpenCnt());
+    EXPECT_EQ(1, module->GetCloseCnt());
+  }
+}
+
+TEST(CorePipeline, PauseResume) {
+  TestPauseResume(cnstream::SCHEDULER_THREAD);
+  TestPauseResume(cnstream::SCHEDULER_WORKER_POOL);
+}
+
+/*
+  source ---> up(4 threads) ---> down(1 thread, small data queue)
+  the threads of up blocked on the full data queue of down do not hold Pause up.
+ */
+TEST(CorePipeline, PauseWithFullQueues) {
+  const int chn_cnt = 4;
+  const int frame_cnt = 50;
+  auto pipeline = std::make_shared<cnstream::Pipeline>("pipeline");
+  auto source = std::make_shared<TestProcessor>("source", chn_cnt);
+  auto up = std::make_shared<TestProcessor>("up", chn_cnt);
+  auto down = std::make_shared<TestDelayProcessor>("down", 2);
+  pipeline->AddModule(source);
+  pipeline->AddModule(up);
+  pipeline->AddModule(down);
+  EXPECT_TRUE(pipeline->SetModuleParallelism(source, 0));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(up, chn_cnt));
+  EXPECT_TRUE(pipeline->SetModuleParallelism(down, 1));
+  EXPECT_NE("", pipeline->LinkModules(source, up));
+  cnstream::LinkConfig link_config;
+  link_config.queue_capacity = 2;
+  EXPECT_NE("", pipeline->LinkModules(up, down, link_config));
+
+  MsgObserver msg_observer(chn_cnt, pipeline);
+  pipeline->SetStreamMsgObserver(reinterpret_cast<cnstream::StreamMsgObserver*>(&msg_observer));
+  ASSERT_TRUE(pipeline->Start());
+  std::thread feeder([&]() {
+    for (int i = 0; i <= frame_cnt; ++i) {
+      for (int chn_idx = 0; chn_idx < chn_cnt; ++chn_idx) {
+        auto data = cnstream::CNFrameInfo::Create(std::to_string(chn_idx), frame_cnt == i);
+        data->channel_idx = chn_idx;
+        data->frame.frame_id = i;
+        EXPECT_TRUE(pipeline->ProvideData(source.get(), data));
+      }
+    }
+  });
+  /* up is blocked on down by now */
+  while (down->GetProcessed() < 5) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  EXPECT_TRUE(pipeline->Pause());
+  const int processed = down->GetProcessed();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(processed, down->GetProcessed());
+  EXPECT_TRUE(pipeline->Resume());
+  feeder.join();
+  EXPECT_EQ(MsgObserver::STOP_BY_EOS, msg_observer.WaitForStop());
+  EXPECT_EQ(chn_cnt * frame_cnt, down->GetProcessed());
+  for (auto cnt : up->GetCnts()) EXPECT_EQ(static_cast<uint64_t>(frame_cnt), cnt);
+}
@@ -0,0 +1,110 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ring_queue.hpp"
+
+namespace cnstream {
+
+TEST(CoreRingQueue, PushPopInOrder) {
+  RingQueue<std::shared_ptr<int>> q(5);
+  EXPECT_EQ(8u, q.Capacity());
+  EXPECT_TRUE(q.Empty());
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_TRUE(q.TryPush(std::make_shared<int>(i)));
+  }
+  EXPECT_FALSE(q.TryPush(std::make_shared<int>(8))) << "push to a full ring should fail";
+  EXPECT_EQ(8u, q.Size());
+
+  std::shared_ptr<int> value;
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(q.TryPop(value));
+    EXPECT_EQ(i, *value);
+  }
+  EXPECT_FALSE(q.TryPop(value)) << "pop from an empty ring should fail";
+  EXPECT_TRUE(q.Empty());
+}
+
+TEST(CoreRingQueue, ReleaseDataAfterPop) {
+  RingQueue<std::shared_ptr<int>> q(2);
+  std::shared_ptr<int> data = std::make_shared<int>(0);
+  EXPECT_TRUE(q.TryPush(data));
+  EXPECT_EQ(2, data.use_count());
+  std::shared_ptr<int> value;
+  EXPECT_TRUE(q.TryPop(value));
+  value.reset();
+  EXPECT_EQ(1, data.use_count()) << "ring should not hold a reference to popped data";
+}
+
+static void TestRingQueueMultiThread(bool single_producer, bool single_consumer) {
+  const int producer_num = single_producer ? 1 : 4;
+  const int consumer_num = single_consumer ? 1 : 4;
+  const int per_producer = 100000;
+  RingQueue<int> q(64, single_producer, single_consumer);
+  std::vector<std::atomic<int>> received(producer_num * per_producer);
+  for (auto& it : received) it = 0;
+  std::atomic<int> pop_cnt{0};
+  std::vector<std::thread> threads;
+
+  for (int p = 0; p < producer_num; ++p) {
+    threads.push_back(std::thread([&, p]() {
+      for (int i = 0; i < per_producer; ++i) {
+        while (!q.TryPush(p * per_producer + i)) std::this_thread::yield();
+      }
+    }));
+  }
+  for (int c = 0; c < consumer_num; ++c) {
+    threads.push_back(std::thread([&]() {
+      std::vector<int> last(producer_num, -1);
+      int value;
+      while (pop_cnt.load() < producer_num * per_producer) {
+        if (!q.TryPop(value)) {
+          std::this_thread::yield();
+          continue;
+        }
+        pop_cnt++;
+        received[value]++;
+        // items of one producer come out in push order
+        int p = value / per_producer;
+        EXPECT_LT(last[p], value);
+        last[p] = value;
+      }
+    }));
+  }
+  for (auto& it : threads) it.join();
+
+  EXPECT_EQ(producer_num * per_producer, pop_cnt.load());
+  for (auto& it : received) EXPECT_EQ(1, it.load());
+  EXPECT_TRUE(q.Empty());
+}
+
+TEST(CoreRingQueue, SingleProducerSingleConsumer) { TestRingQueueMultiThread(true, true); }
+
+TEST(CoreRingQueue, MultiProducerSingleConsumer) { TestRingQueueMultiThread(false, true); }
+
+TEST(CoreRingQueue, MultiProducerMultiConsumer) { TestRingQueueMultiThread(false, false); }
+
+}  // namespace cnstream
@@ -22,12 +22,14 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
 #include <chrono>
+#include <cstring>
 #include <ctime>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <memory>
 #include <random>
+#include <thread>
 #include "cnstream_frame.hpp"
 
 #include "cnstream_syncmem.hpp"
@@ -163,3 +165,16 @@ TEST(CoreSyncedMem, SyncedMem) {
   t = time(NULL);
   //  std::cout << std::put_time(std::localtime(&t), "%Y-%m-%d %H.%M.%S") << std::endl;
 }
+
+TEST(CoreSyncedMem, MallocHostOnNumaNode) {
+  EXPECT_EQ(-1, cnstream::CNStreamGetHostMemoryNode());
+  cnstream::CNStreamSetHostMemoryNode(0);
+  void* ptr = nullptr;
+  cnstream::CNStreamMallocHost(&ptr, 100);
+  ASSERT_NE(nullptr, ptr);
+  memset(ptr, 0xff, 100);
+  cnstream::CNStreamFreeHost(ptr);
+  /* the node is the calling thread's */
+  std::thread([] { EXPECT_EQ(-1, cnstream::CNStreamGetHostMemoryNode()); }).join();
+  cnstream::CNStreamSetHostMemoryNode(-1);
+}
@@ -0,0 +1,110 @@
+/*************************************************************************
+ * Copyright (C) [2019] by Cambricon, Inc. All rights reserved
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *************************************************************************/
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "worker_pool.hpp"
+
+namespace cnstream {
+
+class CountTask : public PoolTask {
+ public:
+  explicit CountTask(std::atomic<int>* cnt) : cnt_(cnt) {}
+  void Run() override { cnt_->fetch_add(1); }
+
+ private:
+  std::atomic<int>* cnt_;
+};
+
+/* resubmits itself from the worker until it has run `runs` times */
+class RepeatTask : public PoolTask {
+ public:
+  RepeatTask(WorkerPool* pool, int runs, std::atomic<int>* finished) : pool_(pool), runs_(runs), finished_(finished) {}
+  void Run() override {
+    if (--runs_ > 0) {
+      pool_->Submit(this, true);
+    } else {
+      finished_->fetch_add(1);
+    }
+  }
+
+ private:
+  WorkerPool* pool_;
+  int runs_;
+  std::atomic<int>* finished_;
+};
+
+static bool WaitFor(const std::atomic<int>& cnt, int expected) {
+  auto start = std::chrono::steady_clock::now();
+  while (cnt.load() != expected) {
+    if (std::chrono::steady_clock::now() - start > std::chrono::seconds(5)) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+TEST(CoreWorkerPool, RunSubmittedTasks) {
+  WorkerPool pool(4);
+  EXPECT_EQ(4u, pool.GetWorkerNum());
+  std::atomic<int> cnt{0};
+  std::vector<std::unique_ptr<CountTask>> tasks;
+  for (int i = 0; i < 1000; ++i) tasks.emplace_back(new CountTask(&cnt));
+  /* tasks submitted before start run after start */
+  for (int i = 0; i < 500; ++i) pool.Submit(tasks[i].get());
+  pool.Start();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 5; ++t) {
+    threads.push_back(std::thread([&, t]() {
+      for (int i = 500 + t * 100; i < 600 + t * 100; ++i) pool.Submit(tasks[i].get());
+    }));
+  }
+  for (auto& it : threads) it.join();
+  EXPECT_TRUE(WaitFor(cnt, 1000));
+  pool.Stop();
+  EXPECT_EQ(1000, cnt.load());
+}
+
+TEST(CoreWorkerPool, SubmitFromWorker) {
+  WorkerPool pool(2);
+  pool.Start();
+  std::atomic<int> finished{0};
+  std::vector<std::unique_ptr<RepeatTask>> tasks;
+  for (int i = 0; i < 16; ++i) {
+    tasks.emplace_back(new RepeatTask(&pool, 100, &finished));
+    pool.Submit(tasks.back().get());
+  }
+  EXPECT_TRUE(WaitFor(finished, 16));
+  pool.Stop();
+}
+
+TEST(CoreWorkerPool, DefaultWorkerNum) {
+  WorkerPool pool(0);
+  EXPECT_GE(pool.GetWorkerNum(), 1u);
+  pool.Start();
+  pool.Stop();
+  pool.Stop();
+}
+
+}  // namespace cnstream